@@ -0,0 +1,27 @@
+{
+	"targets": [
+		{
+			"target_name": "fakepcsc",
+			"type": "shared_library",
+			"sources": [
+				"fakepcsc.cpp"
+			],
+			"cflags": [
+				"-Wall",
+				"-Wextra",
+				"-Wno-unused-parameter",
+				"-fPIC",
+				"-pedantic"
+			],
+			"cflags_cc": [
+				"-std=c++17"
+			],
+			"include_dirs": [
+				"/usr/include/PCSC"
+			],
+			"ldflags": [
+				"-pthread"
+			]
+		}
+	]
+}
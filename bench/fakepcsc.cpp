@@ -0,0 +1,298 @@
+// Stand-in PC/SC library for the soak benchmark, loaded in place of
+// libpcsclite through the library option. It serves FAKE_PCSC_READERS
+// readers (4 by default), each with a card inserted answering APDUs and
+// control commands with an echo, and attaches or detaches one more reader
+// every FAKE_PCSC_CHURN_MS ms (50 by default). Released contexts and handles fail with
+// SCARD_E_INVALID_HANDLE, as they do with pcscd.
+
+#include <winscard.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+
+#define HOTPLUG_READER "Fake Hotplug Reader"
+#define PNP_READER "\\\\?PnP?\\Notification"
+
+struct FakeReader {
+    DWORD counter;
+};
+
+struct FakeHandle {
+    SCARDCONTEXT context;
+    std::string reader;
+};
+
+struct FakeState {
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::map<std::string, FakeReader> readers;
+    std::set<SCARDCONTEXT> contexts;
+    std::set<SCARDCONTEXT> cancelled;
+    std::map<SCARDHANDLE, FakeHandle> handles;
+    DWORD pnp_counter = 0;
+    uintptr_t next_id = 1;
+};
+
+// Never destroyed, the churn thread outlives main()
+static FakeState& fake = *new FakeState();
+
+static const BYTE ATR[] = { 0x3B, 0x80, 0x80, 0x01, 0x01 };
+
+static unsigned int env_value(const char* name, unsigned int fallback) {
+    const char* value = getenv(name);
+    return value ? static_cast<unsigned int>(atoi(value)) : fallback;
+}
+
+static void churn(unsigned int period_ms) {
+    for (;;) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(period_ms));
+
+        std::unique_lock<std::mutex> lock(fake.mutex);
+        if (fake.readers.erase(HOTPLUG_READER)) {
+            // Its handles go away with it
+            for (auto it = fake.handles.begin(); it != fake.handles.end();) {
+                it = (it->second.reader == HOTPLUG_READER) ? fake.handles.erase(it) : std::next(it);
+            }
+        } else {
+            fake.readers[HOTPLUG_READER].counter = 0;
+        }
+        fake.pnp_counter = (fake.pnp_counter + 1) & 0xFFFF;
+        fake.changed.notify_all();
+    }
+}
+
+static void setup() {
+    static std::once_flag once;
+    std::call_once(once, []() {
+        unsigned int readers = env_value("FAKE_PCSC_READERS", 4);
+        for (unsigned int i = 0; i < readers; i++) {
+            fake.readers["Fake Reader " + std::to_string(i)].counter = 0;
+        }
+
+        unsigned int period_ms = env_value("FAKE_PCSC_CHURN_MS", 50);
+        if (period_ms) {
+            std::thread(churn, period_ms).detach();
+        }
+    });
+}
+
+// Current state of one reader, SCARD_STATE_CHANGED set when it differs from
+// what the caller knows. False when the reader is unknown.
+static bool reader_state(SCARD_READERSTATE* state) {
+    DWORD event_state;
+
+    if (!strcmp(state->szReader, PNP_READER)) {
+        event_state = fake.pnp_counter << 16;
+    } else {
+        auto it = fake.readers.find(state->szReader);
+        if (it == fake.readers.end()) {
+            state->dwEventState = SCARD_STATE_UNKNOWN | SCARD_STATE_CHANGED | SCARD_STATE_IGNORE;
+            return false;
+        }
+        event_state = SCARD_STATE_PRESENT | (it->second.counter << 16);
+        memcpy(state->rgbAtr, ATR, sizeof(ATR));
+        state->cbAtr = sizeof(ATR);
+    }
+
+    if (state->dwCurrentState == SCARD_STATE_UNAWARE ||
+        (state->dwCurrentState & ~(DWORD)SCARD_STATE_CHANGED) != event_state) {
+        event_state |= SCARD_STATE_CHANGED;
+    }
+    state->dwEventState = event_state;
+    return true;
+}
+
+extern "C" {
+
+LONG SCardEstablishContext(DWORD scope, LPCVOID reserved1, LPCVOID reserved2, LPSCARDCONTEXT context) {
+    setup();
+
+    std::unique_lock<std::mutex> lock(fake.mutex);
+    *context = fake.next_id++;
+    fake.contexts.insert(*context);
+    return SCARD_S_SUCCESS;
+}
+
+LONG SCardReleaseContext(SCARDCONTEXT context) {
+    std::unique_lock<std::mutex> lock(fake.mutex);
+    if (!fake.contexts.erase(context)) {
+        return SCARD_E_INVALID_HANDLE;
+    }
+
+    for (auto it = fake.handles.begin(); it != fake.handles.end();) {
+        it = (it->second.context == context) ? fake.handles.erase(it) : std::next(it);
+    }
+    fake.cancelled.erase(context);
+    return SCARD_S_SUCCESS;
+}
+
+LONG SCardIsValidContext(SCARDCONTEXT context) {
+    std::unique_lock<std::mutex> lock(fake.mutex);
+    return fake.contexts.count(context) ? SCARD_S_SUCCESS : SCARD_E_INVALID_HANDLE;
+}
+
+LONG SCardListReaders(SCARDCONTEXT context, LPCSTR groups, LPSTR readers, LPDWORD readers_len) {
+    std::unique_lock<std::mutex> lock(fake.mutex);
+    if (!fake.contexts.count(context)) {
+        return SCARD_E_INVALID_HANDLE;
+    }
+
+    if (fake.readers.empty()) {
+        return SCARD_E_NO_READERS_AVAILABLE;
+    }
+
+    std::string names;
+    for (const auto& reader : fake.readers) {
+        names.append(reader.first);
+        names.push_back('\0');
+    }
+    names.push_back('\0');
+
+    if (readers == NULL) {
+        *readers_len = names.size();
+        return SCARD_S_SUCCESS;
+    }
+
+    if (*readers_len == SCARD_AUTOALLOCATE) {
+        char* buffer = static_cast<char*>(malloc(names.size()));
+        memcpy(buffer, names.data(), names.size());
+        *reinterpret_cast<char**>(readers) = buffer;
+    } else if (*readers_len < names.size()) {
+        *readers_len = names.size();
+        return SCARD_E_INSUFFICIENT_BUFFER;
+    } else {
+        memcpy(readers, names.data(), names.size());
+    }
+
+    *readers_len = names.size();
+    return SCARD_S_SUCCESS;
+}
+
+LONG SCardFreeMemory(SCARDCONTEXT context, LPCVOID memory) {
+    free(const_cast<void*>(memory));
+    return SCARD_S_SUCCESS;
+}
+
+LONG SCardGetStatusChange(SCARDCONTEXT context, DWORD timeout, SCARD_READERSTATE* states, DWORD count) {
+    std::unique_lock<std::mutex> lock(fake.mutex);
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() +
+        std::chrono::milliseconds(timeout == INFINITE ? 24 * 3600 * 1000 : timeout);
+
+    if (!fake.contexts.count(context)) {
+        return SCARD_E_INVALID_HANDLE;
+    }
+
+    // A reader unknown from the start is an error, one going away a change
+    for (DWORD i = 0; i < count; i++) {
+        if (!reader_state(&states[i]) && states[i].dwCurrentState != SCARD_STATE_UNAWARE) {
+            return SCARD_E_UNKNOWN_READER;
+        }
+    }
+
+    for (;;) {
+        if (fake.cancelled.erase(context)) {
+            return SCARD_E_CANCELLED;
+        }
+
+        bool changed = false;
+        for (DWORD i = 0; i < count; i++) {
+            reader_state(&states[i]);
+            changed = changed || (states[i].dwEventState & SCARD_STATE_CHANGED);
+        }
+
+        if (changed) {
+            return SCARD_S_SUCCESS;
+        }
+
+        if (fake.changed.wait_until(lock, deadline) == std::cv_status::timeout) {
+            return SCARD_E_TIMEOUT;
+        }
+
+        if (!fake.contexts.count(context)) {
+            return SCARD_E_INVALID_HANDLE;
+        }
+    }
+}
+
+LONG SCardCancel(SCARDCONTEXT context) {
+    std::unique_lock<std::mutex> lock(fake.mutex);
+    if (!fake.contexts.count(context)) {
+        return SCARD_E_INVALID_HANDLE;
+    }
+
+    fake.cancelled.insert(context);
+    fake.changed.notify_all();
+    return SCARD_S_SUCCESS;
+}
+
+LONG SCardConnect(SCARDCONTEXT context, LPCSTR reader, DWORD share_mode,
+                  DWORD preferred_protocols, LPSCARDHANDLE handle, LPDWORD protocol) {
+    std::unique_lock<std::mutex> lock(fake.mutex);
+    if (!fake.contexts.count(context)) {
+        return SCARD_E_INVALID_HANDLE;
+    }
+
+    if (!fake.readers.count(reader)) {
+        return SCARD_E_UNKNOWN_READER;
+    }
+
+    *handle = fake.next_id++;
+    fake.handles[*handle] = FakeHandle{ context, reader };
+    *protocol = (preferred_protocols & SCARD_PROTOCOL_T1) ? SCARD_PROTOCOL_T1 : SCARD_PROTOCOL_T0;
+    return SCARD_S_SUCCESS;
+}
+
+LONG SCardDisconnect(SCARDHANDLE handle, DWORD disposition) {
+    std::unique_lock<std::mutex> lock(fake.mutex);
+    return fake.handles.erase(handle) ? SCARD_S_SUCCESS : SCARD_E_INVALID_HANDLE;
+}
+
+LONG SCardTransmit(SCARDHANDLE handle, const SCARD_IO_REQUEST* send_pci,
+                   LPCBYTE send_buffer, DWORD send_len, SCARD_IO_REQUEST* recv_pci,
+                   LPBYTE recv_buffer, LPDWORD recv_len) {
+    std::unique_lock<std::mutex> lock(fake.mutex);
+    if (!fake.handles.count(handle)) {
+        return SCARD_E_INVALID_HANDLE;
+    }
+
+    if (*recv_len < send_len + 2) {
+        return SCARD_E_INSUFFICIENT_BUFFER;
+    }
+
+    memcpy(recv_buffer, send_buffer, send_len);
+    recv_buffer[send_len] = 0x90;
+    recv_buffer[send_len + 1] = 0x00;
+    *recv_len = send_len + 2;
+    return SCARD_S_SUCCESS;
+}
+
+LONG SCardControl(SCARDHANDLE handle, DWORD control_code, LPCVOID send_buffer, DWORD send_len,
+                  LPVOID recv_buffer, DWORD recv_len, LPDWORD returned_len) {
+    std::unique_lock<std::mutex> lock(fake.mutex);
+    if (!fake.handles.count(handle)) {
+        return SCARD_E_INVALID_HANDLE;
+    }
+
+    if (recv_len < send_len) {
+        return SCARD_E_INSUFFICIENT_BUFFER;
+    }
+
+    memcpy(recv_buffer, send_buffer, send_len);
+    *returned_len = send_len;
+    return SCARD_S_SUCCESS;
+}
+
+const char* pcsc_stringify_error(const LONG error) {
+    static thread_local char message[32];
+    snprintf(message, sizeof(message), "Fake error 0x%08lX", (unsigned long)error);
+    return message;
+}
+
+}
@@ -0,0 +1,173 @@
+"use strict";
+
+// Soak benchmark: connect/transmit/control/disconnect cycles on every reader
+// and reader attach/detach cycles, against the stand-in PC/SC library of
+// fakepcsc.cpp. The native resources are sampled along the way, and the run
+// fails when any is still held once everything is closed.
+//
+//   node-gyp rebuild -C bench
+//   node --expose-gc bench/soak.js [cycles] [sample interval in ms]
+
+const fs = require('fs');
+const path = require('path');
+
+const CYCLES = Number(process.argv[2]) || 1000000;
+const INTERVAL = Number(process.argv[3]) || 5000;
+const APDU = Buffer.from([0x00, 0xB0, 0x00, 0x00, 0x10]);
+const CONTROL_DATA = Buffer.from([0x01, 0x02, 0x03, 0x04]);
+const LIBRARY = path.join(__dirname, 'build', 'Release', 'libfakepcsc.so');
+
+if (!fs.existsSync(LIBRARY)) {
+	console.error('Build the stand-in PC/SC library first: node-gyp rebuild -C bench');
+	process.exit(1);
+}
+
+if (!global.gc) {
+	console.error('Run with node --expose-gc');
+	process.exit(1);
+}
+
+const pcsclite = require('../lib/pcsclite');
+
+const pcsc = pcsclite({ library: LIBRARY });
+const start = Date.now();
+const counts = { cycles: 0, errors: 0, attached: 0, detached: 0 };
+const ended = new WeakSet();
+let stopping = false;
+
+const mb = bytes => (bytes / 1048576).toFixed(1) + ' MB';
+
+function sample() {
+
+	const stats = pcsclite.stats();
+	const memory = process.memoryUsage();
+
+	console.log([
+		((Date.now() - start) / 1000).toFixed(0) + ' s',
+		'cycles ' + counts.cycles,
+		'errors ' + counts.errors,
+		'attach/detach ' + counts.attached + '/' + counts.detached,
+		'rss ' + mb(memory.rss),
+		'native heap ' + (stats.heap === undefined ? '-' : mb(stats.heap)),
+		'threads ' + stats.threads.live,
+		'contexts ' + stats.contexts.live,
+		'handles ' + stats.handles.live,
+		'workers ' + stats.workers.live,
+	].join(', '));
+
+	return stats;
+
+}
+
+// connect, transmit, control and disconnect, over and over
+function cycle(reader) {
+
+	if (stopping || ended.has(reader)) {
+		return;
+	}
+
+	const next = function (err) {
+
+		if (err) {
+			counts.errors++;
+		}
+
+		counts.cycles++;
+		if (counts.cycles >= CYCLES) {
+			return stop();
+		}
+
+		setImmediate(cycle, reader);
+
+	};
+
+	reader.connect({ share_mode: reader.SCARD_SHARE_SHARED }, function (err) {
+
+		if (err) {
+			return next(err);
+		}
+
+		reader.transmit(APDU, 258, reader.SCARD_PROTOCOL_T1, function (err) {
+
+			if (err) {
+				return reader.disconnect(reader.SCARD_LEAVE_CARD, () => next(err));
+			}
+
+			reader.control(CONTROL_DATA, reader.SCARD_CTL_CODE(1), 16, function (err) {
+
+				reader.disconnect(reader.SCARD_LEAVE_CARD, function (disconnectErr) {
+					next(err || disconnectErr);
+				});
+
+			});
+
+		});
+
+	});
+
+}
+
+function stop() {
+
+	if (stopping) {
+		return;
+	}
+
+	stopping = true;
+	clearInterval(timer);
+
+	Object.keys(pcsc.readers).forEach(name => pcsc.readers[name].close());
+	pcsc.close();
+
+	// the native threads end asynchronously, and the card contexts go away
+	// with their CardReader objects
+	setTimeout(function () {
+
+		global.gc();
+
+	}, 500);
+
+	setTimeout(function () {
+
+		global.gc();
+		const stats = sample();
+		const held = ['contexts', 'handles', 'threads', 'workers'].filter(name => stats[name].live !== 0);
+
+		if (held.length) {
+			console.error('Still held after close: ' + held.join(', '));
+			process.exit(1);
+		}
+
+		console.log('No native resource left');
+		process.exit(0);
+
+	}, 1000);
+
+}
+
+pcsc.on('error', function (err) {
+	console.error('PCSC error', err.message);
+	counts.errors++;
+});
+
+pcsc.on('reader', function (reader) {
+
+	counts.attached++;
+
+	// a reader going away while it is in use is part of the test
+	reader.on('error', () => counts.errors++);
+	reader.on('end', function () {
+		ended.add(reader);
+		counts.detached++;
+	});
+
+	// the attach/detach cycles only go through the reader list and monitor
+	if (!/^Fake Hotplug/.test(reader.name)) {
+		cycle(reader);
+	}
+
+});
+
+const timer = setInterval(sample, INTERVAL);
+
+process.on('SIGINT', stop);
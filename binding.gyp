@@ -1,42 +1,102 @@
 {
 	"variables": {
 		"module_name": "pcsclite",
-		"module_path": "./build/Release/"
+		"module_path": "./build/Release/",
+		"pcsc_dynamic%": "true",
+		"secure_messaging%": "false",
+		"usdt%": "false",
+		"openssl_root%": ""
+	},
+	"target_defaults": {
+		"cflags": [
+			"-Wall",
+			"-Wextra",
+			"-Wno-unused-parameter",
+			"-fPIC",
+			"-fno-strict-aliasing",
+			"-fno-exceptions",
+			"-pedantic"
+		],
+		"conditions": [
+			[
+				"OS=='linux'",
+				{
+					"include_dirs": [
+						"/usr/include/PCSC"
+					]
+				}
+			]
+		]
 	},
 	"targets": [
 		{
-			"target_name": "<(module_name)",
+			"target_name": "pcsclite_core",
+			"type": "static_library",
 			"sources": [
-				"src/addon.cpp",
-				"src/pcsclite.cpp",
-				"src/cardreader.cpp"
-			],
-			"cflags": [
-				"-Wall",
-				"-Wextra",
-				"-Wno-unused-parameter",
-				"-fPIC",
-				"-fno-strict-aliasing",
-				"-fno-exceptions",
-				"-pedantic"
+				"src/core/apducache.cpp",
+				"src/core/arbiter.cpp",
+				"src/core/atr.cpp",
+				"src/core/broadcast.cpp",
+				"src/core/debounce.cpp",
+				"src/core/pcscapi.cpp",
+				"src/core/pcscerror.cpp",
+				"src/core/poller.cpp",
+				"src/core/reader.cpp",
+				"src/core/readerfeatures.cpp",
+				"src/core/readerfilter.cpp",
+				"src/core/readerlist.cpp",
+				"src/core/readermonitor.cpp",
+				"src/core/recovery.cpp",
+				"src/core/sharedstate.cpp",
+				"src/core/stats.cpp",
+				"src/core/storagecard.cpp",
+				"src/core/tlv.cpp"
 			],
 			"include_dirs": [
-				"<!@(node -p \"require('node-addon-api').include\")"
-			],
-			"dependencies": [
-				"<!(node -p \"require('node-addon-api').gyp\")"
-			],
-			"defines": [ 
-				"NAPI_DISABLE_CPP_EXCEPTIONS",
-				"NAPI_VERSION=8"
+				"src/core"
 			],
+			"direct_dependent_settings": {
+				"include_dirs": [
+					"src/core"
+				]
+			},
 			"conditions": [
 				[
-					"OS=='linux'",
+					"OS!='win' and pcsc_dynamic=='true'",
 					{
-						"include_dirs": [
-							"/usr/include/PCSC"
+						"defines": [
+							"PCSC_DYNAMIC"
 						],
+						"direct_dependent_settings": {
+							"defines": [
+								"PCSC_DYNAMIC"
+							]
+						}
+					}
+				],
+				[
+					"OS=='linux'",
+					{
+						"link_settings": {
+							"libraries": [
+								"-lrt"
+							]
+						}
+					}
+				],
+				[
+					"OS=='linux' and pcsc_dynamic=='true'",
+					{
+						"link_settings": {
+							"libraries": [
+								"-ldl"
+							]
+						}
+					}
+				],
+				[
+					"OS=='linux' and pcsc_dynamic!='true'",
+					{
 						"link_settings": {
 							"libraries": [
 								"-lpcsclite"
@@ -48,24 +108,109 @@
 					}
 				],
 				[
-					"OS=='mac'",
+					"OS=='mac' and pcsc_dynamic!='true'",
 					{
-						"libraries": [
-							"-framework",
-							"PCSC"
-						]
+						"link_settings": {
+							"libraries": [
+								"-framework",
+								"PCSC"
+							]
+						}
 					}
 				],
 				[
 					"OS=='win'",
 					{
-						"libraries": [
-							"-lWinSCard"
+						"link_settings": {
+							"libraries": [
+								"-lWinSCard"
+							]
+						}
+					}
+				],
+				[
+					"OS=='linux' and usdt=='true'",
+					{
+						"defines": [
+							"PCSC_USDT"
+						],
+						"direct_dependent_settings": {
+							"defines": [
+								"PCSC_USDT"
+							]
+						}
+					}
+				],
+				[
+					"secure_messaging=='true'",
+					{
+						"sources": [
+							"src/core/securemessaging.cpp"
+						],
+						"defines": [
+							"PCSC_SECURE_MESSAGING"
+						],
+						"direct_dependent_settings": {
+							"defines": [
+								"PCSC_SECURE_MESSAGING"
+							]
+						},
+						"conditions": [
+							[
+								"openssl_root!=''",
+								{
+									"include_dirs": [
+										"<(openssl_root)/include"
+									],
+									"link_settings": {
+										"library_dirs": [
+											"<(openssl_root)/lib"
+										]
+									}
+								}
+							],
+							[
+								"OS=='win'",
+								{
+									"link_settings": {
+										"libraries": [
+											"-llibcrypto"
+										]
+									}
+								},
+								{
+									"link_settings": {
+										"libraries": [
+											"-lcrypto"
+										]
+									}
+								}
+							]
 						]
 					}
 				]
 			]
 		},
+		{
+			"target_name": "<(module_name)",
+			"sources": [
+				"src/addon.cpp",
+				"src/pcsclite.cpp",
+				"src/cardreader.cpp",
+				"src/readerpool.cpp"
+			],
+			"include_dirs": [
+				"<!@(node -p \"require('node-addon-api').include\")"
+			],
+			"dependencies": [
+				"pcsclite_core",
+				"<!(node -p \"require('node-addon-api').gyp\")"
+			],
+			"defines": [ 
+				"NAPI_DISABLE_CPP_EXCEPTIONS",
+				"NAPI_VERSION=8"
+			]
+		},
 		{
 			"target_name": "action_after_build",
 			"type": "none",
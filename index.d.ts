@@ -3,23 +3,292 @@ import { EventEmitter } from "events";
 type ConnectOptions = {
 	share_mode?: number;
 	protocol?: number;
+	wait?: number;
+};
+
+type ReaderFeatureCodes = {
+	verify_pin_start?: number;
+	verify_pin_finish?: number;
+	modify_pin_start?: number;
+	modify_pin_finish?: number;
+	get_key_pressed?: number;
+	verify_pin_direct?: number;
+	modify_pin_direct?: number;
+	mct_reader_direct?: number;
+	mct_universal?: number;
+	ifd_pin_properties?: number;
+	abort?: number;
+	set_spe_message?: number;
+	verify_pin_direct_app_id?: number;
+	modify_pin_direct_app_id?: number;
+	write_display?: number;
+	get_key?: number;
+	ifd_display_properties?: number;
+	get_tlv_properties?: number;
+	ccid_esc_command?: number;
+	execute_pace?: number;
+};
+
+type ReaderProperties = {
+	wLcdLayout?: number;
+	bEntryValidationCondition?: number;
+	bTimeOut2?: number;
+	wLcdMaxCharacters?: number;
+	wLcdMaxLines?: number;
+	bMinPINSize?: number;
+	bMaxPINSize?: number;
+	sFirmwareID?: string;
+	bPPDUSupport?: number;
+	dwMaxAPDUDataSize?: number;
+	wIdVendor?: number;
+	wIdProduct?: number;
+};
+
+type PinOptions = {
+	timeout?: number;
+	timeout2?: number;
+	format?: number;
+	pin_block?: number;
+	length_format?: number;
+	min?: number;
+	max?: number;
+	entry_validation?: number;
+	messages?: number;
+	lang_id?: number;
+	msg_index?: number | number[];
+	offset_old?: number;
+	offset_new?: number;
+	confirm?: number;
+};
+
+type StorageOptions = {
+	verify?: boolean;
+	page_size?: number;
+	first_page?: number;
+	pages?: number;
+};
+
+type StorageLayout = {
+	page_size: number;
+	first_page: number;
+	pages: number;
+	version?: Buffer;
+	chunk?: number;
+};
+
+type CardType =
+	| "mifare_classic_1k"
+	| "mifare_classic_4k"
+	| "mifare_mini"
+	| "mifare_ultralight"
+	| "mifare_ultralight_c"
+	| "mifare_ultralight_ev1"
+	| "mifare_plus_2k"
+	| "mifare_plus_4k"
+	| "felica"
+	| "icode"
+	| "topaz"
+	| "iso15693"
+	| "storage"
+	| "iso14443_4"
+	| "iso7816"
+	| "unknown";
+
+type AtrInfo = {
+	valid: boolean;
+	ts: number;
+	t0: number;
+	interfaces: { ta?: number; tb?: number; tc?: number; td?: number }[];
+	historical?: Buffer;
+	tck?: number;
+	protocols: number;
+	storage: boolean;
+	standard?: number;
+	card_name?: number;
+	card_type: CardType;
 };
 
 type Status = {
 	atr?: Buffer;
+	card_type?: CardType;
+	atr_info?: AtrInfo;
+	uid?: Buffer;
 	state: number;
+	timestamp: bigint;
+	event_count: number;
 };
 
 type AnyOrNothing = any | undefined | null;
 
+type ReaderNameFilter = string | RegExp;
+
+type PCSCLiteOptions = {
+	include?: ReaderNameFilter | ReaderNameFilter[];
+	exclude?: ReaderNameFilter | ReaderNameFilter[];
+	library?: string;
+	poll?: { min?: number; max?: number };
+	shared?: string;
+};
+
+type BroadcastOptions = {
+	concurrency?: number;
+};
+
+type BroadcastResult = {
+	reader: CardReader;
+	responses: Buffer[];
+	error?: Error;
+};
+
+type ControlBatchEntry = {
+	reader: CardReader;
+	control_code: number;
+	data: Buffer;
+	res_len: number;
+};
+
+type ControlBatchResult = {
+	reader: CardReader;
+	response: Buffer;
+	error?: Error;
+};
+
+type CacheRule = Buffer | {
+	apdu: Buffer;
+	mask?: Buffer;
+};
+
+type CacheOptions = {
+	max_entries?: number;
+};
+
+type DebounceOptions = {
+	dwell?: number;
+	suppress?: number;
+	uid?: boolean;
+};
+
+type TransmitOptions = {
+	tlv?: boolean;
+};
+
+type TagPath = number | string | (number | string)[];
+
+type SecureMessagingOptions = {
+	cipher: "3des" | "aes";
+	enc: Buffer;
+	mac: Buffer;
+	ssc: Buffer;
+};
+
+type QueueOptions = {
+	highWaterMark?: number;
+	overflow?: "block" | "drop-oldest" | "coalesce";
+};
+
+type EventStamp = {
+	timestamp: bigint;
+	event_count: number;
+};
+
+type ReaderEvent = {
+	type: "add" | "remove";
+	reader: CardReader;
+	timestamp?: bigint;
+	event_count?: number;
+};
+
+type PoolOptions = {
+	name?: string | RegExp;
+	atr?: Buffer | ((atr: Buffer) => boolean);
+	share_mode?: number;
+	protocol?: number;
+};
+
 interface PCSCLite extends EventEmitter {
+	shared?: "owner" | "follower";
+
 	on(type: "error", listener: (error: any) => void): this;
 
 	once(type: "error", listener: (error: any) => void): this;
 
-	on(type: "reader", listener: (reader: CardReader) => void): this;
+	on(type: "reader", listener: (reader: CardReader, stamp?: EventStamp) => void): this;
+
+	once(type: "reader", listener: (reader: CardReader, stamp?: EventStamp) => void): this;
+
+	on(type: "recovering" | "recovered", listener: () => void): this;
+
+	once(type: "recovering" | "recovered", listener: () => void): this;
+
+	on(type: "close", listener: () => void): this;
+
+	once(type: "close", listener: () => void): this;
+
+	broadcast(
+		readers: CardReader[],
+		apdus: Buffer[],
+		res_len: number,
+		cb: (err: AnyOrNothing, results: BroadcastResult[]) => void
+	): void;
+
+	broadcast(
+		readers: CardReader[],
+		apdus: Buffer[],
+		res_len: number,
+		options: BroadcastOptions,
+		cb: (err: AnyOrNothing, results: BroadcastResult[]) => void
+	): void;
+
+	controlBatch(
+		entries: ControlBatchEntry[],
+		cb: (err: AnyOrNothing, results: ControlBatchResult[]) => void
+	): void;
+
+	controlBatch(
+		entries: ControlBatchEntry[],
+		options: BroadcastOptions,
+		cb: (err: AnyOrNothing, results: ControlBatchResult[]) => void
+	): void;
 
-	once(type: "reader", listener: (reader: CardReader) => void): this;
+	pool(options?: PoolOptions): ReaderPool;
+
+	readerEvents(options?: QueueOptions): AsyncIterableIterator<ReaderEvent>;
+
+	rescan(): void;
+
+	close(): void;
+}
+
+interface ReaderPool extends EventEmitter {
+	size: number;
+
+	on(type: "error", listener: (error: any) => void): this;
+
+	once(type: "error", listener: (error: any) => void): this;
+
+	on(type: "add", listener: (reader: CardReader) => void): this;
+
+	once(type: "add", listener: (reader: CardReader) => void): this;
+
+	on(type: "evict", listener: (reader: CardReader, error: Error) => void): this;
+
+	once(type: "evict", listener: (reader: CardReader, error: Error) => void): this;
+
+	add(reader: CardReader): boolean;
+
+	remove(reader: CardReader): boolean;
+
+	transmit(
+		data: Buffer,
+		res_len: number,
+		cb: (err: AnyOrNothing, response: Buffer, reader: CardReader) => void
+	): void;
+
+	transmit(
+		data: Buffer[],
+		res_len: number,
+		cb: (err: AnyOrNothing, responses: Buffer[], reader: CardReader) => void
+	): void;
 
 	close(): void;
 }
@@ -62,6 +331,10 @@ interface CardReader extends EventEmitter {
 
 	once(type: "end", listener: (this: CardReader) => void): this;
 
+	on(type: "recovering" | "recovered", listener: (this: CardReader) => void): this;
+
+	once(type: "recovering" | "recovered", listener: (this: CardReader) => void): this;
+
 	on(
 		type: "status",
 		listener: (this: CardReader, status: Status) => void
@@ -75,7 +348,7 @@ interface CardReader extends EventEmitter {
 	SCARD_CTL_CODE(code: number): number;
 
 	get_status(
-		cb: (err: AnyOrNothing, state: number, atr?: Buffer) => void
+		cb: (err: AnyOrNothing, status: Status) => void
 	): void;
 
 	connect(callback: (err: AnyOrNothing, protocol: number) => void): void;
@@ -96,6 +369,14 @@ interface CardReader extends EventEmitter {
 		cb: (err: AnyOrNothing, response: Buffer) => void
 	): void;
 
+	transmit(
+		data: Buffer,
+		res_len: number,
+		protocol: number,
+		options: TransmitOptions,
+		cb: (err: AnyOrNothing, response: Buffer, tlv?: pcsc.Tlv | null) => void
+	): void;
+
 	control(
 		data: Buffer,
 		control_code: number,
@@ -103,9 +384,161 @@ interface CardReader extends EventEmitter {
 		cb: (err: AnyOrNothing, response: Buffer) => void
 	): void;
 
+	transmitSync(data: Buffer, output: Buffer | number, protocol: number): Buffer;
+
+	controlSync(data: Buffer, control_code: number, output: Buffer | number): Buffer;
+
+	features(
+		cb: (err: AnyOrNothing, codes: ReaderFeatureCodes, properties: ReaderProperties) => void
+	): void;
+
+	verifyPin(apdu: Buffer, cb: (err: AnyOrNothing, response: Buffer) => void): void;
+
+	verifyPin(
+		apdu: Buffer,
+		options: PinOptions,
+		cb: (err: AnyOrNothing, response: Buffer) => void
+	): void;
+
+	modifyPin(apdu: Buffer, cb: (err: AnyOrNothing, response: Buffer) => void): void;
+
+	modifyPin(
+		apdu: Buffer,
+		options: PinOptions,
+		cb: (err: AnyOrNothing, response: Buffer) => void
+	): void;
+
+	readStorage(cb: (err: AnyOrNothing, data: Buffer, layout: StorageLayout) => void): void;
+
+	readStorage(
+		options: StorageOptions,
+		cb: (err: AnyOrNothing, data: Buffer, layout: StorageLayout) => void
+	): void;
+
+	writeStorage(data: Buffer, cb: (err: AnyOrNothing, layout: StorageLayout) => void): void;
+
+	writeStorage(
+		data: Buffer,
+		options: StorageOptions,
+		cb: (err: AnyOrNothing, layout: StorageLayout) => void
+	): void;
+
+	escape(
+		data: Buffer,
+		res_len: number,
+		cb: (err: AnyOrNothing, response: Buffer) => void
+	): void;
+
+	enableCache(rules: CacheRule[], options?: CacheOptions): void;
+
+	disableCache(): void;
+
+	setDebounce(options: DebounceOptions): void;
+
+	statusEvents(options?: QueueOptions): AsyncIterableIterator<Status>;
+
+	startSecureMessaging(options: SecureMessagingOptions): void;
+
+	endSecureMessaging(): void;
+
 	close(): void;
 }
 
-declare function pcsc(): PCSCLite;
+declare function pcsc(options?: PCSCLiteOptions): PCSCLite;
+
+declare namespace pcsc {
+	type StatCounter = { live: number; total: number };
+
+	function stats(): {
+		contexts: StatCounter;
+		handles: StatCounter;
+		threads: StatCounter;
+		workers: StatCounter;
+		heap?: number;
+	};
+
+	class PCSCError extends Error {
+		constructor(code: number, method: string);
+
+		readonly code: number;
+
+		readonly symbol: string | undefined;
+
+		readonly method: string;
+
+		static readonly SCARD_S_SUCCESS: number;
+		static readonly SCARD_F_INTERNAL_ERROR: number;
+		static readonly SCARD_E_CANCELLED: number;
+		static readonly SCARD_E_INVALID_HANDLE: number;
+		static readonly SCARD_E_INVALID_PARAMETER: number;
+		static readonly SCARD_E_INVALID_TARGET: number;
+		static readonly SCARD_E_NO_MEMORY: number;
+		static readonly SCARD_F_WAITED_TOO_LONG: number;
+		static readonly SCARD_E_INSUFFICIENT_BUFFER: number;
+		static readonly SCARD_E_UNKNOWN_READER: number;
+		static readonly SCARD_E_TIMEOUT: number;
+		static readonly SCARD_E_SHARING_VIOLATION: number;
+		static readonly SCARD_E_NO_SMARTCARD: number;
+		static readonly SCARD_E_UNKNOWN_CARD: number;
+		static readonly SCARD_E_CANT_DISPOSE: number;
+		static readonly SCARD_E_PROTO_MISMATCH: number;
+		static readonly SCARD_E_NOT_READY: number;
+		static readonly SCARD_E_INVALID_VALUE: number;
+		static readonly SCARD_E_SYSTEM_CANCELLED: number;
+		static readonly SCARD_F_COMM_ERROR: number;
+		static readonly SCARD_F_UNKNOWN_ERROR: number;
+		static readonly SCARD_E_INVALID_ATR: number;
+		static readonly SCARD_E_NOT_TRANSACTED: number;
+		static readonly SCARD_E_READER_UNAVAILABLE: number;
+		static readonly SCARD_P_SHUTDOWN: number;
+		static readonly SCARD_E_PCI_TOO_SMALL: number;
+		static readonly SCARD_E_READER_UNSUPPORTED: number;
+		static readonly SCARD_E_DUPLICATE_READER: number;
+		static readonly SCARD_E_CARD_UNSUPPORTED: number;
+		static readonly SCARD_E_NO_SERVICE: number;
+		static readonly SCARD_E_SERVICE_STOPPED: number;
+		static readonly SCARD_E_UNEXPECTED: number;
+		static readonly SCARD_E_UNSUPPORTED_FEATURE: number;
+		static readonly SCARD_E_ICC_INSTALLATION: number;
+		static readonly SCARD_E_ICC_CREATEORDER: number;
+		static readonly SCARD_E_DIR_NOT_FOUND: number;
+		static readonly SCARD_E_FILE_NOT_FOUND: number;
+		static readonly SCARD_E_NO_DIR: number;
+		static readonly SCARD_E_NO_FILE: number;
+		static readonly SCARD_E_NO_ACCESS: number;
+		static readonly SCARD_E_WRITE_TOO_MANY: number;
+		static readonly SCARD_E_BAD_SEEK: number;
+		static readonly SCARD_E_INVALID_CHV: number;
+		static readonly SCARD_E_UNKNOWN_RES_MNG: number;
+		static readonly SCARD_E_NO_SUCH_CERTIFICATE: number;
+		static readonly SCARD_E_CERTIFICATE_UNAVAILABLE: number;
+		static readonly SCARD_E_NO_READERS_AVAILABLE: number;
+		static readonly SCARD_E_COMM_DATA_LOST: number;
+		static readonly SCARD_E_NO_KEY_CONTAINER: number;
+		static readonly SCARD_E_SERVER_TOO_BUSY: number;
+		static readonly SCARD_W_UNSUPPORTED_CARD: number;
+		static readonly SCARD_W_UNRESPONSIVE_CARD: number;
+		static readonly SCARD_W_UNPOWERED_CARD: number;
+		static readonly SCARD_W_RESET_CARD: number;
+		static readonly SCARD_W_REMOVED_CARD: number;
+		static readonly SCARD_W_SECURITY_VIOLATION: number;
+		static readonly SCARD_W_WRONG_CHV: number;
+		static readonly SCARD_W_CHV_BLOCKED: number;
+		static readonly SCARD_W_EOF: number;
+		static readonly SCARD_W_CANCELLED_BY_USER: number;
+
+		static readonly SCARD_W_CARD_NOT_AUTHENTICATED: number;
+	}
+
+	class Tlv {
+		static parse(buffer: Buffer): Tlv | null;
+
+		readonly buffer: Buffer;
+
+		readonly index: Uint32Array;
+
+		find(path: TagPath): Buffer | undefined;
+	}
+}
 
 export = pcsc;
@@ -9,11 +9,12 @@ const path = require('path');
 const binding_path = binary.find(path.resolve(path.join(__dirname, '../package.json')));
 const pcsclite = require(binding_path);
 
-const { PCSCLite, CardReader } = pcsclite;
+const { PCSCLite, CardReader, ReaderPool } = pcsclite;
 
 
 inherits(PCSCLite, EventEmitter);
 inherits(CardReader, EventEmitter);
+inherits(ReaderPool, EventEmitter);
 
 function parseReadersString(buffer) {
 
@@ -46,23 +47,65 @@ function diff(a, b) {
 
 }
 
-module.exports = function () {
+/*
+ * Splits include/exclude filters into glob strings, applied natively,
+ * and RegExps, which can only be applied here
+ */
+function splitFilters(filters) {
+
+	filters = [].concat(filters || []);
+
+	return {
+		globs: filters.filter(f => typeof f === 'string'),
+		regexps: filters.filter(f => f instanceof RegExp),
+	};
+
+}
+
+module.exports = function (options) {
+
+	options = options || {};
 
 	const readers = {};
 
-	const p = new PCSCLite();
+	const include = splitFilters(options.include);
+	const exclude = splitFilters(options.exclude);
+
+	// a name matching only a RegExp must get past the native include filter
+	const p = new PCSCLite(include.regexps.length ? [] : include.globs, exclude.globs, options.library, options.shared);
+
+	const accept = function (name) {
+
+		if (include.regexps.length && !include.regexps.some(r => r.test(name)) &&
+			!include.globs.some(g => p._match(g, name))) {
+			return false;
+		}
+
+		return !exclude.regexps.some(r => r.test(name));
+
+	};
 
 	p.readers = readers;
 
+	// without PnP notification, the reader list is polled within these bounds
+	if (options.poll) {
+		p._set_polling(options.poll.min || 100, options.poll.max || 2000);
+	}
+
 	process.nextTick(function () {
 
-		p.start(function (err, data) {
+		p.start(function (err, data, event, stamp) {
 
 			if (err) {
 				return p.emit('error', err);
 			}
 
-			const names = parseReadersString(data);
+			// pcscd restarted, the readers are listed again once it is back
+			if (event) {
+				return p.emit(event);
+			}
+
+			const names = parseReadersString(data).filter(accept);
 
 			const currentNames = Object.keys(readers);
 			const newNames = diff(names, currentNames);
@@ -70,9 +113,13 @@ module.exports = function () {
 
 			newNames.forEach(function (name) {
 
-				const r = new CardReader(name);
+				const r = new CardReader(name, p);
 
 				r.on('_end', function () {
+					// events still queued for an iterator are delivered first
+					while (r._iterated && r._read()) {
+						// delivered through get_status
+					}
 					r.removeAllListeners('status');
 					delete readers[name];
 					r.emit('end');
@@ -80,29 +127,32 @@ module.exports = function () {
 
 				readers[name] = r;
 
-				r.get_status(function (err, state, atr) {
+				r.get_status(function (err, status, event) {
 
 					if (err) {
 						return r.emit('error', err);
 					}
 
-					const status = { state: state };
-
-					if (atr) {
-						status.atr = atr;
+					if (event) {
+						// the card handle did not survive the restart
+						if (event === 'recovering') {
+							r.connected = false;
+						}
+						return r.emit(event);
 					}
 
 					r.emit('status', status);
 
-					r.state = state;
+					r.state = status.state;
 
 				});
 
-				p.emit('reader', r);
+				p.emit('reader', r, stamp);
 
 			});
 
 			removedNames.forEach(function (name) {
+				p.emit('_remove', readers[name], stamp);
 				readers[name].close();
 			});
 
@@ -113,6 +163,472 @@ module.exports = function () {
 	return p;
 };
 
+/*
+ * Lazy view over BER-TLV data, built on a flat index of four Uint32 per object:
+ * tag, value offset, value length and index of the next sibling
+ */
+function Tlv(buffer, index) {
+
+	this.buffer = buffer;
+	this.index = index;
+
+}
+
+/*
+ * Returns null when buffer is not well-formed BER-TLV
+ */
+Tlv.parse = function (buffer) {
+
+	const index = CardReader._tlv_index(buffer);
+
+	return index ? new Tlv(buffer, index) : null;
+
+};
+
+/*
+ * Value of the object at the tag path, as a view into the buffer, or undefined
+ */
+Tlv.prototype.find = function (path) {
+
+	const tags = [].concat(path).map(tag => typeof tag === 'string' ? parseInt(tag, 16) : tag);
+	const index = this.index;
+
+	let i = 0;
+	let end = index.length / 4;
+
+	for (let level = 0; level < tags.length; level++) {
+
+		while (i < end && index[i * 4] !== tags[level]) {
+			i = index[i * 4 + 3];
+		}
+
+		if (i >= end) {
+			return undefined;
+		}
+
+		if (level === tags.length - 1) {
+			return this.buffer.subarray(index[i * 4 + 1], index[i * 4 + 1] + index[i * 4 + 2]);
+		}
+
+		// children follow their parent, up to its next sibling
+		end = index[i * 4 + 3];
+		i++;
+
+	}
+
+	return undefined;
+
+};
+
+module.exports.Tlv = Tlv;
+
+/*
+ * Error of a PC/SC call. code is the raw PC/SC result and method the call
+ * which failed. The symbolic name and the message are only looked up when
+ * read, so that expected errors are cheap to create and to test.
+ */
+class PCSCError extends Error {
+
+	constructor(code, method) {
+
+		super();
+		this.code = code;
+		this.method = method;
+
+	}
+
+	get symbol() {
+
+		return ERROR_SYMBOLS[this.code];
+
+	}
+
+	get message() {
+
+		const message = pcsclite._error_message(this.method, this.code);
+		Object.defineProperty(this, 'message', { value: message, writable: true, configurable: true });
+		return message;
+
+	}
+
+	set message(value) {
+
+		Object.defineProperty(this, 'message', { value: value, writable: true, configurable: true });
+
+	}
+
+}
+
+PCSCError.prototype.name = 'PCSCError';
+
+const ERROR_SYMBOLS = pcsclite._set_error_class(PCSCError);
+
+// PCSCError.SCARD_W_REMOVED_CARD and so on, to compare codes with
+Object.keys(ERROR_SYMBOLS).forEach(function (code) {
+	PCSCError[ERROR_SYMBOLS[code]] = Number(code);
+});
+
+module.exports.PCSCError = PCSCError;
+
+/**
+ * Native resources in use: live and total contexts, handles, threads and
+ * workers, and the native heap in bytes when the allocator can tell
+ */
+module.exports.stats = function () {
+
+	return pcsclite.stats();
+
+};
+
+const OVERFLOW_POLICIES = { 'drop-oldest': 0, 'coalesce': 1, 'block': 2 };
+
+// native queue settings while events are emitted as they come
+const DEFAULT_QUEUE_CAPACITY = 64;
+const DEFAULT_OVERFLOW_POLICY = OVERFLOW_POLICIES.block;
+
+/*
+ * Async iterator over the events of a paused native queue: they are only
+ * delivered, one at a time, when the consumer asks for the next one
+ */
+function queueIterator(source, options, endEvent, subscribe) {
+
+	options = options || {};
+
+	const policy = OVERFLOW_POLICIES[options.overflow || 'block'];
+
+	if (policy === undefined) {
+		throw new TypeError('Unknown overflow policy: ' + options.overflow);
+	}
+
+	if (source._iterated) {
+		throw new Error('Events are already iterated');
+	}
+
+	const items = [];
+	let wake = null;
+	let ended = false;
+	let error = null;
+
+	const notify = function () {
+
+		if (wake) {
+			const resolve = wake;
+			wake = null;
+			resolve();
+		}
+
+	};
+
+	const onEnd = function () {
+
+		ended = true;
+		notify();
+
+	};
+
+	const onError = function (err) {
+
+		error = err;
+		notify();
+
+	};
+
+	const unsubscribe = subscribe(item => items.push(item));
+
+	source.on('_readable', notify);
+	source.on(endEvent, onEnd);
+	source.on('error', onError);
+
+	source._set_queue(options.highWaterMark || 16, policy);
+	source._pause();
+	source._iterated = true;
+
+	const finish = function () {
+
+		if (!source._iterated) {
+			return;
+		}
+
+		unsubscribe();
+		source.removeListener('_readable', notify);
+		source.removeListener(endEvent, onEnd);
+		source.removeListener('error', onError);
+		source._iterated = false;
+		// back to emitting events as they come, without losing any
+		source._set_queue(DEFAULT_QUEUE_CAPACITY, DEFAULT_OVERFLOW_POLICY);
+		source._resume();
+
+	};
+
+	const next = function () {
+
+		for (;;) {
+
+			if (items.length) {
+				return Promise.resolve({ value: items.shift(), done: false });
+			}
+
+			if (error) {
+				const err = error;
+				finish();
+				return Promise.reject(err);
+			}
+
+			// the event is delivered synchronously, through the usual listeners
+			if (source._read()) {
+				continue;
+			}
+
+			if (ended) {
+				finish();
+				return Promise.resolve({ value: undefined, done: true });
+			}
+
+			return new Promise(resolve => { wake = resolve; }).then(next);
+
+		}
+
+	};
+
+	return {
+		next: next,
+		return: function () {
+
+			finish();
+			return Promise.resolve({ value: undefined, done: true });
+
+		},
+		[Symbol.asyncIterator]: function () {
+
+			return this;
+
+		},
+	};
+
+}
+
+PCSCLite.prototype.readerEvents = function (options) {
+
+	const p = this;
+
+	return queueIterator(p, options, 'close', function (push) {
+
+		const event = function (type) {
+
+			return function (reader, stamp) {
+				push(Object.assign({ type: type, reader: reader }, stamp));
+			};
+
+		};
+
+		const onReader = event('add');
+		const onRemove = event('remove');
+
+		// the readers known so far come first
+		Object.keys(p.readers).forEach(name => onReader(p.readers[name]));
+
+		p.on('reader', onReader);
+		p.on('_remove', onRemove);
+
+		return function () {
+			p.removeListener('reader', onReader);
+			p.removeListener('_remove', onRemove);
+		};
+
+	});
+
+};
+
+const closePCSCLite = PCSCLite.prototype.close;
+
+PCSCLite.prototype.close = function () {
+
+	const result = closePCSCLite.call(this);
+	this.emit('close');
+	return result;
+
+};
+
+PCSCLite.prototype.broadcast = function (readers, apdus, res_len, options, cb) {
+
+	if (typeof options === 'function') {
+		cb = options;
+		options = undefined;
+	}
+
+	options = options || {};
+
+	const concurrency = options.concurrency || readers.length;
+
+	this._broadcast(readers, apdus, res_len, concurrency, cb);
+
+};
+
+PCSCLite.prototype.controlBatch = function (entries, options, cb) {
+
+	if (typeof options === 'function') {
+		cb = options;
+		options = undefined;
+	}
+
+	options = options || {};
+
+	// one output buffer per entry, filled in place by the native side
+	const batch = entries.map(entry => ({
+		reader: entry.reader,
+		control_code: entry.control_code,
+		data: entry.data,
+		output: Buffer.alloc(entry.res_len),
+	}));
+
+	const concurrency = options.concurrency || new Set(entries.map(entry => entry.reader)).size;
+
+	this._control_batch(batch, concurrency, function (err, results) {
+		if (err) {
+			return cb(err);
+		}
+
+		cb(undefined, results.map(function (result, i) {
+			const entry = { reader: result.reader, response: batch[i].output.slice(0, result.length) };
+			if (result.error) {
+				entry.error = result.error;
+			}
+			return entry;
+		}));
+	});
+
+};
+
+/*
+ * Tells whether value matches a string (exact) or RegExp filter
+ */
+function matchesName(filter, name) {
+
+	if (!filter) {
+		return true;
+	}
+
+	if (filter instanceof RegExp) {
+		return filter.test(name);
+	}
+
+	return filter === name;
+
+}
+
+/*
+ * Tells whether an ATR matches a Buffer (exact) or predicate filter
+ */
+function matchesAtr(filter, atr) {
+
+	if (!filter) {
+		return true;
+	}
+
+	if (!atr) {
+		return false;
+	}
+
+	if (typeof filter === 'function') {
+		return filter(atr);
+	}
+
+	return filter.equals(atr);
+
+}
+
+PCSCLite.prototype.pool = function (options) {
+
+	options = options || {};
+
+	const p = this;
+
+	const pool = new ReaderPool(function (reader, err) {
+		// evicted readers rejoin the pool on the next card insertion
+		reader.disconnect(reader.SCARD_RESET_CARD, function () {});
+		pool.emit('evict', reader, err);
+	});
+
+	const admit = function (reader, status, previous) {
+
+		if (!(status.state & reader.SCARD_STATE_PRESENT)) {
+			return pool.remove(reader);
+		}
+
+		// only a card insertion (re)admits a reader
+		if (previous & reader.SCARD_STATE_PRESENT) {
+			return;
+		}
+
+		if (!matchesAtr(options.atr, status.atr)) {
+			return;
+		}
+
+		reader.connect({ share_mode: options.share_mode, protocol: options.protocol }, function (err) {
+
+			if (err) {
+				return pool.emit('error', err);
+			}
+
+			if (pool.add(reader)) {
+				pool.emit('add', reader);
+			}
+
+		});
+
+	};
+
+	const watch = function (reader) {
+
+		if (!matchesName(options.name, reader.name)) {
+			return;
+		}
+
+		const onStatus = status => admit(reader, status, reader.state);
+
+		reader.on('status', onStatus);
+		reader.once('end', function () {
+			reader.removeListener('status', onStatus);
+			pool.remove(reader);
+		});
+
+		if (reader.state) {
+			admit(reader, { state: reader.state }, 0);
+		}
+
+	};
+
+	Object.keys(p.readers).forEach(name => watch(p.readers[name]));
+
+	p.on('reader', watch);
+
+	pool.once('close', function () {
+		p.removeListener('reader', watch);
+	});
+
+	return pool;
+
+};
+
+ReaderPool.prototype.transmit = function (data, res_len, cb) {
+
+	const batch = Array.isArray(data);
+
+	if (!this._transmit(batch ? data : [data], res_len, batch, cb)) {
+		return cb(new Error('No reader available in pool'));
+	}
+
+};
+
+const closeReaderPool = ReaderPool.prototype.close;
+
+ReaderPool.prototype.close = function () {
+
+	closeReaderPool.call(this);
+	this.emit('close');
+
+};
+
 CardReader.prototype.connect = function (options, cb) {
 
 	if (typeof options === 'function') {
@@ -127,10 +643,12 @@ CardReader.prototype.connect = function (options, cb) {
 		options.protocol = this.SCARD_PROTOCOL_T0 | this.SCARD_PROTOCOL_T1;
 	}
 
-	if (!this.connected) {
-		this._connect(options.share_mode, options.protocol, cb);
-	} else {
+	if (this.connected) {
 		cb();
+	} else if (options.wait > 0) {
+		this._connect(options.share_mode, options.protocol, options.wait, cb);
+	} else {
+		this._connect(options.share_mode, options.protocol, cb);
 	}
 
 };
@@ -154,13 +672,116 @@ CardReader.prototype.disconnect = function (disposition, cb) {
 
 };
 
-CardReader.prototype.transmit = function (data, res_len, protocol, cb) {
+CardReader.prototype.transmit = function (data, res_len, protocol, options, cb) {
+
+	if (typeof options === 'function') {
+		cb = options;
+		options = undefined;
+	}
+
+	options = options || {};
 
 	if (!this.connected) {
 		return cb(new Error('Card Reader not connected'));
 	}
 
-	this._transmit(data, res_len, protocol, cb);
+	if (this._cache) {
+		const cached = this._cache_lookup(data);
+		if (cached) {
+			if (options.tlv) {
+				return process.nextTick(cb, undefined, cached, Tlv.parse(cached.subarray(0, -2)));
+			}
+			return process.nextTick(cb, undefined, cached);
+		}
+	}
+
+	if (!options.tlv) {
+		return this._transmit(data, res_len, protocol, cb);
+	}
+
+	// the offsets are indexed by the worker thread, values are only sliced on find()
+	this._transmit(data, res_len, protocol, function (err, response, index) {
+
+		if (err) {
+			return cb(err);
+		}
+
+		cb(err, response, index ? new Tlv(response, index) : null);
+
+	}, true);
+
+};
+
+CardReader.prototype.enableCache = function (rules, options) {
+
+	options = options || {};
+
+	rules = rules.map(rule => Buffer.isBuffer(rule) ? { apdu: rule } : rule);
+
+	this._enable_cache(rules, options.max_entries || 256);
+	this._cache = true;
+
+};
+
+CardReader.prototype.disableCache = function () {
+
+	this._disable_cache();
+	this._cache = false;
+
+};
+
+CardReader.prototype.setDebounce = function (options) {
+
+	options = options || {};
+
+	this._set_debounce(options.dwell || 0, options.suppress || 0, !!options.uid);
+
+};
+
+CardReader.prototype.statusEvents = function (options) {
+
+	const reader = this;
+
+	return queueIterator(reader, options, 'end', function (push) {
+
+		reader.on('status', push);
+
+		return function () {
+			reader.removeListener('status', push);
+		};
+
+	});
+
+};
+
+const SM_CIPHERS = { '3des': 0, 'aes': 1 };
+
+CardReader.prototype.startSecureMessaging = function (options) {
+
+	if (!this._sm_start) {
+		throw new Error('Secure messaging is not available, rebuild with secure_messaging=true');
+	}
+
+	if (!this.connected) {
+		throw new Error('Card Reader not connected');
+	}
+
+	options = options || {};
+
+	if (!(options.cipher in SM_CIPHERS)) {
+		throw new TypeError('Unknown secure messaging cipher: ' + options.cipher);
+	}
+
+	// the keys are copied natively, the caller may wipe its buffers right away
+	this._sm_start(SM_CIPHERS[options.cipher], options.enc, options.mac, options.ssc);
+
+};
+
+CardReader.prototype.endSecureMessaging = function () {
+
+	if (this._sm_end) {
+		this._sm_end();
+	}
 
 };
 
@@ -182,6 +803,138 @@ CardReader.prototype.control = function (data, control_code, res_len, cb) {
 
 };
 
+/*
+ * Blocks the event loop for the whole exchange, into output (a Buffer, or its
+ * length). Throws SCARD_E_SERVER_TOO_BUSY while an asynchronous operation is
+ * pending on the reader.
+ */
+CardReader.prototype.transmitSync = function (data, output, protocol) {
+
+	if (!this.connected) {
+		throw new Error('Card Reader not connected');
+	}
+
+	if (typeof output === 'number') {
+		output = Buffer.alloc(output);
+	}
+
+	if (this._cache) {
+		const cached = this._cache_lookup(data);
+		if (cached && cached.length <= output.length) {
+			return output.subarray(0, cached.copy(output));
+		}
+	}
+
+	return output.subarray(0, this._transmit_sync(data, output, protocol));
+
+};
+
+CardReader.prototype.controlSync = function (data, control_code, output) {
+
+	if (!this.connected) {
+		throw new Error('Card Reader not connected');
+	}
+
+	if (typeof output === 'number') {
+		output = Buffer.alloc(output);
+	}
+
+	return output.subarray(0, this._control_sync(data, control_code, output));
+
+};
+
+CardReader.prototype.features = function (cb) {
+
+	if (!this.connected) {
+		return cb(new Error('Card Reader not connected'));
+	}
+
+	this._features(cb);
+
+};
+
+CardReader.prototype.verifyPin = function (apdu, options, cb) {
+
+	if (typeof options === 'function') {
+		cb = options;
+		options = undefined;
+	}
+
+	if (!this.connected) {
+		return cb(new Error('Card Reader not connected'));
+	}
+
+	this._pin(false, apdu, options || {}, cb);
+
+};
+
+CardReader.prototype.modifyPin = function (apdu, options, cb) {
+
+	if (typeof options === 'function') {
+		cb = options;
+		options = undefined;
+	}
+
+	if (!this.connected) {
+		return cb(new Error('Card Reader not connected'));
+	}
+
+	this._pin(true, apdu, options || {}, cb);
+
+};
+
+// whole user memory of a storage card (NFC tag)
+CardReader.prototype.readStorage = function (options, cb) {
+
+	if (typeof options === 'function') {
+		cb = options;
+		options = undefined;
+	}
+
+	if (!this.connected) {
+		return cb(new Error('Card Reader not connected'));
+	}
+
+	this._storage(false, null, options || {}, cb);
+
+};
+
+CardReader.prototype.writeStorage = function (data, options, cb) {
+
+	if (typeof options === 'function') {
+		cb = options;
+		options = undefined;
+	}
+
+	if (!Buffer.isBuffer(data)) {
+		return cb(new TypeError('data must be a Buffer'));
+	}
+
+	if (!this.connected) {
+		return cb(new Error('Card Reader not connected'));
+	}
+
+	this._storage(true, data, options || {}, function (err, unused, layout) {
+		cb(err, layout);
+	});
+
+};
+
+// reader specific commands, through the escape code the reader lists if any
+CardReader.prototype.escape = function (data, res_len, cb) {
+
+	const reader = this;
+
+	this.features(function (err, codes) {
+		if (err) {
+			return cb(err);
+		}
+
+		reader.control(data, codes.ccid_esc_command || reader.IOCTL_CCID_ESCAPE, res_len, cb);
+	});
+
+};
+
 CardReader.prototype.SCARD_CTL_CODE = function (code) {
 
 	const isWin = /^win/.test(process.platform);
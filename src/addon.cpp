@@ -1,11 +1,77 @@
 #include <napi.h>
+#include "addon.h"
 #include "pcsclite.h"
 #include "cardreader.h"
+#include "readerpool.h"
+
+// Native resources in use, for soak tests and leak hunting
+static Napi::Value Stats(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    Napi::Object stats = Napi::Object::New(env);
+
+    for (int i = 0; i < STAT_COUNT; i++) {
+        StatValue value = stats_get(static_cast<Stat>(i));
+        Napi::Object counter = Napi::Object::New(env);
+        counter.Set("live", Napi::Number::New(env, static_cast<double>(value.live)));
+        counter.Set("total", Napi::Number::New(env, static_cast<double>(value.total)));
+        stats.Set(stats_name(static_cast<Stat>(i)), counter);
+    }
+
+    int64_t heap = stats_heap();
+    stats.Set("heap", heap < 0 ? env.Undefined() : Napi::Number::New(env, static_cast<double>(heap)));
+
+    return stats;
+}
+
+// Registers the class of the PC/SC errors, and gives it the error names
+static Napi::Value SetErrorClass(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    if (info.Length() < 1 || !info[0].IsFunction()) {
+        Napi::TypeError::New(env, "Error class expected").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    Napi::Function constructor = info[0].As<Napi::Function>();
+    env.GetInstanceData<AddonData>()->error_constructor = Napi::Persistent(constructor);
+
+    size_t count;
+    const PcscErrorName* names = pcsc_error_names(&count);
+    Napi::Object symbols = Napi::Object::New(env);
+    for (size_t i = 0; i < count; i++) {
+        symbols.Set(names[i].code, Napi::String::New(env, names[i].name));
+    }
+
+    return symbols;
+}
+
+// Message of a PCSCError, formatted on demand
+static Napi::Value ErrorMessage(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    if (info.Length() < 2 || !info[0].IsString() || !info[1].IsNumber()) {
+        Napi::TypeError::New(env, "Wrong arguments").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    std::string method = info[0].As<Napi::String>().Utf8Value();
+    LONG result = static_cast<LONG>(info[1].As<Napi::Number>().Uint32Value());
+
+    return Napi::String::New(env, error_msg(method.c_str(), result));
+}
 
 Napi::Object InitAll(Napi::Env env, Napi::Object exports) {
+    AddonData* data = new AddonData();
+    Napi::Object hrtime = env.Global().Get("process").As<Napi::Object>().Get("hrtime").As<Napi::Object>();
+    data->hrtime = Napi::Persistent(hrtime.Get("bigint").As<Napi::Function>());
+    env.SetInstanceData(data);
     PCSCLite::Init(env, exports);
     CardReader::Init(env, exports);
+    ReaderPool::Init(env, exports);
+    exports.Set("stats", Napi::Function::New(env, Stats, "stats"));
+    exports.Set("_set_error_class", Napi::Function::New(env, SetErrorClass, "_set_error_class"));
+    exports.Set("_error_message", Napi::Function::New(env, ErrorMessage, "_error_message"));
     return exports;
 }
 
-NODE_API_MODULE(pcsclite, InitAll)
\ No newline at end of file
+NODE_API_MODULE(pcsclite, InitAll)
@@ -0,0 +1,41 @@
+#ifndef ADDON_H
+#define ADDON_H
+
+#include <napi.h>
+#include "common.h"
+
+// Per-environment data shared by the wrapped classes
+struct AddonData {
+    Napi::FunctionReference pcsclite_constructor;
+    Napi::FunctionReference card_reader_constructor;
+    // process.hrtime.bigint
+    Napi::FunctionReference hrtime;
+    // PCSCError of lib/pcsclite.js, set once it is loaded
+    Napi::FunctionReference error_constructor;
+};
+
+// A monotonic_ns() timestamp on the process.hrtime.bigint() time line. Only
+// its age is carried over, so that both clocks need not be the same.
+inline Napi::Value hrtime_value(Napi::Env env, uint64_t timestamp) {
+    uint64_t age = monotonic_ns() - timestamp;
+    bool lossless;
+    uint64_t now = env.GetInstanceData<AddonData>()->hrtime.Call({}).As<Napi::BigInt>().Uint64Value(&lossless);
+
+    return Napi::BigInt::New(env, now - age);
+}
+
+// Error of a PC/SC call, carrying its result as a numeric code. Its message is
+// only formatted, by error_msg(), when JS reads it.
+inline Napi::Value pcsc_error(Napi::Env env, const char* method, LONG result) {
+    AddonData* data = env.GetInstanceData<AddonData>();
+    if (data->error_constructor.IsEmpty()) {
+        return Napi::Error::New(env, error_msg(method, result)).Value();
+    }
+
+    return data->error_constructor.New({
+        Napi::Number::New(env, static_cast<uint32_t>(result)),
+        Napi::String::New(env, method)
+    });
+}
+
+#endif /* ADDON_H */
@@ -1,5 +1,6 @@
 #include "cardreader.h"
-#include "common.h"
+#include "addon.h"
+#include "pcsclite.h"
 
 // CardReader implementation
 Napi::Object CardReader::Init(Napi::Env env, Napi::Object exports) {
@@ -9,7 +10,25 @@ Napi::Object CardReader::Init(Napi::Env env, Napi::Object exports) {
         InstanceMethod("_disconnect", &CardReader::Disconnect),
         InstanceMethod("_transmit", &CardReader::Transmit),
         InstanceMethod("_control", &CardReader::Control),
+        InstanceMethod("_transmit_sync", &CardReader::TransmitSync),
+        InstanceMethod("_control_sync", &CardReader::ControlSync),
+        InstanceMethod("_features", &CardReader::Features),
+        InstanceMethod("_pin", &CardReader::Pin),
+        InstanceMethod("_storage", &CardReader::Storage),
+        InstanceMethod("_enable_cache", &CardReader::EnableCache),
+        InstanceMethod("_disable_cache", &CardReader::DisableCache),
+        InstanceMethod("_cache_lookup", &CardReader::CacheLookup),
+        InstanceMethod("_set_debounce", &CardReader::SetDebounce),
+        InstanceMethod("_set_queue", &CardReader::SetQueue),
+        InstanceMethod("_pause", &CardReader::Pause),
+        InstanceMethod("_resume", &CardReader::Resume),
+        InstanceMethod("_read", &CardReader::Read),
         InstanceMethod("close", &CardReader::Close),
+        StaticMethod("_tlv_index", &CardReader::TlvIndex),
+#ifdef PCSC_SECURE_MESSAGING
+        InstanceMethod("_sm_start", &CardReader::SecureMessagingStart),
+        InstanceMethod("_sm_end", &CardReader::SecureMessagingEnd),
+#endif
 
         // Constants: Share Mode
         InstanceValue("SCARD_SHARE_SHARED", Napi::Number::New(env, SCARD_SHARE_SHARED)),
@@ -44,9 +63,7 @@ Napi::Object CardReader::Init(Napi::Env env, Napi::Object exports) {
         InstanceValue("SCARD_EJECT_CARD", Napi::Number::New(env, SCARD_EJECT_CARD))
     });
 
-    Napi::FunctionReference* constructor = new Napi::FunctionReference();
-    *constructor = Napi::Persistent(func);
-    env.SetInstanceData(constructor);
+    env.GetInstanceData<AddonData>()->card_reader_constructor = Napi::Persistent(func);
 
     exports.Set("CardReader", func);
     return exports;
@@ -54,19 +71,30 @@ Napi::Object CardReader::Init(Napi::Env env, Napi::Object exports) {
 
 CardReader::CardReader(const Napi::CallbackInfo& info) 
     : Napi::ObjectWrap<CardReader>(info),
-      m_card_context(0),
-      m_status_card_context(0),
-      m_card_handle(0),
-      m_mutex(),
-      m_cond(),
-      m_state(0) {
+      m_reader((info.Length() > 0 && info[0].IsString()) ? info[0].As<Napi::String>().Utf8Value() : std::string()),
+      m_monitor(m_reader),
+      m_following(false),
+      m_atr_session(0),
+      m_wake_pending(false),
+      m_flowing(true),
+      m_pending(0)
+#ifdef PCSC_SECURE_MESSAGING
+    , m_sm(m_reader)
+#endif
+{
     
     if (info.Length() < 1 || !info[0].IsString()) {
         Napi::TypeError::New(info.Env(), "Reader name expected").ThrowAsJavaScriptException();
         return;
     }
 
-    m_name = info[0].As<Napi::String>().Utf8Value();
+    // The PCSCLite which listed the reader
+    if (info.Length() > 1 && info[1].IsObject()) {
+        Napi::Object owner = info[1].As<Napi::Object>();
+        if (owner.InstanceOf(info.Env().GetInstanceData<AddonData>()->pcsclite_constructor.Value())) {
+            m_shared = PCSCLite::Unwrap(owner)->GetShared();
+        }
+    }
 
     // Set properties on the JavaScript object
     Napi::Object jsThis = info.This().As<Napi::Object>();
@@ -75,54 +103,11 @@ CardReader::CardReader(const Napi::CallbackInfo& info)
 }
 
 CardReader::~CardReader() {
-    if (m_status_thread.joinable()) {
-        SCardCancel(m_status_card_context);
-        m_status_thread.join();
-    }
-
-    if (m_card_context) {
-        SCardReleaseContext(m_card_context);
-    }
-}
-
-// StatusWorker implementation
-CardReader::StatusWorker::StatusWorker(Napi::Function& callback, CardReader* reader)
-    : Napi::AsyncWorker(callback),
-      reader_(reader) {
-    async_result_ = new AsyncResult();
-}
-
-CardReader::StatusWorker::~StatusWorker() {
-    delete async_result_;
-}
-
-void CardReader::StatusWorker::Execute() {
-    // Will run in worker thread
-    // Implementation omitted for brevity
-}
-
-void CardReader::StatusWorker::OnOK() {
-    Napi::HandleScope scope(Env());
-    
-    Napi::Object status = Napi::Object::New(Env());
-    status.Set("state", Napi::Number::New(Env(), async_result_->status));
-    
-    if (async_result_->atrlen > 0) {
-        status.Set("atr", Napi::Buffer<uint8_t>::Copy(Env(), 
-                                                     async_result_->atr, 
-                                                     async_result_->atrlen));
-    }
-    
-    Callback().Call({Env().Undefined(), status});
-}
-
-void CardReader::StatusWorker::NotifyJS() {
-    // Implementation omitted for brevity
 }
 
 // ConnectWorker implementation
 CardReader::ConnectWorker::ConnectWorker(Napi::Function& callback, CardReader* reader, ConnectInput* input)
-    : Napi::AsyncWorker(callback),
+    : PcscWorker(callback, &reader->m_pending),
       reader_(reader),
       input_(input) {
 }
@@ -132,30 +117,23 @@ CardReader::ConnectWorker::~ConnectWorker() {
 }
 
 void CardReader::ConnectWorker::Execute() {
-    LONG result = SCARD_S_SUCCESS;
-    
-    // Lock mutex
-    std::unique_lock<std::mutex> lock(reader_->m_mutex);
-    
-    // Is context established
-    if (!reader_->m_card_context) {
-        result = SCardEstablishContext(SCARD_SCOPE_SYSTEM, NULL, NULL, &reader_->m_card_context);
-    }
-    
-    // Connect
-    if (result == SCARD_S_SUCCESS) {
-        result = SCardConnect(reader_->m_card_context,
-                             reader_->m_name.c_str(),
-                             input_->share_mode,
-                             input_->pref_protocol,
-                             &reader_->m_card_handle,
-                             &result_.card_protocol);
-    }
+    PCSC_PROBE2(connect__start, reader_->m_reader.name().c_str(), input_->share_mode);
+    PCSC_PROBE_CLOCK(start);
+    
+    LONG result = input_->wait_ms ?
+                  reader_->m_reader.connect_wait(input_->share_mode,
+                                                 input_->pref_protocol,
+                                                 &result_.card_protocol,
+                                                 input_->wait_ms) :
+                  reader_->m_reader.connect(input_->share_mode,
+                                            input_->pref_protocol,
+                                            &result_.card_protocol);
     
     result_.result = result;
+    PCSC_PROBE3(connect__done, reader_->m_reader.name().c_str(), result, PCSC_PROBE_ELAPSED(start));
     
     if (result != SCARD_S_SUCCESS) {
-        SetError(error_msg("SCardConnect", result));
+        SetPcscError("SCardConnect", result);
     }
 }
 
@@ -174,32 +152,22 @@ void CardReader::ConnectWorker::OnOK() {
 
 // DisconnectWorker implementation 
 CardReader::DisconnectWorker::DisconnectWorker(Napi::Function& callback, CardReader* reader, DWORD disposition)
-    : Napi::AsyncWorker(callback),
+    : PcscWorker(callback, &reader->m_pending),
       reader_(reader),
       disposition_(disposition) {
 }
 
-CardReader::DisconnectWorker::~DisconnectWorker() {
-}
-
 void CardReader::DisconnectWorker::Execute() {
-    LONG result = SCARD_S_SUCCESS;
+    PCSC_PROBE2(disconnect__start, reader_->m_reader.name().c_str(), disposition_);
+    PCSC_PROBE_CLOCK(start);
     
-    // Lock mutex
-    std::unique_lock<std::mutex> lock(reader_->m_mutex);
-    
-    // Connect
-    if (reader_->m_card_handle) {
-        result = SCardDisconnect(reader_->m_card_handle, disposition_);
-        if (result == SCARD_S_SUCCESS) {
-            reader_->m_card_handle = 0;
-        }
-    }
+    LONG result = reader_->m_reader.disconnect(disposition_);
     
     result_ = result;
+    PCSC_PROBE3(disconnect__done, reader_->m_reader.name().c_str(), result, PCSC_PROBE_ELAPSED(start));
     
     if (result != SCARD_S_SUCCESS) {
-        SetError(error_msg("SCardDisconnect", result));
+        SetPcscError("SCardDisconnect", result);
     }
 }
 
@@ -215,11 +183,12 @@ void CardReader::DisconnectWorker::OnOK() {
 
 // TransmitWorker implementation
 CardReader::TransmitWorker::TransmitWorker(Napi::Function& callback, CardReader* reader, TransmitInput* input)
-    : Napi::AsyncWorker(callback),
+    : PcscWorker(callback, &reader->m_pending),
       reader_(reader),
       input_(input) {
     result_.data = new unsigned char[input_->out_len];
     result_.len = input_->out_len;
+    result_.tlv_valid = false;
 }
 
 CardReader::TransmitWorker::~TransmitWorker() {
@@ -229,42 +198,79 @@ CardReader::TransmitWorker::~TransmitWorker() {
 }
 
 void CardReader::TransmitWorker::Execute() {
-    LONG result = SCARD_E_INVALID_HANDLE;
-    
-    // Lock mutex
-    std::unique_lock<std::mutex> lock(reader_->m_mutex);
+    PCSC_PROBE2(transmit__start, reader_->m_reader.name().c_str(), input_->in_len);
+    PCSC_PROBE_CLOCK(start);
+    
+#ifdef PCSC_SECURE_MESSAGING
+    if (input_->secure) {
+        // Protected exchanges are never cached
+        SecureMessaging::Error sm_error;
+        LONG result = reader_->m_sm.transmit(input_->card_protocol,
+                                             input_->in_data,
+                                             input_->in_len,
+                                             result_.data,
+                                             &result_.len,
+                                             &sm_error);
+        result_.result = result;
+        PCSC_PROBE4(transmit__done, reader_->m_reader.name().c_str(), result_.len, result, PCSC_PROBE_ELAPSED(start));
+
+        if (result != SCARD_S_SUCCESS) {
+            SetPcscError("SCardTransmit", result);
+        } else if (sm_error != SecureMessaging::SM_OK) {
+            SetError(std::string("Secure messaging error: ") + SecureMessaging::error_string(sm_error));
+        } else if (input_->tlv && result_.len >= 2) {
+            result_.tlv_valid = tlv_index(result_.data, result_.len - 2, &result_.tlv);
+        }
+        return;
+    }
+#endif
+
+    ApduCache& cache = reader_->m_reader.cache();
+    uint64_t generation = cache.generation();
+    // Queued before a secure messaging session started, it is not sent in plain
+    LONG result = reader_->m_reader.secure_messaging() ? SCARD_W_SECURITY_VIOLATION :
+                  reader_->m_reader.transmit(input_->card_protocol,
+                                             input_->in_data,
+                                             input_->in_len,
+                                             result_.data,
+                                             &result_.len);
+    PCSC_PROBE4(transmit__done, reader_->m_reader.name().c_str(), result_.len, result, PCSC_PROBE_ELAPSED(start));
     
-    // Connected?
-    if (reader_->m_card_handle) {
-        SCARD_IO_REQUEST send_pci = { input_->card_protocol, sizeof(SCARD_IO_REQUEST) };
-        result = SCardTransmit(reader_->m_card_handle, 
-                              &send_pci, 
-                              input_->in_data, 
-                              input_->in_len,
-                              NULL, 
-                              result_.data, 
-                              &result_.len);
+    if (result == SCARD_S_SUCCESS) {
+        cache.store(generation, input_->in_data, input_->in_len, result_.data, result_.len);
+
+        // Indexed here so that the JS thread only walks the offsets, SW1 SW2 excluded
+        if (input_->tlv && result_.len >= 2) {
+            result_.tlv_valid = tlv_index(result_.data, result_.len - 2, &result_.tlv);
+        }
     }
     
     result_.result = result;
     
     if (result != SCARD_S_SUCCESS) {
-        SetError(error_msg("SCardTransmit", result));
+        SetPcscError("SCardTransmit", result);
     }
 }
 
 void CardReader::TransmitWorker::OnOK() {
     Napi::HandleScope scope(Env());
     
-    Callback().Call({
-        Env().Undefined(),
-        Napi::Buffer<unsigned char>::Copy(Env(), result_.data, result_.len)
-    });
+    Napi::Value response = Napi::Buffer<unsigned char>::Copy(Env(), result_.data, result_.len);
+
+    if (input_->tlv) {
+        Callback().Call({
+            Env().Undefined(),
+            response,
+            tlv_value(Env(), result_.tlv, result_.tlv_valid)
+        });
+    } else {
+        Callback().Call({ Env().Undefined(), response });
+    }
 }
 
 // ControlWorker implementation
 CardReader::ControlWorker::ControlWorker(Napi::Function& callback, CardReader* reader, ControlInput* input)
-    : Napi::AsyncWorker(callback),
+    : PcscWorker(callback, &reader->m_pending),
       reader_(reader),
       input_(input) {
 }
@@ -274,26 +280,21 @@ CardReader::ControlWorker::~ControlWorker() {
 }
 
 void CardReader::ControlWorker::Execute() {
-    LONG result = SCARD_E_INVALID_HANDLE;
+    PCSC_PROBE3(control__start, reader_->m_reader.name().c_str(), input_->control_code, input_->in_len);
+    PCSC_PROBE_CLOCK(start);
     
-    // Lock mutex
-    std::unique_lock<std::mutex> lock(reader_->m_mutex);
-    
-    // Connected?
-    if (reader_->m_card_handle) {
-        result = SCardControl(reader_->m_card_handle,
-                             input_->control_code,
-                             input_->in_data,
-                             input_->in_len,
-                             input_->out_data,
-                             input_->out_len,
-                             &result_.len);
-    }
+    LONG result = reader_->m_reader.control(input_->control_code,
+                                            input_->in_data,
+                                            input_->in_len,
+                                            input_->out_data,
+                                            input_->out_len,
+                                            &result_.len);
     
     result_.result = result;
+    PCSC_PROBE4(control__done, reader_->m_reader.name().c_str(), result_.len, result, PCSC_PROBE_ELAPSED(start));
     
     if (result != SCARD_S_SUCCESS) {
-        SetError(error_msg("SCardControl", result));
+        SetPcscError("SCardControl", result);
     }
 }
 
@@ -306,6 +307,265 @@ void CardReader::ControlWorker::OnOK() {
     });
 }
 
+// FeaturesWorker implementation
+CardReader::FeaturesWorker::FeaturesWorker(Napi::Function& callback, CardReader* reader)
+    : PcscWorker(callback, &reader->m_pending),
+      reader_(reader) {
+}
+
+void CardReader::FeaturesWorker::Execute() {
+    LONG result = reader_->m_reader.features(&features_);
+    
+    if (result != SCARD_S_SUCCESS) {
+        SetPcscError("SCardControl", result);
+    }
+}
+
+void CardReader::FeaturesWorker::OnOK() {
+    Napi::HandleScope scope(Env());
+    
+    // Control codes by feature name, for the features the reader has
+    Napi::Object codes = Napi::Object::New(Env());
+    for (int feature = 1; feature < ReaderFeatures::FEATURE_MAX; feature++) {
+        if (features_.code(feature)) {
+            codes.Set(ReaderFeatures::name(feature), Napi::Number::New(Env(), features_.code(feature)));
+        }
+    }
+    
+    Napi::Object properties = Napi::Object::New(Env());
+    for (int property = 1; property < ReaderFeatures::PROPERTY_MAX; property++) {
+        if (!features_.has_property(property)) {
+            continue;
+        }
+        if (property == ReaderFeatures::FIRMWARE_ID) {
+            properties.Set(ReaderFeatures::property_name(property), Napi::String::New(Env(), features_.firmware_id()));
+        } else {
+            properties.Set(ReaderFeatures::property_name(property), Napi::Number::New(Env(), features_.property(property)));
+        }
+    }
+    
+    Callback().Call({ Env().Undefined(), codes, properties });
+}
+
+// PinWorker implementation
+CardReader::PinWorker::PinWorker(Napi::Function& callback, CardReader* reader, PinInput* input)
+    : PcscWorker(callback, &reader->m_pending),
+      reader_(reader),
+      input_(input) {
+}
+
+CardReader::PinWorker::~PinWorker() {
+    delete input_;
+}
+
+void CardReader::PinWorker::Execute() {
+    result_.len = sizeof(result_.data);
+    
+    // Blocks until the PIN is entered or the reader times out
+    if (input_->modify) {
+        result_.result = reader_->m_reader.modify_pin(input_->params, input_->apdu.data(), input_->apdu.size(),
+                                                      result_.data, &result_.len);
+    } else {
+        result_.result = reader_->m_reader.verify_pin(input_->params, input_->apdu.data(), input_->apdu.size(),
+                                                      result_.data, &result_.len);
+    }
+    
+    if (result_.result != SCARD_S_SUCCESS) {
+        SetPcscError("SCardControl", result_.result);
+    }
+}
+
+void CardReader::PinWorker::OnOK() {
+    Napi::HandleScope scope(Env());
+    
+    Callback().Call({
+        Env().Undefined(),
+        Napi::Buffer<BYTE>::Copy(Env(), result_.data, result_.len)
+    });
+}
+
+// StorageWorker implementation
+CardReader::StorageWorker::StorageWorker(Napi::Function& callback, CardReader* reader, StorageInput* input)
+    : PcscWorker(callback, &reader->m_pending),
+      reader_(reader),
+      input_(input) {
+}
+
+CardReader::StorageWorker::~StorageWorker() {
+    delete input_;
+}
+
+void CardReader::StorageWorker::Execute() {
+    StorageCard card(reader_->m_reader);
+    StorageCard::Layout& layout = input_->layout;
+    
+    result_.result = card.detect(&layout, &result_.error);
+    if (result_.result == SCARD_S_SUCCESS && result_.error == StorageCard::ST_OK) {
+        if (input_->write) {
+            result_.result = card.write(layout, input_->data.data(), input_->data.size(), input_->verify,
+                                        &result_.error);
+            // Responses cached before may be stale now
+            reader_->m_reader.cache().invalidate();
+        } else {
+            result_.result = card.read(layout, &result_.data, &result_.error);
+        }
+    }
+    result_.status = card.status();
+    result_.chunk = input_->write ? 0 : card.read_chunk();
+    
+    if (result_.result != SCARD_S_SUCCESS) {
+        SetPcscError("SCardTransmit", result_.result);
+    } else if (result_.error == StorageCard::ST_BAD_STATUS) {
+        char status[8];
+        snprintf(status, sizeof(status), "%04X", result_.status);
+        SetError(std::string("Storage card error: ") + StorageCard::error_string(result_.error) + " (" + status + ")");
+    } else if (result_.error != StorageCard::ST_OK) {
+        SetError(std::string("Storage card error: ") + StorageCard::error_string(result_.error));
+    }
+}
+
+void CardReader::StorageWorker::OnOK() {
+    Napi::HandleScope scope(Env());
+    
+    const StorageCard::Layout& layout = input_->layout;
+    Napi::Object obj = Napi::Object::New(Env());
+    obj.Set("page_size", Napi::Number::New(Env(), layout.page_size));
+    obj.Set("first_page", Napi::Number::New(Env(), layout.first_page));
+    obj.Set("pages", Napi::Number::New(Env(), layout.pages));
+    if (layout.has_version) {
+        obj.Set("version", Napi::Buffer<BYTE>::Copy(Env(), layout.version, sizeof(layout.version)));
+    }
+    if (result_.chunk) {
+        obj.Set("chunk", Napi::Number::New(Env(), result_.chunk));
+    }
+    
+    Callback().Call({
+        Env().Undefined(),
+        input_->write ? Env().Undefined() : Napi::Buffer<BYTE>::Copy(Env(), result_.data.data(), result_.data.size()),
+        obj
+    });
+}
+
+// Internal methods
+Napi::Value CardReader::atr_info_value(Napi::Env env, const AsyncResult* async_result) {
+    // The decoded ATR is built once per card session and shared by its status events
+    if (m_atr_session == async_result->atr_session && !m_atr_info.IsEmpty()) {
+        return m_atr_info.Value();
+    }
+    
+    const AtrInfo& info = async_result->atr_info;
+    Napi::Object obj = Napi::Object::New(env);
+    obj.Set("valid", Napi::Boolean::New(env, info.valid));
+    obj.Set("ts", Napi::Number::New(env, info.ts));
+    obj.Set("t0", Napi::Number::New(env, info.t0));
+    
+    const char* names[] = { "ta", "tb", "tc", "td" };
+    Napi::Array interfaces = Napi::Array::New(env, info.interfaces_count);
+    for (size_t i = 0; i < info.interfaces_count; i++) {
+        const AtrInfo::Interface& group = info.interfaces[i];
+        const int bytes[] = { group.ta, group.tb, group.tc, group.td };
+        Napi::Object entry = Napi::Object::New(env);
+        for (int j = 0; j < 4; j++) {
+            if (bytes[j] >= 0) {
+                entry.Set(names[j], Napi::Number::New(env, bytes[j]));
+            }
+        }
+        interfaces.Set(i, entry);
+    }
+    obj.Set("interfaces", interfaces);
+    
+    if (info.historical_offset + info.historical_len <= async_result->atrlen) {
+        obj.Set("historical", Napi::Buffer<BYTE>::Copy(env,
+                                                      async_result->atr + info.historical_offset,
+                                                      info.historical_len));
+    }
+    if (info.tck >= 0) {
+        obj.Set("tck", Napi::Number::New(env, info.tck));
+    }
+    obj.Set("protocols", Napi::Number::New(env, info.protocols));
+    obj.Set("storage", Napi::Boolean::New(env, info.storage));
+    if (info.storage) {
+        obj.Set("standard", Napi::Number::New(env, info.standard));
+        obj.Set("card_name", Napi::Number::New(env, info.card_name));
+    }
+    obj.Set("card_type", Napi::String::New(env, info.card_type));
+    obj.Freeze();
+    
+    m_atr_info = Napi::Persistent(obj);
+    m_atr_session = async_result->atr_session;
+    
+    return obj;
+}
+
+Napi::Value CardReader::status_value(Napi::Env env, const AsyncResult* async_result) {
+    Napi::Object status = Napi::Object::New(env);
+    status.Set("state", Napi::Number::New(env, async_result->status));
+    
+    if (async_result->atrlen > 0) {
+        status.Set("atr", Napi::Buffer<uint8_t>::Copy(env, 
+                                                     async_result->atr, 
+                                                     async_result->atrlen));
+        status.Set("card_type", Napi::String::New(env, async_result->atr_info.card_type));
+        status.Set("atr_info", atr_info_value(env, async_result));
+    }
+    
+    status.Set("timestamp", hrtime_value(env, async_result->timestamp));
+    status.Set("event_count", Napi::Number::New(env, async_result->event_count));
+    
+    if (async_result->uidlen > 0) {
+        status.Set("uid", Napi::Buffer<uint8_t>::Copy(env,
+                                                     async_result->uid,
+                                                     async_result->uidlen));
+    }
+    
+    return status;
+}
+
+// Four Uint32 per node (tag, offset, length, next), null when the data is not BER-TLV
+Napi::Value CardReader::tlv_value(Napi::Env env, const std::vector<TlvNode>& nodes, bool valid) {
+    if (!valid) {
+        return env.Null();
+    }
+
+    static_assert(sizeof(TlvNode) == 4 * sizeof(uint32_t), "TlvNode must be four packed Uint32");
+    Napi::Uint32Array index = Napi::Uint32Array::New(env, nodes.size() * 4);
+    if (!nodes.empty()) {
+        memcpy(index.Data(), nodes.data(), nodes.size() * sizeof(TlvNode));
+    }
+
+    return index;
+}
+
+void CardReader::dispatch(Napi::Env env, Napi::Function callback, const AsyncResult& event) {
+    if (m_monitor.closing()) {
+        // Swallow events: the monitor was closed by user
+    } else if (event.notice) {
+        callback.Call({env.Undefined(), env.Undefined(), Napi::String::New(env, event.notice)});
+    } else {
+        callback.Call({env.Undefined(), status_value(env, &event)});
+    }
+}
+
+// Delivers the queued events while flowing, only tells that there are some when paused
+void CardReader::drain(Napi::Env env, Napi::Function callback) {
+    m_wake_pending = false;
+
+    if (env == nullptr) {
+        return;
+    }
+
+    if (!m_flowing) {
+        callback.Call({env.Undefined(), env.Undefined(), Napi::String::New(env, "_readable")});
+        return;
+    }
+
+    PCSC_PROBE2(tsfn__dispatch, m_reader.name().c_str(), m_queue.size());
+    AsyncResult event;
+    while (m_flowing && m_queue.pop(&event)) {
+        dispatch(env, callback, event);
+    }
+}
+
 // CardReader methods
 Napi::Value CardReader::GetStatus(const Napi::CallbackInfo& info) {
     Napi::Env env = info.Env();
@@ -315,20 +575,64 @@ Napi::Value CardReader::GetStatus(const Napi::CallbackInfo& info) {
         return env.Undefined();
     }
     
+    if (!m_monitor.stopped() || m_following) {
+        Napi::Error::New(env, "Status already monitored").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
     Napi::Function callback = info[0].As<Napi::Function>();
     m_status_callback = Napi::Persistent(callback);
+    m_queue.open();
     
-    // Create thread safe function
+    // Create thread safe function, it is finalized once the monitor thread is done
     m_tsfn = Napi::ThreadSafeFunction::New(
         env,
         callback,
         "CardReaderStatusCallback",
         0,
-        1
+        1,
+        [this](Napi::Env env) {
+            m_monitor.join();
+            m_following = false;
+            
+            Napi::Object self = Value();
+            self.Get("emit").As<Napi::Function>().Call(self, {Napi::String::New(env, "_end")});
+            Unref();
+        }
     );
     
-    // Start the monitoring thread
-    m_status_thread = std::thread(HandlerFunction, this);
+    // Events wait in the bounded queue until JS is ready for them
+    auto on_event = [this](const AsyncResult& event) {
+#ifdef PCSC_SECURE_MESSAGING
+        // The session keys do not outlive the card
+        if (event.result == SCARD_S_SUCCESS && (event.status & SCARD_STATE_EMPTY)) {
+            m_sm.end();
+        }
+#endif
+        if (m_shared) {
+            m_shared->publish_status(m_reader.name(), event);
+        }
+        
+        // Errors and notices are never merged into another event
+        bool coalescable = event.result == SCARD_S_SUCCESS && !event.notice;
+        if (m_queue.push(event, coalescable) && !m_wake_pending.exchange(true)) {
+            m_tsfn.NonBlockingCall([this](Napi::Env env, Napi::Function jsCallback) {
+                drain(env, jsCallback);
+            });
+        }
+    };
+    
+    // The reader stays alive while it is monitored
+    Ref();
+    
+    if (m_shared && m_shared->role() == SharedState::ROLE_FOLLOWER) {
+        // The status the owner process publishes
+        m_following = true;
+        m_shared->watch(m_reader.name(), on_event, [this]() { m_tsfn.Release(); });
+        return env.Undefined();
+    }
+    
+    m_monitor.start(on_event, [this]() { m_tsfn.Release(); });
     
     return env.Undefined();
 }
@@ -341,7 +645,9 @@ Napi::Value CardReader::Connect(const Napi::CallbackInfo& info) {
         return env.Undefined();
     }
     
-    if (!info[0].IsNumber() || !info[1].IsNumber() || !info[2].IsFunction()) {
+    // The wait time is optional, before the callback
+    size_t callback_index = (info.Length() > 3 && info[2].IsNumber()) ? 3 : 2;
+    if (!info[0].IsNumber() || !info[1].IsNumber() || !info[callback_index].IsFunction()) {
         Napi::TypeError::New(env, "Wrong arguments").ThrowAsJavaScriptException();
         return env.Undefined();
     }
@@ -349,7 +655,8 @@ Napi::Value CardReader::Connect(const Napi::CallbackInfo& info) {
     ConnectInput* ci = new ConnectInput();
     ci->share_mode = info[0].As<Napi::Number>().Uint32Value();
     ci->pref_protocol = info[1].As<Napi::Number>().Uint32Value();
-    Napi::Function callback = info[2].As<Napi::Function>();
+    ci->wait_ms = (callback_index == 3) ? info[2].As<Napi::Number>().Uint32Value() : 0;
+    Napi::Function callback = info[callback_index].As<Napi::Function>();
     
     // If already connected, just call the callback
     Napi::Object jsThis = info.This().As<Napi::Object>();
@@ -360,6 +667,7 @@ Napi::Value CardReader::Connect(const Napi::CallbackInfo& info) {
     }
     
     ConnectWorker* worker = new ConnectWorker(callback, this, ci);
+    PCSC_PROBE2(worker__queue, m_reader.name().c_str(), "connect");
     worker->Queue();
     
     return env.Undefined();
@@ -388,7 +696,12 @@ Napi::Value CardReader::Disconnect(const Napi::CallbackInfo& info) {
         return env.Undefined();
     }
     
+#ifdef PCSC_SECURE_MESSAGING
+    m_sm.end();
+#endif
+
     DisconnectWorker* worker = new DisconnectWorker(callback, this, disposition);
+    PCSC_PROBE2(worker__queue, m_reader.name().c_str(), "disconnect");
     worker->Queue();
     
     return env.Undefined();
@@ -425,8 +738,16 @@ Napi::Value CardReader::Transmit(const Napi::CallbackInfo& info) {
     ti->in_data = new unsigned char[ti->in_len];
     memcpy(ti->in_data, buffer.Data(), ti->in_len);
     ti->out_len = out_len;
+    ti->tlv = info.Length() > 4 && info[4].ToBoolean().Value();
+#ifdef PCSC_SECURE_MESSAGING
+    // Decided now, so that a command is never sent in plain once the session has ended
+    ti->secure = m_sm.active();
+#else
+    ti->secure = false;
+#endif
     
     TransmitWorker* worker = new TransmitWorker(callback, this, ti);
+    PCSC_PROBE2(worker__queue, m_reader.name().c_str(), "transmit");
     worker->Queue();
     
     return env.Undefined();
@@ -463,99 +784,391 @@ Napi::Value CardReader::Control(const Napi::CallbackInfo& info) {
     ci->in_len = in_buf.Length();
     ci->out_data = out_buf.Data();
     ci->out_len = out_buf.Length();
+    ci->in_buf = Napi::Persistent(static_cast<Napi::Object>(in_buf));
+    ci->out_buf = Napi::Persistent(static_cast<Napi::Object>(out_buf));
     
     ControlWorker* worker = new ControlWorker(callback, this, ci);
+    PCSC_PROBE2(worker__queue, m_reader.name().c_str(), "control");
     worker->Queue();
     
     return env.Undefined();
 }
 
-Napi::Value CardReader::Close(const Napi::CallbackInfo& info) {
+// Runs on the JS thread, into the caller's buffer. Throws rather than waiting
+// for an asynchronous operation on the same reader.
+Napi::Value CardReader::TransmitSync(const Napi::CallbackInfo& info) {
     Napi::Env env = info.Env();
-    LONG result = SCARD_S_SUCCESS;
-    
-    if (m_status_thread.joinable()) {
-        std::unique_lock<std::mutex> lock(m_mutex);
-        if (m_state == 0) {
-            int ret;
-            int times = 0;
-            m_state = 1;
-            do {
-                result = SCardCancel(m_status_card_context);
-                ret = std::cv_status::timeout == m_cond.wait_for(lock, std::chrono::microseconds(10000000)) ? -1 : 0;
-            } while ((ret != 0) && (++times < 5));
-        }
-        
-        lock.unlock();
-        m_status_thread.join();
-        m_status_thread = std::thread();
+    
+    if (info.Length() < 3 || !info[0].IsBuffer() || !info[1].IsBuffer() || !info[2].IsNumber()) {
+        Napi::TypeError::New(env, "Wrong arguments").ThrowAsJavaScriptException();
+        return env.Undefined();
     }
     
-    // Release ThreadSafeFunction if it's active
-    if (m_tsfn) {
-        m_tsfn.Release();
+#ifdef PCSC_SECURE_MESSAGING
+    if (m_sm.active()) {
+        Napi::Error::New(env, "Secure messaging needs the asynchronous transmit").ThrowAsJavaScriptException();
+        return env.Undefined();
     }
+#endif
+    
+    Napi::Buffer<BYTE> in_buf = info[0].As<Napi::Buffer<BYTE>>();
+    Napi::Buffer<BYTE> out_buf = info[1].As<Napi::Buffer<BYTE>>();
+    DWORD protocol = info[2].As<Napi::Number>().Uint32Value();
+    DWORD len = out_buf.Length();
     
-    return Napi::Number::New(env, result);
+    ApduCache& cache = m_reader.cache();
+    uint64_t generation = cache.generation();
+    LONG result = m_pending ? SCARD_E_SERVER_TOO_BUSY :
+                  m_reader.try_transmit(protocol, in_buf.Data(), in_buf.Length(), out_buf.Data(), &len);
+    
+    if (result != SCARD_S_SUCCESS) {
+        Napi::Error(env, pcsc_error(env, "SCardTransmit", result)).ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    cache.store(generation, in_buf.Data(), in_buf.Length(), out_buf.Data(), len);
+    
+    return Napi::Number::New(env, len);
 }
 
-void CardReader::HandlerFunction(void* arg) {
-    CardReader* reader = static_cast<CardReader*>(arg);
-    AsyncResult* async_result = new AsyncResult();
+Napi::Value CardReader::ControlSync(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
     
-    LONG result = SCardEstablishContext(SCARD_SCOPE_SYSTEM, NULL, NULL, &reader->m_status_card_context);
+    if (info.Length() < 3 || !info[0].IsBuffer() || !info[1].IsNumber() || !info[2].IsBuffer()) {
+        Napi::TypeError::New(env, "Wrong arguments").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
     
-    SCARD_READERSTATE card_reader_state = SCARD_READERSTATE();
-    card_reader_state.szReader = reader->m_name.c_str();
-    card_reader_state.dwCurrentState = SCARD_STATE_UNAWARE;
+    Napi::Buffer<BYTE> in_buf = info[0].As<Napi::Buffer<BYTE>>();
+    DWORD control_code = info[1].As<Napi::Number>().Uint32Value();
+    Napi::Buffer<BYTE> out_buf = info[2].As<Napi::Buffer<BYTE>>();
+    DWORD len = 0;
     
-    auto callback = [reader, &card_reader_state, async_result](Napi::Env env, Napi::Function jsCallback) {
-        if (reader->m_state == 1) {
-            // Exit requested by user
-            reader->m_cond.notify_all();
-        } else {
-            Napi::Object status = Napi::Object::New(env);
-            status.Set("state", Napi::Number::New(env, async_result->status));
-            
-            if (async_result->atrlen > 0) {
-                status.Set("atr", Napi::Buffer<uint8_t>::Copy(env, 
-                                                             async_result->atr, 
-                                                             async_result->atrlen));
-            }
-            
-            jsCallback.Call({env.Undefined(), status});
+    LONG result = m_pending ? SCARD_E_SERVER_TOO_BUSY :
+                  m_reader.try_control(control_code, in_buf.Data(), in_buf.Length(),
+                                       out_buf.Data(), out_buf.Length(), &len);
+    
+    if (result != SCARD_S_SUCCESS) {
+        Napi::Error(env, pcsc_error(env, "SCardControl", result)).ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    return Napi::Number::New(env, len);
+}
+
+Napi::Value CardReader::Features(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 1 || !info[0].IsFunction()) {
+        Napi::TypeError::New(env, "Wrong arguments").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    Napi::Function callback = info[0].As<Napi::Function>();
+    FeaturesWorker* worker = new FeaturesWorker(callback, this);
+    worker->Queue();
+    
+    return env.Undefined();
+}
+
+// Numeric options, left as they are when not given
+template <typename T>
+static void number_option(Napi::Object options, const char* name, T* value) {
+    Napi::Value option = options.Get(name);
+    if (option.IsNumber()) {
+        *value = static_cast<T>(option.As<Napi::Number>().Uint32Value());
+    }
+}
+
+Napi::Value CardReader::Pin(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 4) {
+        Napi::TypeError::New(env, "Wrong number of arguments").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    if (!info[0].IsBoolean() || !info[1].IsBuffer() || !info[2].IsObject() || !info[3].IsFunction()) {
+        Napi::TypeError::New(env, "Wrong arguments").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    // Check if connected
+    Napi::Object jsThis = info.This().As<Napi::Object>();
+    if (!jsThis.Get("connected").As<Napi::Boolean>().Value()) {
+        Napi::Error::New(env, "Card Reader not connected").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    Napi::Buffer<BYTE> apdu = info[1].As<Napi::Buffer<BYTE>>();
+    Napi::Object options = info[2].As<Napi::Object>();
+    Napi::Function callback = info[3].As<Napi::Function>();
+    
+    PinInput* pi = new PinInput();
+    pi->modify = info[0].As<Napi::Boolean>().Value();
+    pi->apdu.assign(apdu.Data(), apdu.Data() + apdu.Length());
+    
+    PinParams& params = pi->params;
+    number_option(options, "timeout", &params.timeout);
+    number_option(options, "timeout2", &params.timeout2);
+    number_option(options, "format", &params.format);
+    number_option(options, "pin_block", &params.pin_block);
+    number_option(options, "length_format", &params.length_format);
+    number_option(options, "min", &params.min_size);
+    number_option(options, "max", &params.max_size);
+    number_option(options, "entry_validation", &params.entry_validation);
+    number_option(options, "messages", &params.messages);
+    number_option(options, "lang_id", &params.lang_id);
+    number_option(options, "offset_old", &params.offset_old);
+    number_option(options, "offset_new", &params.offset_new);
+    number_option(options, "confirm", &params.confirm);
+    
+    Napi::Value msg_index = options.Get("msg_index");
+    if (msg_index.IsArray()) {
+        Napi::Array indexes = msg_index.As<Napi::Array>();
+        for (uint32_t i = 0; i < indexes.Length() && i < 3; i++) {
+            params.msg_index[i] = static_cast<BYTE>(indexes.Get(i).ToNumber().Uint32Value());
         }
-    };
+    } else {
+        number_option(options, "msg_index", &params.msg_index[0]);
+    }
     
-    while (!reader->m_state) {
-        result = SCardGetStatusChange(reader->m_status_card_context, INFINITE, &card_reader_state, 1);
-        
-        std::unique_lock<std::mutex> lock(reader->m_mutex);
-        if (reader->m_state == 1) {
-            // Exit requested by user
-            reader->m_cond.notify_all();
-        } else if (result != (LONG)SCARD_S_SUCCESS) {
-            // Exit this loop due to errors
-            reader->m_state = 2;
+    PinWorker* worker = new PinWorker(callback, this, pi);
+    worker->Queue();
+    
+    return env.Undefined();
+}
+
+Napi::Value CardReader::Storage(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 4) {
+        Napi::TypeError::New(env, "Wrong number of arguments").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    if (!info[0].IsBoolean() || !(info[1].IsBuffer() || info[1].IsNull()) || !info[2].IsObject() ||
+        !info[3].IsFunction()) {
+        Napi::TypeError::New(env, "Wrong arguments").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    // Check if connected
+    Napi::Object jsThis = info.This().As<Napi::Object>();
+    if (!jsThis.Get("connected").As<Napi::Boolean>().Value()) {
+        Napi::Error::New(env, "Card Reader not connected").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    Napi::Object options = info[2].As<Napi::Object>();
+    Napi::Function callback = info[3].As<Napi::Function>();
+    
+    StorageInput* si = new StorageInput();
+    si->write = info[0].As<Napi::Boolean>().Value();
+    si->verify = options.Get("verify").ToBoolean().Value();
+    if (info[1].IsBuffer()) {
+        Napi::Buffer<BYTE> data = info[1].As<Napi::Buffer<BYTE>>();
+        si->data.assign(data.Data(), data.Data() + data.Length());
+    }
+    
+    StorageCard::Layout& layout = si->layout;
+    layout = StorageCard::Layout();
+    number_option(options, "page_size", &layout.page_size);
+    number_option(options, "first_page", &layout.first_page);
+    number_option(options, "pages", &layout.pages);
+    
+    StorageWorker* worker = new StorageWorker(callback, this, si);
+    worker->Queue();
+    
+    return env.Undefined();
+}
+
+Napi::Value CardReader::EnableCache(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 2 || !info[0].IsArray() || !info[1].IsNumber()) {
+        Napi::TypeError::New(env, "Wrong arguments").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    Napi::Array array = info[0].As<Napi::Array>();
+    std::vector<ApduCache::Rule> rules;
+    for (uint32_t i = 0; i < array.Length(); i++) {
+        Napi::Value value = array.Get(i);
+        if (!value.IsObject() || !value.As<Napi::Object>().Get("apdu").IsBuffer()) {
+            Napi::TypeError::New(env, "Cache rule expected").ThrowAsJavaScriptException();
+            return env.Undefined();
         }
         
-        async_result->do_exit = (reader->m_state != 0);
-        async_result->result = result;
-        if (card_reader_state.dwEventState == card_reader_state.dwCurrentState) {
-            async_result->status = 0;
-        } else {
-            async_result->status = card_reader_state.dwEventState;
-        }
-        memcpy(async_result->atr, card_reader_state.rgbAtr, card_reader_state.cbAtr);
-        async_result->atrlen = card_reader_state.cbAtr;
+        Napi::Object obj = value.As<Napi::Object>();
+        Napi::Buffer<BYTE> pattern = obj.Get("apdu").As<Napi::Buffer<BYTE>>();
         
-        lock.unlock();
+        ApduCache::Rule rule;
+        rule.pattern.assign(pattern.Data(), pattern.Data() + pattern.Length());
+        rule.mask.assign(pattern.Length(), 0xFF);
+        
+        Napi::Value mask = obj.Get("mask");
+        if (mask.IsBuffer()) {
+            Napi::Buffer<BYTE> buffer = mask.As<Napi::Buffer<BYTE>>();
+            for (size_t j = 0; j < buffer.Length() && j < rule.mask.size(); j++) {
+                rule.mask[j] = buffer.Data()[j];
+            }
+        }
         
-        reader->m_tsfn.BlockingCall(callback);
-        card_reader_state.dwCurrentState = card_reader_state.dwEventState;
+        rules.push_back(std::move(rule));
+    }
+    
+    m_reader.cache().enable(std::move(rules), info[1].As<Napi::Number>().Uint32Value());
+    
+    return env.Undefined();
+}
+
+Napi::Value CardReader::DisableCache(const Napi::CallbackInfo& info) {
+    m_reader.cache().disable();
+    return info.Env().Undefined();
+}
+
+Napi::Value CardReader::CacheLookup(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 1 || !info[0].IsBuffer()) {
+        Napi::TypeError::New(env, "Buffer expected").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+#ifdef PCSC_SECURE_MESSAGING
+    if (m_sm.active()) {
+        return env.Undefined();
+    }
+#endif
+
+    // A SELECT still queued may change the selection context of the answer
+    if (m_pending) {
+        return env.Undefined();
+    }
+
+    Napi::Buffer<BYTE> apdu = info[0].As<Napi::Buffer<BYTE>>();
+    std::vector<BYTE> response;
+    if (!m_reader.cache().lookup(apdu.Data(), apdu.Length(), response)) {
+        return env.Undefined();
+    }
+    
+    return Napi::Buffer<BYTE>::Copy(env, response.data(), response.size());
+}
+
+Napi::Value CardReader::SetDebounce(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 3 || !info[0].IsNumber() || !info[1].IsNumber() || !info[2].IsBoolean()) {
+        Napi::TypeError::New(env, "Wrong arguments").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    m_monitor.set_debounce(info[0].As<Napi::Number>().Uint32Value(),
+                           info[1].As<Napi::Number>().Uint32Value(),
+                           info[2].As<Napi::Boolean>().Value());
+    
+    return env.Undefined();
+}
+
+Napi::Value CardReader::TlvIndex(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    if (info.Length() < 1 || !info[0].IsBuffer()) {
+        Napi::TypeError::New(env, "Buffer expected").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    Napi::Buffer<uint8_t> buffer = info[0].As<Napi::Buffer<uint8_t>>();
+    std::vector<TlvNode> nodes;
+    bool valid = tlv_index(buffer.Data(), buffer.Length(), &nodes);
+
+    return tlv_value(env, nodes, valid);
+}
+
+#ifdef PCSC_SECURE_MESSAGING
+Napi::Value CardReader::SecureMessagingStart(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    if (info.Length() < 4 || !info[0].IsNumber() ||
+        !info[1].IsBuffer() || !info[2].IsBuffer() || !info[3].IsBuffer()) {
+        Napi::TypeError::New(env, "Wrong arguments").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    SecureMessaging::Cipher cipher = info[0].As<Napi::Number>().Uint32Value() ?
+                                     SecureMessaging::CIPHER_AES : SecureMessaging::CIPHER_3DES;
+    Napi::Buffer<uint8_t> enc = info[1].As<Napi::Buffer<uint8_t>>();
+    Napi::Buffer<uint8_t> mac = info[2].As<Napi::Buffer<uint8_t>>();
+    Napi::Buffer<uint8_t> ssc = info[3].As<Napi::Buffer<uint8_t>>();
+
+    if (!m_sm.start(cipher, enc.Data(), enc.Length(), mac.Data(), mac.Length(), ssc.Data(), ssc.Length())) {
+        Napi::TypeError::New(env, "Invalid key or send sequence counter length").ThrowAsJavaScriptException();
+    }
+
+    return env.Undefined();
+}
+
+Napi::Value CardReader::SecureMessagingEnd(const Napi::CallbackInfo& info) {
+    m_sm.end();
+    return info.Env().Undefined();
+}
+#endif
+
+Napi::Value CardReader::SetQueue(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    if (info.Length() < 2 || !info[0].IsNumber() || !info[1].IsNumber()) {
+        Napi::TypeError::New(env, "Wrong arguments").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    m_queue.configure(info[0].As<Napi::Number>().Uint32Value(),
+                      static_cast<OverflowPolicy>(info[1].As<Napi::Number>().Uint32Value()));
+
+    return env.Undefined();
+}
+
+Napi::Value CardReader::Pause(const Napi::CallbackInfo& info) {
+    m_flowing = false;
+    return info.Env().Undefined();
+}
+
+Napi::Value CardReader::Resume(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    m_flowing = true;
+    if (!m_status_callback.IsEmpty()) {
+        drain(env, m_status_callback.Value());
+    }
+
+    return env.Undefined();
+}
+
+// Delivers one queued event through the status callback, false when there is none
+Napi::Value CardReader::Read(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    AsyncResult event;
+
+    if (m_status_callback.IsEmpty() || !m_queue.pop(&event)) {
+        return Napi::Boolean::New(env, false);
+    }
+
+    dispatch(env, m_status_callback.Value(), event);
+    return Napi::Boolean::New(env, true);
+}
+
+Napi::Value CardReader::Close(const Napi::CallbackInfo& info) {
+    // The monitor thread ends on its own and '_end' is emitted once it is gone,
+    // a producer blocked on a full queue is released first, and a connect
+    // waiting for the reader to be released gives up
+    m_queue.close();
+    m_reader.cancel_waits();
+    
+    if (m_following) {
+        m_shared->unwatch(m_reader.name());
+        return Napi::Number::New(info.Env(), SCARD_S_SUCCESS);
     }
     
-    // Final cleanup
-    reader->m_tsfn.Release();
-    delete async_result;
-}
\ No newline at end of file
+    return Napi::Number::New(info.Env(), m_monitor.close());
+}
@@ -2,25 +2,11 @@
 #define CARDREADER_H
 
 #include <napi.h>
+#include <memory>
 #include <string>
-#include <thread>
-#include <mutex>
-#include <condition_variable>
-#ifdef __APPLE__
-#include <PCSC/winscard.h>
-#include <PCSC/wintypes.h>
-#else
-#include <winscard.h>
-#endif
-
-#ifdef _WIN32
-#define MAX_ATR_SIZE 33
-#endif
-#ifdef WIN32
-#define IOCTL_CCID_ESCAPE (0x42000000 + 3500)
-#else
-#define IOCTL_CCID_ESCAPE (0x42000000 + 1)
-#endif
+#include "pcsccore.h"
+#include "pcscworker.h"
+#include "probes.h"
 
 class CardReader : public Napi::ObjectWrap<CardReader> {
 public:
@@ -28,13 +14,18 @@ public:
     CardReader(const Napi::CallbackInfo& info);
     ~CardReader();
 
-    const SCARDHANDLE& GetHandler() const { return m_card_handle; };
+    const std::string& GetName() const { return m_reader.name(); };
+    Reader& GetReader() { return m_reader; };
+    // Asynchronous operations in flight on the reader, the sync methods fail while it is set
+    std::atomic<unsigned int>* GetPending() { return &m_pending; };
 
 private:
     // Structures
     struct ConnectInput {
         DWORD share_mode;
         DWORD pref_protocol;
+        // Sharing violations are retried for this long, 0 fails at once
+        unsigned int wait_ms;
     };
 
     struct ConnectResult {
@@ -47,12 +38,16 @@ private:
         LPBYTE in_data;
         DWORD in_len;
         DWORD out_len;
+        bool tlv;
+        bool secure;
     };
 
     struct TransmitResult {
         LONG result;
         LPBYTE data;
         DWORD len;
+        bool tlv_valid;
+        std::vector<TlvNode> tlv;
     };
 
     struct ControlInput {
@@ -61,6 +56,9 @@ private:
         DWORD in_len;
         LPVOID out_data;
         DWORD out_len;
+        // The JS buffers stay alive until the worker is done with them
+        Napi::ObjectReference in_buf;
+        Napi::ObjectReference out_buf;
     };
 
     struct ControlResult {
@@ -68,16 +66,38 @@ private:
         DWORD len;
     };
 
-    struct AsyncResult {
+    struct PinInput {
+        bool modify;
+        PinParams params;
+        std::vector<BYTE> apdu;
+    };
+
+    struct PinResult {
         LONG result;
-        DWORD status;
-        BYTE atr[MAX_ATR_SIZE];
-        DWORD atrlen;
-        bool do_exit;
+        BYTE data[258];
+        DWORD len;
     };
 
+    struct StorageInput {
+        bool write;
+        bool verify;
+        std::vector<BYTE> data;
+        // Detected unless pages is set
+        StorageCard::Layout layout;
+    };
+
+    struct StorageResult {
+        LONG result;
+        StorageCard::Error error;
+        uint16_t status;
+        unsigned int chunk;
+        std::vector<BYTE> data;
+    };
+
+    typedef ReaderMonitor::Event AsyncResult;
+
     // AsyncWorker classes
-    class ConnectWorker : public Napi::AsyncWorker {
+    class ConnectWorker : public PcscWorker {
     public:
         ConnectWorker(Napi::Function& callback, CardReader* reader, ConnectInput* input);
         ~ConnectWorker();
@@ -89,10 +109,9 @@ private:
         ConnectResult result_;
     };
 
-    class DisconnectWorker : public Napi::AsyncWorker {
+    class DisconnectWorker : public PcscWorker {
     public:
         DisconnectWorker(Napi::Function& callback, CardReader* reader, DWORD disposition);
-        ~DisconnectWorker();
         void Execute() override;
         void OnOK() override;
     private:
@@ -101,7 +120,7 @@ private:
         LONG result_;
     };
 
-    class TransmitWorker : public Napi::AsyncWorker {
+    class TransmitWorker : public PcscWorker {
     public:
         TransmitWorker(Napi::Function& callback, CardReader* reader, TransmitInput* input);
         ~TransmitWorker();
@@ -113,7 +132,7 @@ private:
         TransmitResult result_;
     };
 
-    class ControlWorker : public Napi::AsyncWorker {
+    class ControlWorker : public PcscWorker {
     public:
         ControlWorker(Napi::Function& callback, CardReader* reader, ControlInput* input);
         ~ControlWorker();
@@ -125,16 +144,38 @@ private:
         ControlResult result_;
     };
 
-    class StatusWorker : public Napi::AsyncWorker {
+    class FeaturesWorker : public PcscWorker {
     public:
-        StatusWorker(Napi::Function& callback, CardReader* reader);
-        ~StatusWorker();
+        FeaturesWorker(Napi::Function& callback, CardReader* reader);
         void Execute() override;
         void OnOK() override;
-        void NotifyJS();
     private:
         CardReader* reader_;
-        AsyncResult* async_result_;
+        ReaderFeatures features_;
+    };
+
+    class PinWorker : public PcscWorker {
+    public:
+        PinWorker(Napi::Function& callback, CardReader* reader, PinInput* input);
+        ~PinWorker();
+        void Execute() override;
+        void OnOK() override;
+    private:
+        CardReader* reader_;
+        PinInput* input_;
+        PinResult result_;
+    };
+
+    class StorageWorker : public PcscWorker {
+    public:
+        StorageWorker(Napi::Function& callback, CardReader* reader, StorageInput* input);
+        ~StorageWorker();
+        void Execute() override;
+        void OnOK() override;
+    private:
+        CardReader* reader_;
+        StorageInput* input_;
+        StorageResult result_;
     };
 
     // Napi methods
@@ -143,22 +184,52 @@ private:
     Napi::Value Disconnect(const Napi::CallbackInfo& info);
     Napi::Value Transmit(const Napi::CallbackInfo& info);
     Napi::Value Control(const Napi::CallbackInfo& info);
+    Napi::Value TransmitSync(const Napi::CallbackInfo& info);
+    Napi::Value ControlSync(const Napi::CallbackInfo& info);
+    Napi::Value Features(const Napi::CallbackInfo& info);
+    Napi::Value Pin(const Napi::CallbackInfo& info);
+    Napi::Value Storage(const Napi::CallbackInfo& info);
+    Napi::Value EnableCache(const Napi::CallbackInfo& info);
+    Napi::Value DisableCache(const Napi::CallbackInfo& info);
+    Napi::Value CacheLookup(const Napi::CallbackInfo& info);
+    Napi::Value SetDebounce(const Napi::CallbackInfo& info);
+    Napi::Value SetQueue(const Napi::CallbackInfo& info);
+    Napi::Value Pause(const Napi::CallbackInfo& info);
+    Napi::Value Resume(const Napi::CallbackInfo& info);
+    Napi::Value Read(const Napi::CallbackInfo& info);
     Napi::Value Close(const Napi::CallbackInfo& info);
+    static Napi::Value TlvIndex(const Napi::CallbackInfo& info);
+#ifdef PCSC_SECURE_MESSAGING
+    Napi::Value SecureMessagingStart(const Napi::CallbackInfo& info);
+    Napi::Value SecureMessagingEnd(const Napi::CallbackInfo& info);
+#endif
 
-    // Thread function
-    static void HandlerFunction(void* arg);
+    // Internal methods
+    Napi::Value atr_info_value(Napi::Env env, const AsyncResult* async_result);
+    Napi::Value status_value(Napi::Env env, const AsyncResult* async_result);
+    void dispatch(Napi::Env env, Napi::Function callback, const AsyncResult& event);
+    void drain(Napi::Env env, Napi::Function callback);
+    static Napi::Value tlv_value(Napi::Env env, const std::vector<TlvNode>& nodes, bool valid);
 
     // Member variables
-    SCARDCONTEXT m_card_context;
-    SCARDCONTEXT m_status_card_context;
-    SCARDHANDLE m_card_handle;
-    std::string m_name;
-    std::thread m_status_thread;
-    std::mutex m_mutex;
-    std::condition_variable m_cond;
-    int m_state;
+    Reader m_reader;
+    ReaderMonitor m_monitor;
+    // Set when the PCSCLite shares its state: its status is published, or
+    // followed instead of monitored
+    std::shared_ptr<SharedState> m_shared;
+    bool m_following;
+    unsigned int m_atr_session;
+    Napi::ObjectReference m_atr_info;
     Napi::ThreadSafeFunction m_tsfn;
     Napi::FunctionReference m_status_callback;
+    EventQueue<AsyncResult> m_queue;
+    std::atomic<bool> m_wake_pending;
+    bool m_flowing;
+    // Asynchronous operations queued or running, the synchronous ones fail meanwhile
+    std::atomic<unsigned int> m_pending;
+#ifdef PCSC_SECURE_MESSAGING
+    SecureMessaging m_sm;
+#endif
 };
 
-#endif /* CARDREADER_H */
\ No newline at end of file
+#endif /* CARDREADER_H */
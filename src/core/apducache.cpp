@@ -0,0 +1,179 @@
+#include "apducache.h"
+
+// Longer selection contexts are left unknown rather than kept growing
+static const size_t MAX_SELECTION_SIZE = 1024;
+
+ApduCache::ApduCache()
+    : m_enabled(false),
+      m_max_entries(0),
+      m_generation(0),
+      m_session(false),
+      m_event_counter(0),
+      m_selection_known(true) {
+}
+
+void ApduCache::enable(std::vector<Rule>&& rules, size_t max_entries) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_rules = std::move(rules);
+    m_max_entries = max_entries;
+    m_enabled = true;
+    m_entries.clear();
+    m_generation++;
+}
+
+void ApduCache::disable() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_enabled = false;
+    m_rules.clear();
+    m_entries.clear();
+    m_generation++;
+}
+
+bool ApduCache::enabled() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return m_enabled;
+}
+
+void ApduCache::invalidate() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_entries.clear();
+    m_session = false;
+    m_atr.clear();
+    reset_selection();
+    m_generation++;
+}
+
+void ApduCache::observe_card(const BYTE* atr, DWORD atr_len, DWORD event_counter) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    std::string current(reinterpret_cast<const char*>(atr), atr_len);
+    if (!m_session || current != m_atr || event_counter != m_event_counter) {
+        m_entries.clear();
+        m_session = true;
+        m_atr.swap(current);
+        m_event_counter = event_counter;
+        reset_selection();
+        m_generation++;
+    }
+}
+
+void ApduCache::reset_selection() {
+    // A card out of reset has its default application or the MF selected
+    m_selection_known = true;
+    m_selection.clear();
+}
+
+void ApduCache::observe_transmit(const BYTE* apdu, DWORD apdu_len, const BYTE* response, DWORD response_len) {
+    // Only an interindustry SELECT moves the card to another context
+    if (apdu_len < 4 || (apdu[0] & 0x80) || apdu[1] != 0xA4) {
+        return;
+    }
+
+    BYTE p1 = apdu[2];
+    BYTE p2 = apdu[3];
+    bool selected = response_len >= 2 &&
+                    ((response[response_len - 2] == 0x90 && response[response_len - 1] == 0x00) ||
+                     response[response_len - 2] == 0x61);
+    // A file of the MF itself, or the MF with no data or 3F 00
+    bool mf = p1 == 0x00 && (apdu_len <= 5 || (apdu_len >= 7 && apdu[4] == 2 && apdu[5] == 0x3F && apdu[6] == 0x00));
+    bool absolute = p1 == 0x04 || p1 == 0x08 || mf;
+
+    std::string select;
+    select.push_back((char)(apdu_len >> 8));
+    select.push_back((char)apdu_len);
+    select.append(reinterpret_cast<const char*>(apdu), apdu_len);
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (!selected || (p2 & 0x03) == 0x02) {
+        // The card may be anywhere: the same APDU of the next occurrence selects another file
+        m_selection_known = false;
+        m_selection.clear();
+    } else if (absolute) {
+        // Selecting again what is selected leaves the context as is
+        if (m_selection_known && m_selection == select) {
+            return;
+        }
+        m_selection_known = true;
+        m_selection.swap(select);
+    } else if (m_selection_known) {
+        // Relative to the current DF, the same EF selected again leaves the context as is
+        if ((p1 == 0x00 || p1 == 0x02) && m_selection.size() >= select.size() &&
+            m_selection.compare(m_selection.size() - select.size(), select.size(), select) == 0) {
+            return;
+        }
+        m_selection += select;
+        if (m_selection.size() > MAX_SELECTION_SIZE) {
+            m_selection_known = false;
+            m_selection.clear();
+        }
+    } else {
+        return;
+    }
+
+    m_generation++;
+}
+
+std::string ApduCache::key(const BYTE* apdu, DWORD apdu_len) const {
+    std::string key;
+    key.push_back((char)(m_selection.size() >> 8));
+    key.push_back((char)m_selection.size());
+    key += m_selection;
+    key.append(reinterpret_cast<const char*>(apdu), apdu_len);
+    return key;
+}
+
+uint64_t ApduCache::generation() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return m_generation;
+}
+
+bool ApduCache::cacheable(const BYTE* apdu, DWORD apdu_len) const {
+    for (const Rule& rule : m_rules) {
+        if (apdu_len < rule.pattern.size()) {
+            continue;
+        }
+
+        size_t i = 0;
+        while (i < rule.pattern.size() &&
+               (apdu[i] & rule.mask[i]) == (rule.pattern[i] & rule.mask[i])) {
+            i++;
+        }
+
+        if (i == rule.pattern.size()) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool ApduCache::lookup(const BYTE* apdu, DWORD apdu_len, std::vector<BYTE>& response) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (!m_enabled || !m_selection_known) {
+        return false;
+    }
+
+    // A SELECT is only found in the context it selects, so serving it never changes the context
+    auto it = m_entries.find(key(apdu, apdu_len));
+    if (it == m_entries.end()) {
+        return false;
+    }
+
+    response.assign(it->second.begin(), it->second.end());
+    return true;
+}
+
+void ApduCache::store(uint64_t generation, const BYTE* apdu, DWORD apdu_len, const BYTE* response, DWORD response_len) {
+    // Only successful answers are worth replaying
+    if (response_len < 2 || response[response_len - 2] != 0x90 || response[response_len - 1] != 0x00) {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (!m_enabled || !m_selection_known || generation != m_generation ||
+        m_entries.size() >= m_max_entries || !cacheable(apdu, apdu_len)) {
+        return;
+    }
+
+    m_entries.emplace(key(apdu, apdu_len),
+                      std::string(reinterpret_cast<const char*>(response), response_len));
+}
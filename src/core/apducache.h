@@ -0,0 +1,75 @@
+#ifndef APDUCACHE_H
+#define APDUCACHE_H
+
+#ifdef __APPLE__
+#include <PCSC/winscard.h>
+#include <PCSC/wintypes.h>
+#else
+#include <winscard.h>
+#endif
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <unordered_map>
+
+// Response cache for idempotent APDUs, scoped to a single card session.
+// Only commands matching one of the rules are cached, and only when the
+// card answered 90 00. Entries are keyed on the selection context as well:
+// the SELECTs which reached the card since the last absolute one (by DF
+// name, by path from the MF, or of the MF), so READ RECORD or GET DATA of
+// an application is never answered once another one is selected.
+class ApduCache {
+public:
+    struct Rule {
+        std::vector<BYTE> pattern;
+        std::vector<BYTE> mask;
+    };
+
+    ApduCache();
+
+    void enable(std::vector<Rule>&& rules, size_t max_entries);
+    void disable();
+    bool enabled();
+
+    // Drops every entry, e.g. when the card went away or was reset
+    void invalidate();
+    // Drops every entry unless the card is the one of the cached session: same
+    // ATR and same pcscd event counter (the high word of dwEventState), with no
+    // invalidation since. Two cards of a model share the ATR, the counter tells
+    // a swap apart even when the removal was never reported.
+    void observe_card(const BYTE* atr, DWORD atr_len, DWORD event_counter);
+
+    // Follows the selection context, for every APDU which reached the card
+    void observe_transmit(const BYTE* apdu, DWORD apdu_len, const BYTE* response, DWORD response_len);
+
+    // Responses are only stored if neither an invalidation nor a change of
+    // selection context happened since generation() was read
+    uint64_t generation();
+    bool lookup(const BYTE* apdu, DWORD apdu_len, std::vector<BYTE>& response);
+    void store(uint64_t generation, const BYTE* apdu, DWORD apdu_len, const BYTE* response, DWORD response_len);
+
+private:
+    bool cacheable(const BYTE* apdu, DWORD apdu_len) const;
+    // m_mutex held
+    void reset_selection();
+    std::string key(const BYTE* apdu, DWORD apdu_len) const;
+
+    std::mutex m_mutex;
+    bool m_enabled;
+    size_t m_max_entries;
+    uint64_t m_generation;
+    // Card of the cached session
+    bool m_session;
+    std::string m_atr;
+    DWORD m_event_counter;
+    // SELECTs of the context, each prefixed with its length on 2 bytes.
+    // Nothing is cached while the context is unknown (a failed SELECT, a
+    // SELECT of the next occurrence...).
+    bool m_selection_known;
+    std::string m_selection;
+    std::vector<Rule> m_rules;
+    std::unordered_map<std::string, std::string> m_entries;
+};
+
+#endif /* APDUCACHE_H */
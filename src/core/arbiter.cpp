@@ -0,0 +1,140 @@
+#include "arbiter.h"
+#include "common.h"
+#include "stats.h"
+#include <algorithm>
+#include <random>
+#include <thread>
+
+const unsigned int ConnectArbiter::MIN_DELAY_MS;
+const unsigned int ConnectArbiter::MAX_DELAY_MS;
+
+// A cancel landing right before a status wait starts only delays it this long
+static const DWORD RELEASE_WAIT_MS = 1000;
+
+ConnectArbiter::ConnectArbiter()
+    : m_next_ticket(0) {
+}
+
+ConnectArbiter& ConnectArbiter::instance() {
+    static ConnectArbiter arbiter;
+    return arbiter;
+}
+
+// Full jitter: a delay drawn between 0 and delay_ms
+static std::chrono::milliseconds jitter(unsigned int delay_ms) {
+    static thread_local std::minstd_rand random(static_cast<unsigned int>(
+        monotonic_ns() ^ std::hash<std::thread::id>()(std::this_thread::get_id())));
+    return std::chrono::milliseconds(std::uniform_int_distribution<unsigned int>(0, delay_ms)(random));
+}
+
+LONG ConnectArbiter::connect(const std::string& reader, DWORD share_mode, unsigned int timeout_ms,
+                             const Attempt& attempt, const Cancelled& cancelled) {
+    Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(timeout_ms);
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    Line& line = m_lines[reader];
+    uint64_t ticket = m_next_ticket++;
+    line.waiters.push_back(ticket);
+
+    LONG result = SCARD_E_SHARING_VIOLATION;
+    unsigned int delay_ms = MIN_DELAY_MS;
+
+    // Waiters of this process go one at a time
+    if (m_turn.wait_until(lock, deadline, [&] { return line.waiters.front() == ticket || cancelled(); })) {
+        while (!cancelled()) {
+            lock.unlock();
+            result = attempt();
+            if (result == (LONG)SCARD_E_SHARING_VIOLATION && Clock::now() < deadline) {
+                wait_released(reader, share_mode, deadline, cancelled);
+            }
+            lock.lock();
+
+            if (result != (LONG)SCARD_E_SHARING_VIOLATION || Clock::now() >= deadline) {
+                break;
+            }
+
+            // The other processes saw the release as well
+            m_turn.wait_for(lock, std::min(jitter(delay_ms), std::chrono::duration_cast<std::chrono::milliseconds>(
+                deadline - Clock::now())), cancelled);
+            delay_ms = std::min(delay_ms * 2, MAX_DELAY_MS);
+        }
+    }
+
+    if (cancelled() && result == (LONG)SCARD_E_SHARING_VIOLATION) {
+        result = SCARD_E_CANCELLED;
+    }
+
+    line.waiters.remove(ticket);
+    if (line.waiters.empty()) {
+        m_lines.erase(reader);
+    }
+    m_turn.notify_all();
+
+    return result;
+}
+
+void ConnectArbiter::wake(const std::string& reader) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    std::map<std::string, Line>::iterator it = m_lines.find(reader);
+    if (it != m_lines.end()) {
+        for (SCARDCONTEXT context : it->second.contexts) {
+            SCardCancel(context);
+        }
+    }
+    m_turn.notify_all();
+}
+
+// Returns once the reader is free for this share mode, gone, or on errors,
+// the next attempt telling which
+void ConnectArbiter::wait_released(const std::string& reader, DWORD share_mode,
+                                   Clock::time_point deadline, const Cancelled& cancelled) {
+    SCARDCONTEXT context;
+    if (SCardEstablishContext(SCARD_SCOPE_SYSTEM, NULL, NULL, &context) != SCARD_S_SUCCESS) {
+        return;
+    }
+    stats_open(STAT_CONTEXTS);
+
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_lines[reader].contexts.insert(context);
+    }
+
+    // Any other process blocks an exclusive connection, only an exclusive one a shared connection
+    const DWORD busy = (share_mode == SCARD_SHARE_EXCLUSIVE) ?
+                       (SCARD_STATE_EXCLUSIVE | SCARD_STATE_INUSE) : SCARD_STATE_EXCLUSIVE;
+    const DWORD gone = SCARD_STATE_UNKNOWN | SCARD_STATE_UNAVAILABLE | SCARD_STATE_EMPTY;
+
+    SCARD_READERSTATE state = SCARD_READERSTATE();
+    state.szReader = reader.c_str();
+    state.dwCurrentState = SCARD_STATE_UNAWARE;
+
+    for (;;) {
+        Clock::time_point now = Clock::now();
+        if (now >= deadline || cancelled()) {
+            break;
+        }
+
+        DWORD timeout = static_cast<DWORD>(std::min<int64_t>(
+            std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count(), RELEASE_WAIT_MS));
+        LONG result = SCardGetStatusChange(context, timeout, &state, 1);
+
+        if (result == (LONG)SCARD_E_TIMEOUT) {
+            continue;
+        }
+
+        if (result != SCARD_S_SUCCESS || !(state.dwEventState & busy) || (state.dwEventState & gone)) {
+            break;
+        }
+
+        state.dwCurrentState = state.dwEventState;
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_lines[reader].contexts.erase(context);
+    }
+
+    SCardReleaseContext(context);
+    stats_close(STAT_CONTEXTS);
+}
@@ -0,0 +1,60 @@
+#ifndef ARBITER_H
+#define ARBITER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <list>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <stdint.h>
+#include "pcscapi.h"
+
+// Arbitrates the connections to readers shared with other processes. A
+// connection refused with SCARD_E_SHARING_VIOLATION waits for the reader to
+// be released, watching SCARD_STATE_EXCLUSIVE and SCARD_STATE_INUSE through
+// SCardGetStatusChange instead of retrying, then tries again after a
+// jittered backoff, so that the processes waiting for the same reader do not
+// all rush at once, up to a deadline. Waiters of this process take turns
+// per reader, in arrival order.
+class ConnectArbiter {
+public:
+    typedef std::chrono::steady_clock Clock;
+    typedef std::function<LONG()> Attempt;
+    typedef std::function<bool()> Cancelled;
+
+    // Backoff bounds of the attempts following a release
+    static const unsigned int MIN_DELAY_MS = 5;
+    static const unsigned int MAX_DELAY_MS = 200;
+
+    static ConnectArbiter& instance();
+
+    // Runs attempt until it does not fail with SCARD_E_SHARING_VIOLATION,
+    // which is returned once timeout_ms is over. SCARD_E_CANCELLED once
+    // cancelled() holds, checked after wake().
+    LONG connect(const std::string& reader, DWORD share_mode, unsigned int timeout_ms,
+                 const Attempt& attempt, const Cancelled& cancelled);
+
+    // Makes the waiters of this reader check whether they are cancelled
+    void wake(const std::string& reader);
+
+private:
+    struct Line {
+        std::list<uint64_t> waiters;
+        std::set<SCARDCONTEXT> contexts;
+    };
+
+    ConnectArbiter();
+
+    void wait_released(const std::string& reader, DWORD share_mode,
+                       Clock::time_point deadline, const Cancelled& cancelled);
+
+    std::mutex m_mutex;
+    std::condition_variable m_turn;
+    std::map<std::string, Line> m_lines;
+    uint64_t m_next_ticket;
+};
+
+#endif /* ARBITER_H */
@@ -0,0 +1,122 @@
+#include "atr.h"
+#include <string.h>
+
+// PC/SC Part 3 registered application provider identifier
+static const BYTE PCSC_RID[] = { 0xA0, 0x00, 0x00, 0x03, 0x06 };
+
+static const char* storage_card_type(BYTE standard, uint16_t card_name) {
+    switch (card_name) {
+        case 0x0001: return "mifare_classic_1k";
+        case 0x0002: return "mifare_classic_4k";
+        case 0x0003: return "mifare_ultralight";
+        case 0x0026: return "mifare_mini";
+        case 0x0036:
+        case 0x0038: return "mifare_plus_2k";
+        case 0x0037:
+        case 0x0039: return "mifare_plus_4k";
+        case 0x003A: return "mifare_ultralight_c";
+        case 0x003B: return "felica";
+        case 0x003D: return "mifare_ultralight_ev1";
+        case 0x0014:
+        case 0x0016:
+        case 0x0022:
+        case 0x0023:
+        case 0x0035: return "icode";
+        case 0x002F:
+        case 0x0030: return "topaz";
+    }
+
+    if (standard == 0x11) {
+        return "felica";
+    }
+    if (standard >= 0x09 && standard <= 0x0C) {
+        return "iso15693";
+    }
+
+    return "storage";
+}
+
+void atr_parse(const BYTE* atr, size_t atr_len, AtrInfo* info) {
+    memset(info, 0, sizeof(AtrInfo));
+    info->tck = -1;
+    info->card_type = "unknown";
+
+    if (atr_len < 2) {
+        return;
+    }
+
+    info->ts = atr[0];
+    info->t0 = atr[1];
+
+    size_t pos = 2;
+    BYTE y = atr[1] >> 4;
+    bool t0_only = true;
+
+    // Each TDi announces which interface bytes follow and the protocol they apply to
+    while (info->interfaces_count < ATR_MAX_INTERFACE_GROUPS) {
+        AtrInfo::Interface& group = info->interfaces[info->interfaces_count++];
+        group.ta = group.tb = group.tc = group.td = -1;
+
+        int* bytes[] = { &group.ta, &group.tb, &group.tc, &group.td };
+        for (int i = 0; i < 4; i++) {
+            if (y & (1 << i)) {
+                if (pos >= atr_len) {
+                    return;
+                }
+                *bytes[i] = atr[pos++];
+            }
+        }
+
+        if (group.td < 0) {
+            break;
+        }
+
+        BYTE protocol = group.td & 0x0F;
+        if (protocol == 0) {
+            info->protocols |= SCARD_PROTOCOL_T0;
+        } else {
+            t0_only = false;
+            if (protocol == 1) {
+                info->protocols |= SCARD_PROTOCOL_T1;
+            }
+        }
+        y = group.td >> 4;
+    }
+
+    // Without TD1 the card only speaks T=0
+    if (info->interfaces[0].td < 0) {
+        info->protocols |= SCARD_PROTOCOL_T0;
+    }
+
+    info->historical_offset = pos;
+    info->historical_len = atr[1] & 0x0F;
+    if (pos + info->historical_len > atr_len) {
+        return;
+    }
+    pos += info->historical_len;
+
+    if (!t0_only) {
+        if (pos >= atr_len) {
+            return;
+        }
+        info->tck = atr[pos++];
+    }
+
+    info->valid = true;
+
+    const BYTE* historical = atr + info->historical_offset;
+    if (info->historical_len >= 11 &&
+        historical[0] == 0x80 && historical[1] == 0x4F && historical[2] >= 0x0C &&
+        memcmp(historical + 3, PCSC_RID, sizeof(PCSC_RID)) == 0) {
+        info->storage = true;
+        info->standard = historical[8];
+        info->card_name = (uint16_t)((historical[9] << 8) | historical[10]);
+        info->card_type = storage_card_type(info->standard, info->card_name);
+    } else if (info->interfaces_count >= 2 &&
+               info->interfaces[0].td == 0x80 && info->interfaces[1].td == 0x01) {
+        // PC/SC Part 3 ATR built by contactless readers from the ATS or ATQB
+        info->card_type = "iso14443_4";
+    } else {
+        info->card_type = "iso7816";
+    }
+}
@@ -0,0 +1,47 @@
+#ifndef ATR_H
+#define ATR_H
+
+#ifdef __APPLE__
+#include <PCSC/winscard.h>
+#include <PCSC/wintypes.h>
+#else
+#include <winscard.h>
+#endif
+#include <stddef.h>
+#include <stdint.h>
+
+#define ATR_MAX_INTERFACE_GROUPS 8
+
+// Decoded ATR (ISO 7816-3) and, for storage cards, the PC/SC Part 3
+// card identification carried in the historical bytes
+struct AtrInfo {
+    // Interface bytes of one group, -1 when absent
+    struct Interface {
+        int ta;
+        int tb;
+        int tc;
+        int td;
+    };
+
+    bool valid;
+    BYTE ts;
+    BYTE t0;
+    Interface interfaces[ATR_MAX_INTERFACE_GROUPS];
+    size_t interfaces_count;
+    size_t historical_offset;
+    size_t historical_len;
+    int tck;
+    DWORD protocols;
+
+    // PC/SC Part 3 storage card identification
+    bool storage;
+    BYTE standard;
+    uint16_t card_name;
+
+    const char* card_type;
+};
+
+// Parses an ATR, never reading past atr_len
+void atr_parse(const BYTE* atr, size_t atr_len, AtrInfo* info);
+
+#endif /* ATR_H */
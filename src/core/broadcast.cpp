@@ -0,0 +1,127 @@
+#include "broadcast.h"
+#include "stats.h"
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <thread>
+
+static void run_sequence(Reader* reader,
+                         const std::vector<std::vector<BYTE>>& apdus,
+                         DWORD out_len,
+                         BroadcastResult& result) {
+    result.result = SCARD_S_SUCCESS;
+    result.responses.reserve(apdus.size());
+
+    // Stop at the first failing APDU, the responses collected so far are kept
+    for (const std::vector<BYTE>& apdu : apdus) {
+        // Never in plain to a card in a secure messaging session
+        if (reader->secure_messaging()) {
+            result.result = SCARD_W_SECURITY_VIOLATION;
+            break;
+        }
+
+        std::vector<BYTE> response(out_len);
+        DWORD len = out_len;
+
+        result.result = reader->transmit(SCARD_PROTOCOL_UNDEFINED,
+                                         apdu.data(),
+                                         apdu.size(),
+                                         response.data(),
+                                         &len);
+        if (result.result != SCARD_S_SUCCESS) {
+            break;
+        }
+
+        response.resize(len);
+        result.responses.push_back(std::move(response));
+    }
+}
+
+// Calls task(index) for every index below count, on up to concurrency threads
+template <typename Task>
+static void run_pool(size_t count, size_t concurrency, Task task) {
+    // Indexes are handed out one at a time, so a slow card only holds up its own thread
+    std::atomic<size_t> next(0);
+    auto run = [&]() {
+        size_t index;
+        while ((index = next++) < count) {
+            task(index);
+        }
+    };
+
+    size_t threads = std::min(std::max<size_t>(concurrency, 1), count);
+    std::vector<std::thread> pool;
+    for (size_t i = 1; i < threads; i++) {
+        pool.emplace_back([&run]() {
+            StatThread counted;
+            run();
+        });
+    }
+
+    // This thread takes part as well
+    run();
+
+    for (std::thread& thread : pool) {
+        thread.join();
+    }
+}
+
+// Indexes below count grouped by reader_of(index), in order. A card handle
+// takes one exchange at a time anyway, so each reader is served by a single
+// thread and its exchanges never interleave.
+template <typename ReaderOf>
+static std::vector<std::vector<size_t>> group_by_reader(size_t count, ReaderOf reader_of) {
+    std::vector<std::vector<size_t>> groups;
+    std::map<Reader*, size_t> group_of;
+    for (size_t i = 0; i < count; i++) {
+        auto inserted = group_of.emplace(reader_of(i), groups.size());
+        if (inserted.second) {
+            groups.emplace_back();
+        }
+        groups[inserted.first->second].push_back(i);
+    }
+    return groups;
+}
+
+void broadcast(const std::vector<Reader*>& readers,
+               const std::vector<std::vector<BYTE>>& apdus,
+               DWORD out_len,
+               size_t concurrency,
+               std::vector<BroadcastResult>* results) {
+    results->assign(readers.size(), BroadcastResult());
+
+    // A reader listed twice runs the sequence twice, one after the other
+    std::vector<std::vector<size_t>> groups =
+        group_by_reader(readers.size(), [&](size_t index) { return readers[index]; });
+
+    run_pool(groups.size(), concurrency, [&](size_t group) {
+        for (size_t index : groups[group]) {
+            run_sequence(readers[index], apdus, out_len, (*results)[index]);
+        }
+    });
+}
+
+void control_batch(const std::vector<ControlEntry>& entries,
+                   size_t concurrency,
+                   std::vector<ControlEntryResult>* results) {
+    results->assign(entries.size(), ControlEntryResult());
+
+    // Entries grouped by reader, in the batch order
+    std::vector<std::vector<size_t>> groups =
+        group_by_reader(entries.size(), [&](size_t index) { return entries[index].reader; });
+
+    run_pool(groups.size(), concurrency, [&](size_t group) {
+        for (size_t index : groups[group]) {
+            const ControlEntry& entry = entries[index];
+            ControlEntryResult& result = (*results)[index];
+
+            result.len = 0;
+            result.result = entry.reader->control(entry.control_code,
+                                                  entry.in_data,
+                                                  entry.in_len,
+                                                  entry.out_data,
+                                                  entry.out_len,
+                                                  &result.len);
+        }
+    });
+}
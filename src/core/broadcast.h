@@ -0,0 +1,50 @@
+#ifndef BROADCAST_H
+#define BROADCAST_H
+
+#ifdef __APPLE__
+#include <PCSC/winscard.h>
+#include <PCSC/wintypes.h>
+#else
+#include <winscard.h>
+#endif
+#include <vector>
+#include "reader.h"
+
+struct BroadcastResult {
+    LONG result;
+    // Responses collected before the first failing APDU
+    std::vector<std::vector<BYTE>> responses;
+};
+
+// Runs the same APDU sequence on several connected readers, up to
+// concurrency of them at a time. The calling thread takes part as well.
+// A reader listed twice gets its sequences in turn, never interleaved.
+void broadcast(const std::vector<Reader*>& readers,
+               const std::vector<std::vector<BYTE>>& apdus,
+               DWORD out_len,
+               size_t concurrency,
+               std::vector<BroadcastResult>* results);
+
+// One control command of a batch, into a caller-owned output buffer
+struct ControlEntry {
+    Reader* reader;
+    DWORD control_code;
+    LPCVOID in_data;
+    DWORD in_len;
+    LPVOID out_data;
+    DWORD out_len;
+};
+
+struct ControlEntryResult {
+    LONG result;
+    DWORD len;
+};
+
+// Runs the control commands of a batch, up to concurrency readers at a time.
+// The commands of one reader are sent in turn, in the batch order, and a
+// failing one does not stop the next. The calling thread takes part as well.
+void control_batch(const std::vector<ControlEntry>& entries,
+                   size_t concurrency,
+                   std::vector<ControlEntryResult>* results);
+
+#endif /* BROADCAST_H */
@@ -2,6 +2,8 @@
 #define COMMON_H
 
 #include <string>
+#include <chrono>
+#include <stdint.h>
 
 #define ERR_MSG_MAX_LEN 512
 
@@ -12,10 +14,18 @@
 #define Sleep(x) usleep((x)*1000)
 #endif
 
+#include "pcscapi.h"
+
 #ifdef _WIN32
 #define snprintf _snprintf
 #endif
 
+// Monotonic time in ns, taken when PC/SC reports an event
+inline uint64_t monotonic_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
 inline std::string error_msg(const char* method, LONG result) {
     char msg[ERR_MSG_MAX_LEN];
 #ifdef _WIN32
@@ -0,0 +1,93 @@
+#include "debounce.h"
+
+Debouncer::Debouncer()
+    : m_dwell_ms(0),
+      m_suppress_ms(0),
+      m_pending(false),
+      m_present(false),
+      m_suppressed(false),
+      m_removed(false) {
+}
+
+void Debouncer::configure(unsigned int dwell_ms, unsigned int suppress_ms) {
+    m_dwell_ms = dwell_ms;
+    m_suppress_ms = suppress_ms;
+    if (m_dwell_ms == 0) {
+        m_pending = false;
+    }
+}
+
+Debouncer::Update Debouncer::update(bool present, Clock::time_point now) {
+    if (present == m_present) {
+        // The card bounced back before the transition was stable
+        if (m_pending) {
+            m_pending = false;
+            return CANCELLED;
+        }
+        return STABLE;
+    }
+
+    if (m_dwell_ms == 0) {
+        return STABLE;
+    }
+
+    // Other state bits may change while waiting, the dwell time keeps running
+    if (!m_pending) {
+        m_pending = true;
+        m_since = now;
+    }
+
+    return PENDING;
+}
+
+DWORD Debouncer::wait_ms(Clock::time_point now) const {
+    if (!m_pending) {
+        return INFINITE;
+    }
+
+    Clock::time_point deadline = m_since + std::chrono::milliseconds(m_dwell_ms);
+    if (deadline <= now) {
+        return 0;
+    }
+
+    // Round up so the wait never ends before the deadline
+    return (DWORD)std::chrono::duration_cast<std::chrono::milliseconds>(
+        deadline - now + std::chrono::milliseconds(1) - Clock::duration(1)).count();
+}
+
+bool Debouncer::expire(Clock::time_point now) {
+    if (!m_pending || now < m_since + std::chrono::milliseconds(m_dwell_ms)) {
+        return false;
+    }
+
+    m_pending = false;
+    return true;
+}
+
+bool Debouncer::commit(bool present, const std::string& identity, Clock::time_point now) {
+    if (present == m_present) {
+        // Other state changes of a suppressed session stay hidden too
+        return !m_suppressed;
+    }
+
+    m_present = present;
+
+    if (!present) {
+        m_removed = true;
+        m_removed_at = now;
+        if (m_suppressed) {
+            m_suppressed = false;
+            return false;
+        }
+        return true;
+    }
+
+    if (m_suppress_ms != 0 && m_removed && identity == m_identity &&
+        now - m_removed_at < std::chrono::milliseconds(m_suppress_ms)) {
+        m_suppressed = true;
+        return false;
+    }
+
+    m_identity = identity;
+    return true;
+}
@@ -0,0 +1,55 @@
+#ifndef DEBOUNCE_H
+#define DEBOUNCE_H
+
+#ifdef __APPLE__
+#include <PCSC/winscard.h>
+#include <PCSC/wintypes.h>
+#else
+#include <winscard.h>
+#endif
+#include <chrono>
+#include <string>
+
+// Filters card presence transitions of one reader so that only stable ones
+// are reported. A transition must last for the dwell time to be reported,
+// and the same card (same identity) coming back within the suppression
+// window after its removal is not reported at all, neither is its removal.
+class Debouncer {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    enum Update {
+        STABLE,
+        PENDING,
+        CANCELLED
+    };
+
+    Debouncer();
+
+    void configure(unsigned int dwell_ms, unsigned int suppress_ms);
+    bool enabled() const { return m_dwell_ms != 0 || m_suppress_ms != 0; }
+
+    // Records a raw transition, STABLE ones can be committed right away
+    Update update(bool present, Clock::time_point now);
+    // Time left before the pending transition is stable, INFINITE if none
+    DWORD wait_ms(Clock::time_point now) const;
+    // Takes the pending transition if it has been stable for the dwell time
+    bool expire(Clock::time_point now);
+    // Applies the suppression window, returns whether the transition is reported
+    bool commit(bool present, const std::string& identity, Clock::time_point now);
+    bool present() const { return m_present; }
+
+private:
+    unsigned int m_dwell_ms;
+    unsigned int m_suppress_ms;
+    bool m_pending;
+    Clock::time_point m_since;
+    // Presence as last committed, including suppressed card sessions
+    bool m_present;
+    bool m_suppressed;
+    bool m_removed;
+    Clock::time_point m_removed_at;
+    std::string m_identity;
+};
+
+#endif /* DEBOUNCE_H */
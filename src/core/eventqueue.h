@@ -0,0 +1,120 @@
+#ifndef EVENTQUEUE_H
+#define EVENTQUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+// What a full queue does with a new event
+enum OverflowPolicy {
+    // The oldest event is dropped
+    OVERFLOW_DROP_OLDEST,
+    // The newest event is replaced, when both can be merged
+    OVERFLOW_COALESCE,
+    // The producer waits for the consumer
+    OVERFLOW_BLOCK
+};
+
+// Bounded queue between a monitoring thread and its consumer. Events a
+// consumer must see (errors, notices) are pushed as not coalescable: a full
+// coalescing queue drops the oldest event instead of merging them.
+template <typename T>
+class EventQueue {
+public:
+    EventQueue()
+        : m_capacity(64),
+          m_policy(OVERFLOW_BLOCK),
+          m_closed(false),
+          m_dropped(0) {
+    }
+
+    void configure(size_t capacity, OverflowPolicy policy) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_capacity = capacity ? capacity : 1;
+        m_policy = policy;
+        // A blocked producer may fit now
+        m_space.notify_all();
+    }
+
+    // False once closed
+    bool push(const T& item, bool coalescable) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+
+        if (m_policy == OVERFLOW_BLOCK) {
+            m_space.wait(lock, [this] { return m_closed || m_items.size() < m_capacity; });
+        }
+
+        if (m_closed) {
+            return false;
+        }
+
+        if (m_items.size() >= m_capacity) {
+            m_dropped++;
+            if (m_policy == OVERFLOW_COALESCE && coalescable && m_items.back().coalescable) {
+                m_items.back().item = item;
+                return true;
+            }
+            m_items.pop_front();
+        }
+
+        m_items.push_back(Entry{ item, coalescable });
+        return true;
+    }
+
+    bool pop(T* item) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+
+        if (m_items.empty()) {
+            return false;
+        }
+
+        *item = m_items.front().item;
+        m_items.pop_front();
+        m_space.notify_one();
+        return true;
+    }
+
+    // Drops the events left by a previous producer
+    void open() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_closed = false;
+        m_items.clear();
+    }
+
+    // Drops the pending events and releases a blocked producer for good
+    void close() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_closed = true;
+        m_items.clear();
+        m_space.notify_all();
+    }
+
+    size_t size() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        return m_items.size();
+    }
+
+    // Events lost to the overflow policy
+    uint64_t dropped() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        return m_dropped;
+    }
+
+private:
+    struct Entry {
+        T item;
+        bool coalescable;
+    };
+
+    std::mutex m_mutex;
+    std::condition_variable m_space;
+    std::deque<Entry> m_items;
+    size_t m_capacity;
+    OverflowPolicy m_policy;
+    bool m_closed;
+    uint64_t m_dropped;
+};
+
+#endif /* EVENTQUEUE_H */
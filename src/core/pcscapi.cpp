@@ -0,0 +1,127 @@
+#include "pcscapi.h"
+#include <mutex>
+#ifdef PCSC_DYNAMIC
+#include <dlfcn.h>
+#endif
+
+#ifdef PCSC_DYNAMIC
+
+template <typename... Args>
+static LONG not_loaded(Args...) {
+    return SCARD_E_NO_SERVICE;
+}
+
+static const char* not_loaded_error(const LONG) {
+    return "PC/SC library not loaded";
+}
+
+PcscApi pcsc_api = {
+    not_loaded, not_loaded, not_loaded, not_loaded, not_loaded, not_loaded,
+    not_loaded, not_loaded, not_loaded, not_loaded, not_loaded_error
+};
+
+#ifdef __APPLE__
+static const char* const DEFAULT_PATHS[] = { "/System/Library/Frameworks/PCSC.framework/PCSC", NULL };
+#else
+static const char* const DEFAULT_PATHS[] = { "libpcsclite.so.1", "libpcsclite.so", NULL };
+#endif
+
+static std::mutex s_mutex;
+static void* s_library = NULL;
+static std::string s_path;
+
+static bool resolve(void* library, PcscApi* api, std::string* missing) {
+    struct Symbol {
+        void** function;
+        const char* name;
+    };
+
+    const Symbol symbols[] = {
+        { reinterpret_cast<void**>(&api->establish_context), "SCardEstablishContext" },
+        { reinterpret_cast<void**>(&api->release_context), "SCardReleaseContext" },
+        { reinterpret_cast<void**>(&api->list_readers), "SCardListReaders" },
+        { reinterpret_cast<void**>(&api->free_memory), "SCardFreeMemory" },
+        { reinterpret_cast<void**>(&api->get_status_change), "SCardGetStatusChange" },
+        { reinterpret_cast<void**>(&api->cancel), "SCardCancel" },
+        { reinterpret_cast<void**>(&api->connect), "SCardConnect" },
+        { reinterpret_cast<void**>(&api->disconnect), "SCardDisconnect" },
+        { reinterpret_cast<void**>(&api->transmit), "SCardTransmit" },
+#ifdef __APPLE__
+        { reinterpret_cast<void**>(&api->control), "SCardControl132" },
+#else
+        { reinterpret_cast<void**>(&api->control), "SCardControl" },
+#endif
+        { reinterpret_cast<void**>(&api->stringify_error), "pcsc_stringify_error" }
+    };
+
+    for (const Symbol& symbol : symbols) {
+        *symbol.function = dlsym(library, symbol.name);
+        if (!*symbol.function) {
+            *missing = symbol.name;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool pcsc_load(const char* path, std::string* error) {
+    std::unique_lock<std::mutex> lock(s_mutex);
+
+    if (s_library) {
+        if (path && s_path != path) {
+            *error = "PC/SC library already loaded from " + s_path;
+            return false;
+        }
+        return true;
+    }
+
+    const char* const given[] = { path, NULL };
+    const char* const* paths = path ? given : DEFAULT_PATHS;
+
+    for (; *paths; paths++) {
+        void* library = dlopen(*paths, RTLD_NOW | RTLD_LOCAL);
+        if (!library) {
+            const char* reason = dlerror();
+            *error = std::string("Cannot load the PC/SC library: ") + (reason ? reason : *paths);
+            continue;
+        }
+
+        PcscApi api;
+        std::string missing;
+        if (!resolve(library, &api, &missing)) {
+            dlclose(library);
+            *error = "Cannot find " + missing + " in " + *paths;
+            continue;
+        }
+
+        // The table is only written here, before any context exists
+        pcsc_api = api;
+        s_library = library;
+        s_path = *paths;
+        return true;
+    }
+
+    return false;
+}
+
+bool pcsc_loaded() {
+    std::unique_lock<std::mutex> lock(s_mutex);
+    return s_library != NULL;
+}
+
+#else
+
+bool pcsc_load(const char* path, std::string* error) {
+    if (path) {
+        *error = "The PC/SC library is linked in this build";
+        return false;
+    }
+    return true;
+}
+
+bool pcsc_loaded() {
+    return true;
+}
+
+#endif
@@ -0,0 +1,55 @@
+#ifndef PCSCAPI_H
+#define PCSCAPI_H
+
+#ifdef __APPLE__
+#include <PCSC/winscard.h>
+#include <PCSC/wintypes.h>
+#else
+#include <winscard.h>
+#endif
+#include <string>
+
+// With PCSC_DYNAMIC the PC/SC library is not linked: pcsc_load() opens it
+// and fills the function table the SCard* names below are routed through,
+// so that loading the addon costs nothing and works on hosts without it.
+// Until then every call fails with SCARD_E_NO_SERVICE. Without
+// PCSC_DYNAMIC (Windows, or pcsc_dynamic=false) the library is linked.
+
+// Opens the library at path, or the platform one when NULL, false with
+// *error set when it or one of its functions is missing. Only the first
+// successful call loads it, a later one with another path fails.
+bool pcsc_load(const char* path, std::string* error);
+bool pcsc_loaded();
+
+#ifdef PCSC_DYNAMIC
+struct PcscApi {
+    decltype(&::SCardEstablishContext) establish_context;
+    decltype(&::SCardReleaseContext) release_context;
+    decltype(&::SCardListReaders) list_readers;
+    decltype(&::SCardFreeMemory) free_memory;
+    decltype(&::SCardGetStatusChange) get_status_change;
+    decltype(&::SCardCancel) cancel;
+    decltype(&::SCardConnect) connect;
+    decltype(&::SCardDisconnect) disconnect;
+    decltype(&::SCardTransmit) transmit;
+    decltype(&::SCardControl) control;
+    decltype(&::pcsc_stringify_error) stringify_error;
+};
+
+extern PcscApi pcsc_api;
+
+#undef SCardControl
+#define SCardEstablishContext pcsc_api.establish_context
+#define SCardReleaseContext pcsc_api.release_context
+#define SCardListReaders pcsc_api.list_readers
+#define SCardFreeMemory pcsc_api.free_memory
+#define SCardGetStatusChange pcsc_api.get_status_change
+#define SCardCancel pcsc_api.cancel
+#define SCardConnect pcsc_api.connect
+#define SCardDisconnect pcsc_api.disconnect
+#define SCardTransmit pcsc_api.transmit
+#define SCardControl pcsc_api.control
+#define pcsc_stringify_error pcsc_api.stringify_error
+#endif
+
+#endif /* PCSCAPI_H */
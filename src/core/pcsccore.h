@@ -0,0 +1,42 @@
+#ifndef PCSCCORE_H
+#define PCSCCORE_H
+
+// Public header of the PC/SC core library. It has no N-API dependency, so
+// native code can use readers directly, the addon being a thin layer on top.
+//
+//   pcsc_load()      opens the PC/SC library, before anything else
+//   ReaderList       reader enumeration and hot plug monitoring
+//   Reader           connect, transmit and control on one reader
+//   ReaderFeatures   PC/SC Part 10 features, cached by Reader::features()
+//   StorageCard      PC/SC Part 3 storage card memory read and written in bulk
+//   ConnectArbiter   sharing violations retried in turn, for Reader::connect_wait()
+//   ReaderMonitor    card status monitoring of one reader
+//   SharedState      reader list and status monitored by one process for the others
+//   broadcast()      the same APDU sequence on several readers at once
+//   control_batch()  control commands on several readers at once
+//   tlv_index()      BER-TLV offset index over a response
+//   EventQueue       bounded queue between a monitor and its consumer
+//   pcsc_error_name() symbolic name of a PC/SC result
+//   stats_get()      live contexts, handles, threads and workers
+//   SecureMessaging  ISO 7816-4 secure messaging, with secure_messaging=true
+
+#include "common.h"
+#include "atr.h"
+#include "apducache.h"
+#include "reader.h"
+#include "readerfeatures.h"
+#include "storagecard.h"
+#include "arbiter.h"
+#include "readerlist.h"
+#include "readermonitor.h"
+#include "sharedstate.h"
+#include "broadcast.h"
+#include "tlv.h"
+#include "eventqueue.h"
+#include "stats.h"
+#include "pcscerror.h"
+#ifdef PCSC_SECURE_MESSAGING
+#include "securemessaging.h"
+#endif
+
+#endif /* PCSCCORE_H */
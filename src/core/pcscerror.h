@@ -0,0 +1,19 @@
+#ifndef PCSCERROR_H
+#define PCSCERROR_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct PcscErrorName {
+    uint32_t code;
+    const char* name;
+};
+
+// Symbolic name of a PC/SC result, such as "SCARD_W_REMOVED_CARD", or NULL.
+// A lookup in a static table, nothing is allocated.
+const char* pcsc_error_name(uint32_t code);
+
+// The whole table, sorted by code
+const PcscErrorName* pcsc_error_names(size_t* count);
+
+#endif /* PCSCERROR_H */
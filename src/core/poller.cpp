@@ -0,0 +1,29 @@
+#include "poller.h"
+#include <algorithm>
+
+const unsigned int Poller::MIN_DELAY_MS;
+const unsigned int Poller::MAX_DELAY_MS;
+
+Poller::Poller()
+    : m_min_ms(MIN_DELAY_MS),
+      m_max_ms(MAX_DELAY_MS),
+      m_delay_ms(MIN_DELAY_MS) {
+}
+
+void Poller::configure(unsigned int min_ms, unsigned int max_ms) {
+    m_min_ms = min_ms ? min_ms : 1;
+    m_max_ms = std::max(max_ms, m_min_ms.load());
+}
+
+void Poller::reset() {
+    m_delay_ms = m_min_ms;
+}
+
+std::chrono::milliseconds Poller::next_delay() {
+    unsigned int min_ms = m_min_ms;
+    unsigned int max_ms = m_max_ms;
+    unsigned int delay_ms = std::min(std::max(m_delay_ms, min_ms), max_ms);
+
+    m_delay_ms = (delay_ms < max_ms / 2) ? delay_ms * 2 : max_ms;
+    return std::chrono::milliseconds(delay_ms);
+}
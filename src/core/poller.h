@@ -0,0 +1,30 @@
+#ifndef POLLER_H
+#define POLLER_H
+
+#include <atomic>
+#include <chrono>
+
+// Interval between two reader lists when the service has no PnP
+// notification: short right after a change or a rescan, doubling up to
+// the maximum while the list stays the same.
+class Poller {
+public:
+    static const unsigned int MIN_DELAY_MS = 100;
+    static const unsigned int MAX_DELAY_MS = 2000;
+
+    Poller();
+
+    // Picked up by the next delay, can be called from any thread
+    void configure(unsigned int min_ms, unsigned int max_ms);
+
+    // The next delay is the minimum one again
+    void reset();
+    std::chrono::milliseconds next_delay();
+
+private:
+    std::atomic<unsigned int> m_min_ms;
+    std::atomic<unsigned int> m_max_ms;
+    unsigned int m_delay_ms;
+};
+
+#endif /* POLLER_H */
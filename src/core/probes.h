@@ -0,0 +1,45 @@
+#ifndef PROBES_H
+#define PROBES_H
+
+// USDT probes of the pcsclite provider, compiled in on Linux with
+// usdt=true (sys/sdt.h comes with systemtap-sdt-dev). A probe is a single
+// nop until a tracer attaches to it, e.g.
+//
+//   bpftrace -e 'usdt:build/Release/pcsclite.node:pcsclite:transmit__done { @[str(arg0)] = hist(arg3); }'
+//
+// Durations are in ns, results are PC/SC results:
+//
+//   worker__queue(reader, op)                   JS thread, op is "connect", "transmit"...
+//   connect__start(reader, share_mode)          worker thread, on Execute() entry
+//   connect__done(reader, result, duration)
+//   disconnect__start(reader, disposition)
+//   disconnect__done(reader, result, duration)
+//   transmit__start(reader, len)                APDU length
+//   transmit__done(reader, len, result, duration)   response length
+//   control__start(reader, code, len)
+//   control__done(reader, len, result, duration)
+//   status__wait(reader, count)                 monitoring thread, before SCardGetStatusChange,
+//   status__done(reader, result, duration)      reader "" for the reader list
+//   tsfn__dispatch(reader, queued)              JS thread, queued events about to be delivered
+
+#ifdef PCSC_USDT
+#include <sys/sdt.h>
+#include "common.h"
+
+#define PCSC_PROBE2(name, a, b) DTRACE_PROBE2(pcsclite, name, a, b)
+#define PCSC_PROBE3(name, a, b, c) DTRACE_PROBE3(pcsclite, name, a, b, c)
+#define PCSC_PROBE4(name, a, b, c, d) DTRACE_PROBE4(pcsclite, name, a, b, c, d)
+
+// Start time of a probed call, only taken when the probes are compiled in
+#define PCSC_PROBE_CLOCK(start) uint64_t start = monotonic_ns()
+#define PCSC_PROBE_ELAPSED(start) (monotonic_ns() - (start))
+#else
+// The arguments are not even evaluated
+#define PCSC_PROBE2(name, a, b) do {} while (0)
+#define PCSC_PROBE3(name, a, b, c) do {} while (0)
+#define PCSC_PROBE4(name, a, b, c, d) do {} while (0)
+
+#define PCSC_PROBE_CLOCK(start) do {} while (0)
+#endif
+
+#endif /* PROBES_H */
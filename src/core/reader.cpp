@@ -0,0 +1,281 @@
+#include "reader.h"
+#include "arbiter.h"
+#include "pcscapi.h"
+#include "stats.h"
+#include <string.h>
+
+Reader::Reader(const std::string& name)
+    : m_name(name),
+      m_context(0),
+      m_handle(0),
+      m_protocol(SCARD_PROTOCOL_UNDEFINED),
+      m_wait_generation(0),
+      m_secure_messaging(false) {
+}
+
+Reader::~Reader() {
+    if (m_handle) {
+        SCardDisconnect(m_handle, SCARD_LEAVE_CARD);
+        stats_close(STAT_HANDLES);
+    }
+
+    if (m_context) {
+        SCardReleaseContext(m_context);
+        stats_close(STAT_CONTEXTS);
+    }
+}
+
+LONG Reader::connect(DWORD share_mode, DWORD preferred_protocols, LPDWORD protocol) {
+    LONG result = SCARD_S_SUCCESS;
+
+    std::unique_lock<std::mutex> lock(m_io_mutex);
+
+    // Is context established
+    if (!m_context) {
+        result = SCardEstablishContext(SCARD_SCOPE_SYSTEM, NULL, NULL, &m_context);
+        if (result != SCARD_S_SUCCESS) {
+            m_context = 0;
+        } else {
+            stats_open(STAT_CONTEXTS);
+        }
+    }
+
+    if (result == SCARD_S_SUCCESS) {
+        result = SCardConnect(m_context,
+                              m_name.c_str(),
+                              share_mode,
+                              preferred_protocols,
+                              &m_handle,
+                              protocol);
+    }
+
+    if (result == SCARD_S_SUCCESS) {
+        m_protocol = *protocol;
+        stats_open(STAT_HANDLES);
+    }
+
+    return result;
+}
+
+LONG Reader::connect_wait(DWORD share_mode, DWORD preferred_protocols, LPDWORD protocol,
+                          unsigned int timeout_ms) {
+    const unsigned int generation = m_wait_generation;
+
+    return ConnectArbiter::instance().connect(
+        m_name, share_mode, timeout_ms,
+        [&] { return connect(share_mode, preferred_protocols, protocol); },
+        [&] { return m_wait_generation != generation; });
+}
+
+void Reader::cancel_waits() {
+    m_wait_generation++;
+    ConnectArbiter::instance().wake(m_name);
+}
+
+LONG Reader::disconnect(DWORD disposition) {
+    LONG result = SCARD_S_SUCCESS;
+
+    std::unique_lock<std::mutex> lock(m_io_mutex);
+
+    if (m_handle) {
+        result = SCardDisconnect(m_handle, disposition);
+        if (result == SCARD_S_SUCCESS) {
+            m_handle = 0;
+            m_protocol = SCARD_PROTOCOL_UNDEFINED;
+            stats_close(STAT_HANDLES);
+        }
+    }
+
+    // Anything but leaving the card as is ends the cached card session
+    if (disposition != SCARD_LEAVE_CARD) {
+        m_cache.invalidate();
+    }
+
+    return result;
+}
+
+LONG Reader::transmit(DWORD protocol, LPCBYTE in_data, DWORD in_len, LPBYTE out_data, LPDWORD out_len) {
+    std::unique_lock<std::mutex> lock(m_io_mutex);
+    return transmit_locked(protocol, in_data, in_len, out_data, out_len);
+}
+
+LONG Reader::try_transmit(DWORD protocol, LPCBYTE in_data, DWORD in_len, LPBYTE out_data, LPDWORD out_len) {
+    std::unique_lock<std::mutex> lock(m_io_mutex, std::try_to_lock);
+    if (!lock.owns_lock()) {
+        return SCARD_E_SERVER_TOO_BUSY;
+    }
+    return transmit_locked(protocol, in_data, in_len, out_data, out_len);
+}
+
+LONG Reader::transmit_locked(DWORD protocol, LPCBYTE in_data, DWORD in_len, LPBYTE out_data, LPDWORD out_len) {
+    LONG result = SCARD_E_INVALID_HANDLE;
+
+    // Connected?
+    if (m_handle) {
+        if (protocol == SCARD_PROTOCOL_UNDEFINED) {
+            protocol = m_protocol;
+        }
+        SCARD_IO_REQUEST send_pci = { protocol, sizeof(SCARD_IO_REQUEST) };
+        result = SCardTransmit(m_handle,
+                               &send_pci,
+                               in_data,
+                               in_len,
+                               NULL,
+                               out_data,
+                               out_len);
+    }
+
+    if (result == SCARD_S_SUCCESS) {
+        m_cache.observe_transmit(in_data, in_len, out_data, *out_len);
+    } else if (result == (LONG)SCARD_W_RESET_CARD || result == (LONG)SCARD_W_REMOVED_CARD) {
+        m_cache.invalidate();
+    }
+
+    return result;
+}
+
+LONG Reader::control(DWORD control_code, LPCVOID in_data, DWORD in_len,
+                     LPVOID out_data, DWORD out_len, LPDWORD returned_len) {
+    std::unique_lock<std::mutex> lock(m_io_mutex);
+    return control_locked(control_code, in_data, in_len, out_data, out_len, returned_len);
+}
+
+LONG Reader::try_control(DWORD control_code, LPCVOID in_data, DWORD in_len,
+                         LPVOID out_data, DWORD out_len, LPDWORD returned_len) {
+    std::unique_lock<std::mutex> lock(m_io_mutex, std::try_to_lock);
+    if (!lock.owns_lock()) {
+        return SCARD_E_SERVER_TOO_BUSY;
+    }
+    return control_locked(control_code, in_data, in_len, out_data, out_len, returned_len);
+}
+
+LONG Reader::control_locked(DWORD control_code, LPCVOID in_data, DWORD in_len,
+                            LPVOID out_data, DWORD out_len, LPDWORD returned_len) {
+    LONG result = SCARD_E_INVALID_HANDLE;
+
+    // Connected?
+    if (m_handle) {
+        result = SCardControl(m_handle,
+                              control_code,
+                              in_data,
+                              in_len,
+                              out_data,
+                              out_len,
+                              returned_len);
+    }
+
+    return result;
+}
+
+LONG Reader::atr(LPBYTE atr, LPDWORD atr_len) {
+    std::unique_lock<std::mutex> lock(m_io_mutex);
+
+    if (!m_handle) {
+        return SCARD_E_INVALID_HANDLE;
+    }
+
+    // The current state is reported at once to a caller unaware of it
+    SCARD_READERSTATE state = SCARD_READERSTATE();
+    state.szReader = m_name.c_str();
+    state.dwCurrentState = SCARD_STATE_UNAWARE;
+    LONG result = SCardGetStatusChange(m_context, 0, &state, 1);
+    if (result != SCARD_S_SUCCESS) {
+        return result;
+    }
+
+    if (state.cbAtr > *atr_len) {
+        return SCARD_E_INSUFFICIENT_BUFFER;
+    }
+
+    memcpy(atr, state.rgbAtr, state.cbAtr);
+    *atr_len = state.cbAtr;
+    return SCARD_S_SUCCESS;
+}
+
+LONG Reader::features(ReaderFeatures* features) {
+    std::unique_lock<std::mutex> lock(m_io_mutex);
+
+    if (!m_features.discovered()) {
+        if (!m_handle) {
+            return SCARD_E_INVALID_HANDLE;
+        }
+
+        BYTE buffer[256];
+        DWORD len = 0;
+        LONG result = SCardControl(m_handle, CM_IOCTL_GET_FEATURE_REQUEST, NULL, 0,
+                                   buffer, sizeof(buffer), &len);
+        if (result != SCARD_S_SUCCESS) {
+            return result;
+        }
+
+        ReaderFeatures discovered;
+        if (!discovered.parse(buffer, len)) {
+            return SCARD_F_INTERNAL_ERROR;
+        }
+
+        // Properties are optional, a reader failing to list them still has its features
+        DWORD code = discovered.code(ReaderFeatures::GET_TLV_PROPERTIES);
+        if (code && SCardControl(m_handle, code, NULL, 0, buffer, sizeof(buffer), &len) == SCARD_S_SUCCESS) {
+            discovered.parse_properties(buffer, len);
+        }
+
+        m_features = discovered;
+    }
+
+    *features = m_features;
+    return SCARD_S_SUCCESS;
+}
+
+static LONG pin_control(Reader* reader, int feature, const std::vector<BYTE>& structure,
+                        LPBYTE out_data, LPDWORD out_len) {
+    ReaderFeatures features;
+    LONG result = reader->features(&features);
+    if (result != SCARD_S_SUCCESS) {
+        return result;
+    }
+
+    DWORD code = features.code(feature);
+    if (!code) {
+        return SCARD_E_UNSUPPORTED_FEATURE;
+    }
+
+    return reader->control(code, structure.data(), structure.size(), out_data, *out_len, out_len);
+}
+
+LONG Reader::verify_pin(const PinParams& params, LPCBYTE apdu, DWORD apdu_len,
+                        LPBYTE out_data, LPDWORD out_len) {
+    std::vector<BYTE> structure;
+    pin_verify_structure(params, apdu, apdu_len, &structure);
+    return pin_control(this, ReaderFeatures::VERIFY_PIN_DIRECT, structure, out_data, out_len);
+}
+
+LONG Reader::modify_pin(const PinParams& params, LPCBYTE apdu, DWORD apdu_len,
+                        LPBYTE out_data, LPDWORD out_len) {
+    std::vector<BYTE> structure;
+    pin_modify_structure(params, apdu, apdu_len, &structure);
+    return pin_control(this, ReaderFeatures::MODIFY_PIN_DIRECT, structure, out_data, out_len);
+}
+
+void Reader::reset_connection() {
+    {
+        std::unique_lock<std::mutex> lock(m_io_mutex);
+        if (m_handle) {
+            SCardDisconnect(m_handle, SCARD_LEAVE_CARD);
+            m_handle = 0;
+            m_protocol = SCARD_PROTOCOL_UNDEFINED;
+            stats_close(STAT_HANDLES);
+        }
+
+        // connect() establishes a new context
+        if (m_context) {
+            SCardReleaseContext(m_context);
+            m_context = 0;
+            stats_close(STAT_CONTEXTS);
+        }
+
+        // The driver may have changed as well
+        m_features.reset();
+    }
+
+    m_cache.invalidate();
+}
@@ -0,0 +1,95 @@
+#ifndef READER_H
+#define READER_H
+
+#ifdef __APPLE__
+#include <PCSC/winscard.h>
+#include <PCSC/wintypes.h>
+#else
+#include <winscard.h>
+#endif
+#include <string>
+#include <mutex>
+#include <atomic>
+#include "apducache.h"
+#include "readerfeatures.h"
+
+#ifdef _WIN32
+#define MAX_ATR_SIZE 33
+#endif
+#ifndef SCARD_E_SERVER_TOO_BUSY
+#define SCARD_E_SERVER_TOO_BUSY ((LONG)0x80100031)
+#endif
+#ifdef WIN32
+#define IOCTL_CCID_ESCAPE (0x42000000 + 3500)
+#else
+#define IOCTL_CCID_ESCAPE (0x42000000 + 1)
+#endif
+
+// The connection to the card of one reader and the I/O on it. Every call
+// blocks and is serialized on the card handle only, so they are meant to
+// run on worker threads and never wait for the status monitor.
+class Reader {
+public:
+    explicit Reader(const std::string& name);
+    ~Reader();
+
+    const std::string& name() const { return m_name; }
+    ApduCache& cache() { return m_cache; }
+
+    LONG connect(DWORD share_mode, DWORD preferred_protocols, LPDWORD protocol);
+    // connect(), retried while another connection holds the reader, for up to timeout_ms
+    LONG connect_wait(DWORD share_mode, DWORD preferred_protocols, LPDWORD protocol,
+                      unsigned int timeout_ms);
+    // The pending connect_wait() calls return SCARD_E_CANCELLED
+    void cancel_waits();
+    LONG disconnect(DWORD disposition);
+    // SCARD_PROTOCOL_UNDEFINED selects the connected protocol
+    LONG transmit(DWORD protocol, LPCBYTE in_data, DWORD in_len, LPBYTE out_data, LPDWORD out_len);
+    LONG control(DWORD control_code, LPCVOID in_data, DWORD in_len,
+                 LPVOID out_data, DWORD out_len, LPDWORD returned_len);
+    // Same as transmit() and control(), for callers which must not block: they
+    // fail with SCARD_E_SERVER_TOO_BUSY while another call holds the card handle
+    LONG try_transmit(DWORD protocol, LPCBYTE in_data, DWORD in_len, LPBYTE out_data, LPDWORD out_len);
+    LONG try_control(DWORD control_code, LPCVOID in_data, DWORD in_len,
+                     LPVOID out_data, DWORD out_len, LPDWORD returned_len);
+
+    // PC/SC Part 10 features of the reader, queried on the first call of the
+    // reader session and then answered without any SCardControl
+    LONG features(ReaderFeatures* features);
+    // PIN entry on the reader PIN pad, the reader completing the APDU with
+    // the PIN. SCARD_E_UNSUPPORTED_FEATURE when it has no PIN pad.
+    LONG verify_pin(const PinParams& params, LPCBYTE apdu, DWORD apdu_len,
+                    LPBYTE out_data, LPDWORD out_len);
+    LONG modify_pin(const PinParams& params, LPCBYTE apdu, DWORD apdu_len,
+                    LPBYTE out_data, LPDWORD out_len);
+
+    // ATR of the connected card, as pcscd reports it
+    LONG atr(LPBYTE atr, LPDWORD atr_len);
+
+    // Drops a connection that did not survive a pcscd restart, and the features with it
+    void reset_connection();
+
+    // Set while a secure messaging session runs on the card. The callers
+    // sending plain APDUs (broadcast, pools, storage) fail with
+    // SCARD_W_SECURITY_VIOLATION instead.
+    void set_secure_messaging(bool active) { m_secure_messaging = active; }
+    bool secure_messaging() const { return m_secure_messaging; }
+
+private:
+    // m_io_mutex held
+    LONG transmit_locked(DWORD protocol, LPCBYTE in_data, DWORD in_len, LPBYTE out_data, LPDWORD out_len);
+    LONG control_locked(DWORD control_code, LPCVOID in_data, DWORD in_len,
+                        LPVOID out_data, DWORD out_len, LPDWORD returned_len);
+
+    std::string m_name;
+    SCARDCONTEXT m_context;
+    SCARDHANDLE m_handle;
+    DWORD m_protocol;
+    std::mutex m_io_mutex;
+    std::atomic<unsigned int> m_wait_generation;
+    std::atomic<bool> m_secure_messaging;
+    ApduCache m_cache;
+    ReaderFeatures m_features;
+};
+
+#endif /* READER_H */
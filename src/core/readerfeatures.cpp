@@ -0,0 +1,190 @@
+#include "readerfeatures.h"
+#include <string.h>
+
+static const char* const feature_names[ReaderFeatures::FEATURE_MAX] = {
+    NULL,
+    "verify_pin_start",
+    "verify_pin_finish",
+    "modify_pin_start",
+    "modify_pin_finish",
+    "get_key_pressed",
+    "verify_pin_direct",
+    "modify_pin_direct",
+    "mct_reader_direct",
+    "mct_universal",
+    "ifd_pin_properties",
+    "abort",
+    "set_spe_message",
+    "verify_pin_direct_app_id",
+    "modify_pin_direct_app_id",
+    "write_display",
+    "get_key",
+    "ifd_display_properties",
+    "get_tlv_properties",
+    "ccid_esc_command",
+    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+    "execute_pace"
+};
+
+static const char* const property_names[ReaderFeatures::PROPERTY_MAX] = {
+    NULL,
+    "wLcdLayout",
+    "bEntryValidationCondition",
+    "bTimeOut2",
+    "wLcdMaxCharacters",
+    "wLcdMaxLines",
+    "bMinPINSize",
+    "bMaxPINSize",
+    "sFirmwareID",
+    "bPPDUSupport",
+    "dwMaxAPDUDataSize",
+    "wIdVendor",
+    "wIdProduct"
+};
+
+ReaderFeatures::ReaderFeatures() {
+    reset();
+}
+
+void ReaderFeatures::reset() {
+    m_discovered = false;
+    memset(m_codes, 0, sizeof(m_codes));
+    memset(m_properties, 0, sizeof(m_properties));
+    m_property_mask = 0;
+    m_firmware_id.clear();
+}
+
+bool ReaderFeatures::parse(const BYTE* data, size_t len) {
+    DWORD codes[FEATURE_MAX] = { 0 };
+
+    for (size_t offset = 0; offset < len; offset += 6) {
+        if (len - offset < 6 || data[offset + 1] != 4) {
+            return false;
+        }
+
+        // Unknown features are skipped, not an error
+        BYTE tag = data[offset];
+        if (tag < FEATURE_MAX) {
+            codes[tag] = (DWORD)data[offset + 2] << 24 | (DWORD)data[offset + 3] << 16 |
+                         (DWORD)data[offset + 4] << 8 | data[offset + 5];
+        }
+    }
+
+    memcpy(m_codes, codes, sizeof(m_codes));
+    m_discovered = true;
+    return true;
+}
+
+bool ReaderFeatures::parse_properties(const BYTE* data, size_t len) {
+    for (size_t offset = 0; offset < len; offset += 2 + data[offset + 1]) {
+        if (len - offset < 2 || len - offset - 2 < data[offset + 1]) {
+            return false;
+        }
+
+        BYTE tag = data[offset];
+        BYTE size = data[offset + 1];
+        const BYTE* value = data + offset + 2;
+        if (tag >= PROPERTY_MAX) {
+            continue;
+        }
+
+        if (tag == FIRMWARE_ID) {
+            m_firmware_id.assign(reinterpret_cast<const char*>(value), size);
+        } else if (size <= 4) {
+            uint32_t number = 0;
+            for (BYTE i = size; i > 0; i--) {
+                number = number << 8 | value[i - 1];
+            }
+            m_properties[tag] = number;
+        } else {
+            continue;
+        }
+        m_property_mask |= 1u << tag;
+    }
+
+    return true;
+}
+
+DWORD ReaderFeatures::code(int feature) const {
+    return (feature > 0 && feature < FEATURE_MAX) ? m_codes[feature] : 0;
+}
+
+const char* ReaderFeatures::name(int feature) {
+    return (feature > 0 && feature < FEATURE_MAX) ? feature_names[feature] : NULL;
+}
+
+bool ReaderFeatures::has_property(int property) const {
+    return property > 0 && property < PROPERTY_MAX && (m_property_mask & (1u << property));
+}
+
+uint32_t ReaderFeatures::property(int property) const {
+    return has_property(property) ? m_properties[property] : 0;
+}
+
+const char* ReaderFeatures::property_name(int property) {
+    return (property > 0 && property < PROPERTY_MAX) ? property_names[property] : NULL;
+}
+
+PinParams::PinParams()
+    : timeout(0),
+      timeout2(0),
+      format(0x82),
+      pin_block(0x04),
+      length_format(0x00),
+      min_size(4),
+      max_size(8),
+      entry_validation(0x02),
+      messages(0x01),
+      lang_id(0x0409),
+      msg_index(),
+      offset_old(0),
+      offset_new(0),
+      confirm(0) {
+}
+
+// The drivers take the 16 and 32 bit fields in host byte order
+template <typename T>
+static void append(std::vector<BYTE>* out, T value) {
+    const BYTE* bytes = reinterpret_cast<const BYTE*>(&value);
+    out->insert(out->end(), bytes, bytes + sizeof(T));
+}
+
+static void append_apdu(std::vector<BYTE>* out, const BYTE* apdu, size_t len) {
+    // bTeoPrologue, only used by T=1 readers doing the framing themselves
+    out->insert(out->end(), 3, 0);
+    append<uint32_t>(out, static_cast<uint32_t>(len));
+    out->insert(out->end(), apdu, apdu + len);
+}
+
+void pin_verify_structure(const PinParams& params, const BYTE* apdu, size_t len, std::vector<BYTE>* out) {
+    out->clear();
+    out->push_back(params.timeout);
+    out->push_back(params.timeout2);
+    out->push_back(params.format);
+    out->push_back(params.pin_block);
+    out->push_back(params.length_format);
+    append<uint16_t>(out, static_cast<uint16_t>(params.min_size << 8 | params.max_size));
+    out->push_back(params.entry_validation);
+    out->push_back(params.messages);
+    append<uint16_t>(out, params.lang_id);
+    out->push_back(params.msg_index[0]);
+    append_apdu(out, apdu, len);
+}
+
+void pin_modify_structure(const PinParams& params, const BYTE* apdu, size_t len, std::vector<BYTE>* out) {
+    out->clear();
+    out->push_back(params.timeout);
+    out->push_back(params.timeout2);
+    out->push_back(params.format);
+    out->push_back(params.pin_block);
+    out->push_back(params.length_format);
+    out->push_back(params.offset_old);
+    out->push_back(params.offset_new);
+    append<uint16_t>(out, static_cast<uint16_t>(params.min_size << 8 | params.max_size));
+    out->push_back(params.confirm);
+    out->push_back(params.entry_validation);
+    out->push_back(params.messages);
+    append<uint16_t>(out, params.lang_id);
+    out->insert(out->end(), params.msg_index, params.msg_index + 3);
+    append_apdu(out, apdu, len);
+}
@@ -0,0 +1,125 @@
+#ifndef READERFEATURES_H
+#define READERFEATURES_H
+
+#ifdef __APPLE__
+#include <PCSC/winscard.h>
+#include <PCSC/wintypes.h>
+#else
+#include <winscard.h>
+#endif
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#ifndef CM_IOCTL_GET_FEATURE_REQUEST
+#ifdef WIN32
+#define CM_IOCTL_GET_FEATURE_REQUEST (0x31 << 16 | 3400 << 2)
+#else
+#define CM_IOCTL_GET_FEATURE_REQUEST (0x42000000 + 3400)
+#endif
+#endif
+
+// PC/SC Part 10 features of a reader, as listed by CM_IOCTL_GET_FEATURE_REQUEST,
+// and its properties from FEATURE_GET_TLV_PROPERTIES. Both belong to the
+// reader and its driver, not to the card, so they are queried once.
+class ReaderFeatures {
+public:
+    enum Feature {
+        VERIFY_PIN_START = 0x01,
+        VERIFY_PIN_FINISH = 0x02,
+        MODIFY_PIN_START = 0x03,
+        MODIFY_PIN_FINISH = 0x04,
+        GET_KEY_PRESSED = 0x05,
+        VERIFY_PIN_DIRECT = 0x06,
+        MODIFY_PIN_DIRECT = 0x07,
+        MCT_READER_DIRECT = 0x08,
+        MCT_UNIVERSAL = 0x09,
+        IFD_PIN_PROPERTIES = 0x0A,
+        ABORT = 0x0B,
+        SET_SPE_MESSAGE = 0x0C,
+        VERIFY_PIN_DIRECT_APP_ID = 0x0D,
+        MODIFY_PIN_DIRECT_APP_ID = 0x0E,
+        WRITE_DISPLAY = 0x0F,
+        GET_KEY = 0x10,
+        IFD_DISPLAY_PROPERTIES = 0x11,
+        GET_TLV_PROPERTIES = 0x12,
+        CCID_ESC_COMMAND = 0x13,
+        EXECUTE_PACE = 0x20,
+        FEATURE_MAX = 0x21
+    };
+
+    enum Property {
+        LCD_LAYOUT = 0x01,
+        ENTRY_VALIDATION_CONDITION = 0x02,
+        TIMEOUT2 = 0x03,
+        LCD_MAX_CHARACTERS = 0x04,
+        LCD_MAX_LINES = 0x05,
+        MIN_PIN_SIZE = 0x06,
+        MAX_PIN_SIZE = 0x07,
+        FIRMWARE_ID = 0x08,
+        PPDU_SUPPORT = 0x09,
+        MAX_APDU_DATA_SIZE = 0x0A,
+        ID_VENDOR = 0x0B,
+        ID_PRODUCT = 0x0C,
+        PROPERTY_MAX = 0x0D
+    };
+
+    ReaderFeatures();
+
+    // True once a feature list was parsed, even an empty one
+    bool discovered() const { return m_discovered; }
+    void reset();
+
+    // Tag, length 4 and big endian control code entries. False, with nothing
+    // kept, on malformed data.
+    bool parse(const BYTE* data, size_t len);
+    // Tag, length and little endian value entries
+    bool parse_properties(const BYTE* data, size_t len);
+
+    // 0 when the reader does not have the feature
+    DWORD code(int feature) const;
+    static const char* name(int feature);
+
+    bool has_property(int property) const;
+    uint32_t property(int property) const;
+    const std::string& firmware_id() const { return m_firmware_id; }
+    static const char* property_name(int property);
+
+private:
+    bool m_discovered;
+    DWORD m_codes[FEATURE_MAX];
+    uint32_t m_properties[PROPERTY_MAX];
+    uint32_t m_property_mask;
+    std::string m_firmware_id;
+};
+
+// PIN entry parameters of PIN_VERIFY_STRUCTURE and PIN_MODIFY_STRUCTURE
+struct PinParams {
+    BYTE timeout;
+    BYTE timeout2;
+    BYTE format;
+    BYTE pin_block;
+    BYTE length_format;
+    BYTE min_size;
+    BYTE max_size;
+    BYTE entry_validation;
+    BYTE messages;
+    uint16_t lang_id;
+    BYTE msg_index[3];
+    // PIN modification only
+    BYTE offset_old;
+    BYTE offset_new;
+    BYTE confirm;
+
+    // Those of the PC/SC Part 10 examples: ASCII PIN of 4 to 8 digits
+    // left justified in the APDU data, validated with the OK key
+    PinParams();
+};
+
+// Packed control data of FEATURE_VERIFY_PIN_DIRECT and FEATURE_MODIFY_PIN_DIRECT,
+// followed by the APDU the reader completes with the PIN
+void pin_verify_structure(const PinParams& params, const BYTE* apdu, size_t len, std::vector<BYTE>* out);
+void pin_modify_structure(const PinParams& params, const BYTE* apdu, size_t len, std::vector<BYTE>* out);
+
+#endif /* READERFEATURES_H */
@@ -0,0 +1,130 @@
+#include "readerfilter.h"
+#include <string.h>
+
+void ReaderFilter::configure(std::vector<std::string>&& include, std::vector<std::string>&& exclude) {
+    m_include = std::move(include);
+    m_exclude = std::move(exclude);
+}
+
+bool ReaderFilter::match(const char* name) const {
+    bool included = m_include.empty();
+    for (const std::string& pattern : m_include) {
+        if (glob_match(pattern.c_str(), name)) {
+            included = true;
+            break;
+        }
+    }
+
+    if (!included) {
+        return false;
+    }
+
+    for (const std::string& pattern : m_exclude) {
+        if (glob_match(pattern.c_str(), name)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void ReaderFilter::apply(char* readers, DWORD* readers_len) const {
+    if (empty() || !readers || *readers_len == 0) {
+        return;
+    }
+
+    // Kept names are moved down over the dropped ones, the list only shrinks
+    const char* end = readers + *readers_len;
+    const char* name = readers;
+    char* out = readers;
+    while (name < end && *name) {
+        size_t len = strlen(name) + 1;
+        if (match(name)) {
+            memmove(out, name, len);
+            out += len;
+        }
+        name += len;
+    }
+
+    *out++ = '\0';
+    *readers_len = (DWORD)(out - readers);
+}
+
+// Tells whether c is in the class starting after '[', *class_end is set past the ']'
+static bool class_match(const char* cls, char c, const char** class_end) {
+    bool negate = (*cls == '!' || *cls == '^');
+    if (negate) {
+        cls++;
+    }
+
+    bool matched = false;
+    bool first = true;
+    while (*cls && (first || *cls != ']')) {
+        if (cls[1] == '-' && cls[2] && cls[2] != ']') {
+            if (cls[0] <= c && c <= cls[2]) {
+                matched = true;
+            }
+            cls += 3;
+        } else {
+            if (*cls == c) {
+                matched = true;
+            }
+            cls++;
+        }
+        first = false;
+    }
+
+    if (!*cls) {
+        // Unterminated class
+        *class_end = NULL;
+        return false;
+    }
+
+    *class_end = cls + 1;
+    return matched != negate;
+}
+
+bool ReaderFilter::glob_match(const char* pattern, const char* name) {
+    // Backtracking only ever needs to resume after the last '*'
+    const char* star = NULL;
+    const char* star_name = NULL;
+
+    while (*name) {
+        const char* next = NULL;
+        if (*pattern == '*') {
+            star = ++pattern;
+            star_name = name;
+            continue;
+        }
+
+        if (*pattern == '?') {
+            next = pattern + 1;
+        } else if (*pattern == '[') {
+            const char* class_end;
+            if (class_match(pattern + 1, *name, &class_end)) {
+                next = class_end;
+            } else if (!class_end && *name == '[') {
+                // An unterminated class is a literal '['
+                next = pattern + 1;
+            }
+        } else if (*pattern && *pattern == *name) {
+            next = pattern + 1;
+        }
+
+        if (next) {
+            pattern = next;
+            name++;
+        } else if (star) {
+            pattern = star;
+            name = ++star_name;
+        } else {
+            return false;
+        }
+    }
+
+    while (*pattern == '*') {
+        pattern++;
+    }
+
+    return !*pattern;
+}
@@ -0,0 +1,33 @@
+#ifndef READERFILTER_H
+#define READERFILTER_H
+
+#ifdef __APPLE__
+#include <PCSC/winscard.h>
+#include <PCSC/wintypes.h>
+#else
+#include <winscard.h>
+#endif
+#include <string>
+#include <vector>
+
+// Include/exclude glob patterns applied to the reader names listed by
+// SCardListReaders. A reader is kept when it matches one of the include
+// patterns (or there are none) and none of the exclude patterns.
+// Patterns support '*', '?' and '[...]' classes ('[!...]' negates).
+class ReaderFilter {
+public:
+    void configure(std::vector<std::string>&& include, std::vector<std::string>&& exclude);
+    bool empty() const { return m_include.empty() && m_exclude.empty(); }
+
+    bool match(const char* name) const;
+    // Drops the filtered out names from a multi-string in place
+    void apply(char* readers, DWORD* readers_len) const;
+
+    static bool glob_match(const char* pattern, const char* name);
+
+private:
+    std::vector<std::string> m_include;
+    std::vector<std::string> m_exclude;
+};
+
+#endif /* READERFILTER_H */
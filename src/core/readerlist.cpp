@@ -0,0 +1,443 @@
+#include "readerlist.h"
+#include "common.h"
+#include "probes.h"
+#include "recovery.h"
+#include "stats.h"
+#include <stdio.h>
+#include <string.h>
+
+// A rescan() or close() landing right before the PnP wait starts has no
+// wait to cancel, it is seen within this time
+static const DWORD PNP_WAIT_MS = 1000;
+
+ReaderList::ReaderList()
+    : m_card_context(0),
+      m_card_reader_state(),
+      m_pnp(false),
+      m_state(0),
+      m_rescan(false) {
+}
+
+ReaderList::~ReaderList() {
+    if (m_status_thread.joinable()) {
+        m_state = 1;
+        SCardCancel(m_card_context);
+        m_status_thread.join();
+    }
+
+    if (m_card_context) {
+        SCardReleaseContext(m_card_context);
+        stats_close(STAT_CONTEXTS);
+    }
+}
+
+LONG ReaderList::init(const char** method) {
+    // Windows-specific service initialization code
+#ifdef _WIN32
+    HKEY hKey;
+    DWORD startStatus, datacb = sizeof(DWORD);
+    LONG _res;
+    _res = RegOpenKeyEx(HKEY_LOCAL_MACHINE, "System\\CurrentControlSet\\Services\\SCardSvr", 0, KEY_READ, &hKey);
+    if (_res != ERROR_SUCCESS) {
+        printf("Reg Open Key exited with %d\n", _res);
+        goto postServiceCheck;
+    }
+    _res = RegQueryValueEx(hKey, "Start", NULL, NULL, (LPBYTE)&startStatus, &datacb);
+    if (_res != ERROR_SUCCESS) {
+        printf("Reg Query Value exited with %d\n", _res);
+        goto postServiceCheck;
+    }
+    if (startStatus != 2) {
+        SHELLEXECUTEINFO seInfo = {0};
+        seInfo.cbSize = sizeof(SHELLEXECUTEINFO);
+        seInfo.fMask = SEE_MASK_NOCLOSEPROCESS;
+        seInfo.hwnd = NULL;
+        seInfo.lpVerb = "runas";
+        seInfo.lpFile = "sc.exe";
+        seInfo.lpParameters = "config SCardSvr start=auto";
+        seInfo.lpDirectory = NULL;
+        seInfo.nShow = SW_SHOWNORMAL;
+        seInfo.hInstApp = NULL;
+        if (!ShellExecuteEx(&seInfo)) {
+            printf("Shell Execute failed with %d\n", GetLastError());
+            goto postServiceCheck;
+        }
+        WaitForSingleObject(seInfo.hProcess, INFINITE);
+        CloseHandle(seInfo.hProcess);
+    }
+postServiceCheck:
+#endif // _WIN32
+
+    if (!pcsc_loaded()) {
+        *method = "pcsc_load";
+        return SCARD_E_NO_SERVICE;
+    }
+
+    LONG result;
+    do {
+        result = SCardEstablishContext(SCARD_SCOPE_SYSTEM, NULL, NULL, &m_card_context);
+    } while(result == SCARD_E_NO_SERVICE || result == SCARD_E_SERVICE_STOPPED);
+
+    if (result != SCARD_S_SUCCESS) {
+        *method = "SCardEstablishContext";
+        return result;
+    }
+    stats_open(STAT_CONTEXTS);
+
+    m_card_reader_state.szReader = "\\\\?PnP?\\Notification";
+    m_card_reader_state.dwCurrentState = SCARD_STATE_UNAWARE;
+    result = SCardGetStatusChange(m_card_context, 0, &m_card_reader_state, 1);
+
+    if ((result != SCARD_S_SUCCESS) && (result != (LONG)SCARD_E_TIMEOUT)) {
+        *method = "SCardGetStatusChange";
+        return result;
+    }
+
+    m_pnp = !(m_card_reader_state.dwEventState & SCARD_STATE_UNKNOWN);
+    return SCARD_S_SUCCESS;
+}
+
+void ReaderList::set_filter(std::vector<std::string>&& include, std::vector<std::string>&& exclude) {
+    m_filter.configure(std::move(include), std::move(exclude));
+}
+
+void ReaderList::set_polling(unsigned int min_ms, unsigned int max_ms) {
+    m_poller.configure(min_ms, max_ms);
+}
+
+LONG ReaderList::list(std::string* names) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    return list_readers(names);
+}
+
+bool ReaderList::start(EventHandler on_event, ExitHandler on_exit) {
+    if (m_status_thread.joinable()) {
+        return false;
+    }
+
+    m_on_event = on_event;
+    m_on_exit = on_exit;
+    m_status_thread = std::thread(&ReaderList::run, this);
+
+    return true;
+}
+
+LONG ReaderList::close() {
+    LONG result = SCARD_S_SUCCESS;
+
+    if (m_pnp) {
+        if (m_status_thread.joinable()) {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            if (m_state == 0) {
+                int ret;
+                int times = 0;
+                m_state = 1;
+                // Wakes up a recovery in progress
+                m_cond.notify_all();
+                do {
+                    result = SCardCancel(m_card_context);
+                    ret = std::cv_status::timeout == m_cond.wait_for(lock, std::chrono::microseconds(10000000)) ? -1 : 0;
+                } while ((ret != 0) && (++times < 5));
+            }
+        }
+    } else {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_state = 1;
+        m_cond.notify_all();
+        // Ends a wait on the known readers
+        if (m_card_context) {
+            result = SCardCancel(m_card_context);
+        }
+    }
+
+    if (m_status_thread.joinable()) {
+        m_status_thread.join();
+    }
+
+    // Nothing waits on the context anymore
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_card_context) {
+        SCardReleaseContext(m_card_context);
+        m_card_context = 0;
+        stats_close(STAT_CONTEXTS);
+    }
+
+    return result;
+}
+
+void ReaderList::rescan() {
+    // close() and recover() swap the context under the lock as well
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_rescan = true;
+    m_cond.notify_all();
+    if (m_card_context) {
+        SCardCancel(m_card_context);
+    }
+}
+
+void ReaderList::notify(const char* notice) {
+    Event event = Event();
+    event.notice = notice;
+    event.timestamp = monotonic_ns();
+    m_on_event(event);
+}
+
+bool ReaderList::recover() {
+    notify("recovering");
+
+    Recovery recovery(Recovery::Clock::now());
+    std::chrono::milliseconds delay;
+
+    // close() cancels through m_card_context, so it is only swapped under the lock
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_card_context) {
+        SCardReleaseContext(m_card_context);
+        m_card_context = 0;
+        stats_close(STAT_CONTEXTS);
+    }
+
+    while (!m_state && recovery.next_delay(Recovery::Clock::now(), &delay)) {
+        if (m_cond.wait_for(lock, delay, [this] { return m_state != 0; })) {
+            break;
+        }
+
+        SCARDCONTEXT context;
+        if (SCardEstablishContext(SCARD_SCOPE_SYSTEM, NULL, NULL, &context) == SCARD_S_SUCCESS) {
+            stats_open(STAT_CONTEXTS);
+            m_card_context = context;
+            m_card_reader_state.dwCurrentState = SCARD_STATE_UNAWARE;
+            lock.unlock();
+
+            notify("recovered");
+            return true;
+        }
+    }
+
+    if (m_state) {
+        m_cond.notify_all();
+    }
+
+    return false;
+}
+
+// Waits until the next list is due. A known reader going away, rescan()
+// and close() end the wait early, inserting a card in one does not.
+void ReaderList::poll(const std::string& names, Event* event) {
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point deadline = Clock::now() + m_poller.next_delay();
+
+    std::vector<SCARD_READERSTATE> states;
+    for (const char* name = names.c_str(); *name; name += strlen(name) + 1) {
+        SCARD_READERSTATE state = SCARD_READERSTATE();
+        state.szReader = name;
+        state.dwCurrentState = SCARD_STATE_UNAWARE;
+        states.push_back(state);
+    }
+
+    while (!m_state && !m_rescan) {
+        Clock::time_point now = Clock::now();
+        if (now >= deadline) {
+            break;
+        }
+
+        if (states.empty()) {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cond.wait_until(lock, deadline, [this] { return m_state != 0 || m_rescan; });
+            break;
+        }
+
+        // A rescan() landing right before the wait starts is not lost, the wait is bounded
+        DWORD timeout = static_cast<DWORD>(
+            std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now).count());
+        PCSC_PROBE2(status__wait, "", states.size());
+        PCSC_PROBE_CLOCK(start);
+        LONG result = SCardGetStatusChange(m_card_context, timeout, states.data(), states.size());
+        PCSC_PROBE3(status__done, "", result, PCSC_PROBE_ELAPSED(start));
+
+        bool gone = (result == (LONG)SCARD_E_UNKNOWN_READER);
+        if (result == SCARD_S_SUCCESS) {
+            for (size_t i = 0; i < states.size(); i++) {
+                if (states[i].dwEventState & (SCARD_STATE_UNKNOWN | SCARD_STATE_UNAVAILABLE)) {
+                    gone = true;
+                }
+                states[i].dwCurrentState = states[i].dwEventState;
+            }
+        }
+
+        if (gone) {
+            event->timestamp = monotonic_ns();
+            m_poller.reset();
+            break;
+        }
+
+        if (result != SCARD_S_SUCCESS) {
+            // Timed out or cancelled, other errors are reported by the next list
+            break;
+        }
+    }
+
+    if (m_rescan.exchange(false)) {
+        m_poller.reset();
+    }
+}
+
+void ReaderList::run() {
+    StatThread counted;
+    Event event = Event();
+    LONG result = SCARD_S_SUCCESS;
+    // Last list sent, compared against when polling
+    std::string known;
+    bool listed = false;
+
+    while (!m_state) {
+        // Get card readers, at start up and when polling the list is the event
+        if (!event.timestamp) {
+            event.timestamp = monotonic_ns();
+        }
+        result = list(&event.names);
+        if (result == (LONG)SCARD_E_NO_READERS_AVAILABLE) {
+            result = SCARD_S_SUCCESS;
+        }
+
+        // pcscd restarted, the readers are listed again once it is back
+        if (Recovery::service_lost(result) && recover()) {
+            continue;
+        }
+
+        // Store the result
+        event.result = result;
+        event.method = "SCardListReaders";
+
+        // Notify the listener, the list is only sent once, and when polling
+        // only if it changed. A change makes the next lists come quickly.
+        bool changed = (event.names != known);
+        if (!m_pnp && changed) {
+            m_poller.reset();
+        }
+        if (m_pnp || changed || !listed || result != SCARD_S_SUCCESS) {
+            m_on_event(event);
+        }
+        known.swap(event.names);
+        listed = true;
+        event.names.clear();
+        event.result = SCARD_S_SUCCESS;
+        event.timestamp = 0;
+
+        if (result == SCARD_S_SUCCESS) {
+            if (m_pnp) {
+                // A rescan() landing while listing had no wait to cancel, the
+                // readers are listed again instead of waiting for the next PnP event
+                if (!m_state && m_rescan.exchange(false)) {
+                    continue;
+                }
+
+                // Set current status
+                m_card_reader_state.dwCurrentState = m_card_reader_state.dwEventState;
+                // Start checking for status change, the wait is bounded for
+                // the rescan() landing between the check above and the wait
+                do {
+                    PCSC_PROBE2(status__wait, "", 1);
+                    PCSC_PROBE_CLOCK(start);
+                    result = SCardGetStatusChange(m_card_context,
+                                                  PNP_WAIT_MS,
+                                                  &m_card_reader_state,
+                                                  1);
+                    PCSC_PROBE3(status__done, "", result, PCSC_PROBE_ELAPSED(start));
+                } while (result == (LONG)SCARD_E_TIMEOUT && !m_state && !m_rescan);
+                event.timestamp = monotonic_ns();
+                event.event_count = m_card_reader_state.dwEventState >> 16;
+
+                // rescan() cancels the wait to list the readers again
+                if ((result == (LONG)SCARD_E_CANCELLED || result == (LONG)SCARD_E_TIMEOUT) &&
+                    !m_state && m_rescan.exchange(false)) {
+                    continue;
+                }
+
+                std::unique_lock<std::mutex> lock(m_mutex);
+                event.result = result;
+                if (m_state) {
+                    m_cond.notify_all();
+                } else if (Recovery::service_lost(result)) {
+                    lock.unlock();
+                    if (recover()) {
+                        continue;
+                    }
+                    lock.lock();
+                }
+
+                if (result != SCARD_S_SUCCESS && !m_state) {
+                    m_state = 2;
+                    event.method = "SCardGetStatusChange";
+                }
+            } else {
+                // PnP is not supported, the list is polled
+                poll(known, &event);
+            }
+        } else if (!m_state) {
+            // Error on last card access, stop monitoring
+            m_state = 2;
+        }
+    }
+
+    // Final notification before exiting
+    event.do_exit = true;
+    m_on_event(event);
+
+    m_on_exit();
+}
+
+LONG ReaderList::list_readers(std::string* names) {
+    DWORD readers_name_length;
+    LPTSTR readers_name;
+
+    LONG result = SCARD_S_SUCCESS;
+
+    names->clear();
+
+#ifdef SCARD_AUTOALLOCATE
+    readers_name_length = SCARD_AUTOALLOCATE;
+    result = SCardListReaders(m_card_context,
+                              NULL,
+                              (LPTSTR)&readers_name,
+                              &readers_name_length);
+#else
+    // Find out ReaderNameLength
+    result = SCardListReaders(m_card_context,
+                              NULL,
+                              NULL,
+                              &readers_name_length);
+    if (result != SCARD_S_SUCCESS) {
+        return result;
+    }
+
+    // Allocate Memory for ReaderName and retrieve all readers in the terminal
+    readers_name = new char[readers_name_length];
+    result = SCardListReaders(m_card_context,
+                              NULL,
+                              readers_name,
+                              &readers_name_length);
+#endif
+
+    if (result != SCARD_S_SUCCESS) {
+#ifndef SCARD_AUTOALLOCATE
+        delete[] readers_name;
+
+        // Retry in case of insufficient buffer error
+        if (result == (LONG)SCARD_E_INSUFFICIENT_BUFFER) {
+            result = list_readers(names);
+        }
+#endif
+        return result;
+    }
+
+    m_filter.apply(readers_name, &readers_name_length);
+    names->assign(readers_name, readers_name_length);
+
+#ifdef SCARD_AUTOALLOCATE
+    SCardFreeMemory(m_card_context, readers_name);
+#else
+    delete[] readers_name;
+#endif
+
+    return result;
+}
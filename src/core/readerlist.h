@@ -0,0 +1,89 @@
+#ifndef READERLIST_H
+#define READERLIST_H
+
+#ifdef __APPLE__
+#include <PCSC/winscard.h>
+#include <PCSC/wintypes.h>
+#else
+#include <winscard.h>
+#endif
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include "poller.h"
+#include "readerfilter.h"
+
+// Enumerates the readers and watches for readers being plugged in or out
+// on its own thread, through the PnP notification when the service has
+// one and by polling otherwise. Polling relists with an adaptive interval
+// and waits on the known readers meanwhile, so a removal is seen right
+// away. pcscd restarts are recovered from.
+class ReaderList {
+public:
+    struct Event {
+        LONG result;
+        // PC/SC function that failed
+        const char* method;
+        // Multi-string as returned by SCardListReaders, empty if no reader
+        std::string names;
+        // "recovering" or "recovered", no reader list then
+        const char* notice;
+        // monotonic_ns() right after the change was reported, or the list taken
+        uint64_t timestamp;
+        // Event counter of the PnP notification, 0 when polling
+        DWORD event_count;
+        bool do_exit;
+    };
+
+    // Both are called on the monitor thread, on_exit right before it returns
+    typedef std::function<void(const Event& event)> EventHandler;
+    typedef std::function<void()> ExitHandler;
+
+    ReaderList();
+    ~ReaderList();
+
+    // Establishes the context and finds out whether PnP is supported,
+    // *method is set to the failing PC/SC function on errors
+    LONG init(const char** method);
+    void set_filter(std::vector<std::string>&& include, std::vector<std::string>&& exclude);
+    // Bounds of the polling interval when there is no PnP notification
+    void set_polling(unsigned int min_ms, unsigned int max_ms);
+
+    // Names of the readers not filtered out
+    LONG list(std::string* names);
+
+    bool start(EventHandler on_event, ExitHandler on_exit);
+    // Stops the monitor thread, waits for it and releases the context
+    LONG close();
+    // Lists the readers again right away
+    void rescan();
+
+    bool pnp() const { return m_pnp; }
+    bool closing() const { return m_state == 1; }
+
+private:
+    LONG list_readers(std::string* names);
+    bool recover();
+    void notify(const char* notice);
+    void poll(const std::string& names, Event* event);
+    void run();
+
+    SCARDCONTEXT m_card_context;
+    SCARD_READERSTATE m_card_reader_state;
+    std::thread m_status_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    bool m_pnp;
+    std::atomic<int> m_state;
+    std::atomic<bool> m_rescan;
+    Poller m_poller;
+    ReaderFilter m_filter;
+    EventHandler m_on_event;
+    ExitHandler m_on_exit;
+};
+
+#endif /* READERLIST_H */
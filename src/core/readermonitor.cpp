@@ -0,0 +1,311 @@
+#include "readermonitor.h"
+#include "common.h"
+#include "debounce.h"
+#include "probes.h"
+#include "recovery.h"
+#include "stats.h"
+#include <algorithm>
+#include <string.h>
+
+// A status wait never lasts longer, so that a missed cancel only delays close()
+static const DWORD STATUS_WAIT_MS = 10000;
+
+static void release_context(SCARDCONTEXT context) {
+    if (context) {
+        SCardReleaseContext(context);
+        stats_close(STAT_CONTEXTS);
+    }
+}
+
+ReaderMonitor::ReaderMonitor(Reader& reader)
+    : m_reader(reader),
+      m_state(MONITOR_STOPPED),
+      m_context(0),
+      m_debounce_dwell(0),
+      m_debounce_suppress(0),
+      m_debounce_uid(false) {
+}
+
+ReaderMonitor::~ReaderMonitor() {
+    if (m_thread.joinable()) {
+        m_state = MONITOR_CLOSING;
+        SCardCancel(m_context);
+        m_thread.join();
+    }
+}
+
+bool ReaderMonitor::start(EventHandler on_event, ExitHandler on_exit) {
+    int expected = MONITOR_STOPPED;
+    if (!m_state.compare_exchange_strong(expected, MONITOR_RUNNING)) {
+        return false;
+    }
+
+    m_on_event = on_event;
+    m_on_exit = on_exit;
+    m_thread = std::thread(&ReaderMonitor::run, this);
+
+    return true;
+}
+
+LONG ReaderMonitor::close() {
+    LONG result = SCARD_S_SUCCESS;
+
+    // Only the first close cancels
+    int expected = MONITOR_RUNNING;
+    if (m_state.compare_exchange_strong(expected, MONITOR_CLOSING)) {
+        {
+            // Wakes up a recovery in progress
+            std::unique_lock<std::mutex> lock(m_recovery_mutex);
+            m_recovery_cond.notify_all();
+        }
+        result = SCardCancel(m_context);
+    }
+
+    return result;
+}
+
+void ReaderMonitor::join() {
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+
+    m_state = MONITOR_STOPPED;
+}
+
+void ReaderMonitor::set_debounce(unsigned int dwell_ms, unsigned int suppress_ms, bool uid) {
+    // Picked up by the monitor thread on its next event
+    m_debounce_dwell = dwell_ms;
+    m_debounce_suppress = suppress_ms;
+    m_debounce_uid = uid;
+}
+
+void ReaderMonitor::notify(const char* notice) {
+    Event event = Event();
+    event.notice = notice;
+    event.timestamp = monotonic_ns();
+    m_on_event(event);
+}
+
+bool ReaderMonitor::recover(SCARD_READERSTATE* reader_state) {
+    notify("recovering");
+
+    Recovery recovery(Recovery::Clock::now());
+    std::chrono::milliseconds delay;
+    const SCARD_READERSTATE last = *reader_state;
+    const DWORD presence = SCARD_STATE_EMPTY | SCARD_STATE_PRESENT;
+
+    // The card handle died with pcscd as well
+    m_reader.reset_connection();
+    release_context(m_context.exchange(0));
+
+    std::unique_lock<std::mutex> lock(m_recovery_mutex);
+    while (m_state == MONITOR_RUNNING && recovery.next_delay(Recovery::Clock::now(), &delay)) {
+        if (m_recovery_cond.wait_for(lock, delay, [this] { return m_state != MONITOR_RUNNING; })) {
+            break;
+        }
+
+        SCARDCONTEXT context = m_context;
+        if (!context) {
+            if (SCardEstablishContext(SCARD_SCOPE_SYSTEM, NULL, NULL, &context) != SCARD_S_SUCCESS) {
+                continue;
+            }
+            stats_open(STAT_CONTEXTS);
+            m_context = context;
+        }
+
+        // The reader is back once pcscd has enumerated it again
+        SCARD_READERSTATE probe = SCARD_READERSTATE();
+        probe.szReader = m_reader.name().c_str();
+        probe.dwCurrentState = SCARD_STATE_UNAWARE;
+        LONG result = SCardGetStatusChange(context, 0, &probe, 1);
+
+        if (result == SCARD_S_SUCCESS &&
+            !(probe.dwEventState & (SCARD_STATE_UNKNOWN | SCARD_STATE_UNAVAILABLE))) {
+            if ((probe.dwEventState & presence) == (last.dwCurrentState & presence) &&
+                probe.cbAtr == last.cbAtr && memcmp(probe.rgbAtr, last.rgbAtr, probe.cbAtr) == 0) {
+                // Same card (or none) as before the restart, keep watching silently
+                reader_state->dwCurrentState = probe.dwEventState;
+            } else {
+                // Reported by the next SCardGetStatusChange
+                reader_state->dwCurrentState = SCARD_STATE_UNAWARE;
+            }
+            lock.unlock();
+
+            notify("recovered");
+            return true;
+        }
+
+        if (Recovery::service_lost(result)) {
+            release_context(m_context.exchange(0));
+        }
+    }
+
+    return false;
+}
+
+// Reads the UID of a contactless card with the PC/SC Part 3 GET DATA command
+static bool read_uid(SCARDCONTEXT context, const char* name, BYTE* uid, DWORD* uid_len) {
+    static const BYTE get_uid[] = { 0xFF, 0xCA, 0x00, 0x00, 0x00 };
+    SCARDHANDLE handle;
+    DWORD protocol;
+    BYTE response[MAX_ATR_SIZE];
+    DWORD len = sizeof(response);
+
+    LONG result = SCardConnect(context, name, SCARD_SHARE_SHARED,
+                               SCARD_PROTOCOL_T0 | SCARD_PROTOCOL_T1, &handle, &protocol);
+    if (result != SCARD_S_SUCCESS) {
+        return false;
+    }
+    stats_open(STAT_HANDLES);
+
+    SCARD_IO_REQUEST send_pci = { protocol, sizeof(SCARD_IO_REQUEST) };
+    result = SCardTransmit(handle, &send_pci, get_uid, sizeof(get_uid), NULL, response, &len);
+    SCardDisconnect(handle, SCARD_LEAVE_CARD);
+    stats_close(STAT_HANDLES);
+
+    if (result != SCARD_S_SUCCESS || len < 2 || len - 2 > *uid_len ||
+        response[len - 2] != 0x90 || response[len - 1] != 0x00) {
+        return false;
+    }
+
+    memcpy(uid, response, len - 2);
+    *uid_len = len - 2;
+    return true;
+}
+
+void ReaderMonitor::run() {
+    StatThread counted;
+    SCARDCONTEXT context;
+    LONG result = SCardEstablishContext(SCARD_SCOPE_SYSTEM, NULL, NULL, &context);
+    m_context = (result == SCARD_S_SUCCESS) ? context : 0;
+    if (m_context) {
+        stats_open(STAT_CONTEXTS);
+    }
+
+    SCARD_READERSTATE card_reader_state = SCARD_READERSTATE();
+    card_reader_state.szReader = m_reader.name().c_str();
+    card_reader_state.dwCurrentState = SCARD_STATE_UNAWARE;
+
+    // Last raw transition, held back until it is stable, and when it happened
+    SCARD_READERSTATE held_state = SCARD_READERSTATE();
+    uint64_t held_timestamp = 0;
+    Debouncer debounce;
+    Event event = Event();
+    // UID of the card session, read only when the card comes in: the state
+    // changes of its session are mostly the application connecting to it
+    bool uid_read = false;
+    std::string uid_atr;
+    BYTE session_uid[sizeof(event.uid)];
+    DWORD session_uidlen = 0;
+
+    while (m_state == MONITOR_RUNNING) {
+        debounce.configure(m_debounce_dwell, m_debounce_suppress);
+
+        // A close() landing right before the wait starts is not lost, the wait is bounded
+        PCSC_PROBE2(status__wait, card_reader_state.szReader, 1);
+        PCSC_PROBE_CLOCK(start);
+        result = SCardGetStatusChange(m_context,
+                                      std::min<DWORD>(debounce.wait_ms(Debouncer::Clock::now()), STATUS_WAIT_MS),
+                                      &card_reader_state,
+                                      1);
+        uint64_t timestamp = monotonic_ns();
+        PCSC_PROBE3(status__done, card_reader_state.szReader, result, PCSC_PROBE_ELAPSED(start));
+
+        // pcscd restarted, the same thread watches the reader once it is back
+        if (m_state == MONITOR_RUNNING && Recovery::service_lost(result) && recover(&card_reader_state)) {
+            continue;
+        }
+
+        Debouncer::Clock::time_point now = Debouncer::Clock::now();
+        const SCARD_READERSTATE* state = &card_reader_state;
+        bool stable = true;
+
+        if (result == (LONG)SCARD_E_TIMEOUT) {
+            // The held transition lasted for the dwell time
+            if (!debounce.expire(now)) {
+                continue;
+            }
+            result = SCARD_S_SUCCESS;
+            state = &held_state;
+            timestamp = held_timestamp;
+        } else if (result == SCARD_S_SUCCESS) {
+            // A removed card, a different ATR or any card event since ends the cached card session
+            if (card_reader_state.dwEventState & SCARD_STATE_EMPTY) {
+                m_reader.cache().invalidate();
+            } else if (card_reader_state.dwEventState & SCARD_STATE_PRESENT) {
+                m_reader.cache().observe_card(card_reader_state.rgbAtr,
+                                              card_reader_state.cbAtr,
+                                              card_reader_state.dwEventState >> 16);
+            }
+
+            bool changed = card_reader_state.dwEventState != card_reader_state.dwCurrentState;
+            card_reader_state.dwCurrentState = card_reader_state.dwEventState;
+
+            if (debounce.enabled()) {
+                held_state = card_reader_state;
+                held_timestamp = timestamp;
+                stable = debounce.update((card_reader_state.dwEventState & SCARD_STATE_PRESENT) != 0,
+                                         now) == Debouncer::STABLE;
+            }
+
+            if (!changed) {
+                card_reader_state.dwCurrentState = 0;
+            }
+        }
+
+        bool present = (state->dwEventState & SCARD_STATE_PRESENT) != 0;
+        DWORD uidlen = 0;
+        if (result == SCARD_S_SUCCESS && stable && debounce.enabled()) {
+            std::string identity(reinterpret_cast<const char*>(state->rgbAtr), state->cbAtr);
+            if (!present || !m_debounce_uid) {
+                uid_read = false;
+            } else if (!uid_read || !debounce.present() || identity != uid_atr) {
+                session_uidlen = sizeof(session_uid);
+                if (!read_uid(m_context, m_reader.name().c_str(), session_uid, &session_uidlen)) {
+                    session_uidlen = 0;
+                }
+                uid_read = true;
+                uid_atr = identity;
+            }
+            if (uid_read) {
+                uidlen = session_uidlen;
+                identity.append(reinterpret_cast<const char*>(session_uid), uidlen);
+            }
+            stable = debounce.commit(present, identity, now);
+        }
+
+        int expected = MONITOR_RUNNING;
+        if (result != (LONG)SCARD_S_SUCCESS) {
+            // Exit this loop due to errors, unless close() was first
+            m_state.compare_exchange_strong(expected, MONITOR_FAILED);
+        } else if (!stable) {
+            // Bounces and suppressed card sessions are never reported
+            card_reader_state.dwCurrentState = card_reader_state.dwEventState;
+            continue;
+        }
+
+        event.do_exit = (m_state != MONITOR_RUNNING);
+        event.result = result;
+        event.status = (state == &card_reader_state && card_reader_state.dwCurrentState == 0) ?
+                       0 : state->dwEventState;
+        // Parse the ATR only when a new card session starts
+        if (state->cbAtr != event.atrlen ||
+            memcmp(event.atr, state->rgbAtr, state->cbAtr) != 0) {
+            atr_parse(state->rgbAtr, state->cbAtr, &event.atr_info);
+            event.atr_session++;
+        }
+        memcpy(event.atr, state->rgbAtr, state->cbAtr);
+        event.atrlen = state->cbAtr;
+        event.timestamp = timestamp;
+        event.event_count = state->dwEventState >> 16;
+        memcpy(event.uid, session_uid, uidlen);
+        event.uidlen = uidlen;
+
+        m_on_event(event);
+        card_reader_state.dwCurrentState = card_reader_state.dwEventState;
+    }
+
+    release_context(m_context.exchange(0));
+
+    m_on_exit();
+}
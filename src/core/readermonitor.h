@@ -0,0 +1,88 @@
+#ifndef READERMONITOR_H
+#define READERMONITOR_H
+
+#ifdef __APPLE__
+#include <PCSC/winscard.h>
+#include <PCSC/wintypes.h>
+#else
+#include <winscard.h>
+#endif
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "reader.h"
+#include "atr.h"
+
+// Watches the status of one reader on its own thread. Debouncing, ATR
+// parsing and the recovery from pcscd restarts happen there, only the
+// events worth reporting reach the event handler.
+class ReaderMonitor {
+public:
+    struct Event {
+        LONG result;
+        DWORD status;
+        BYTE atr[MAX_ATR_SIZE];
+        DWORD atrlen;
+        AtrInfo atr_info;
+        // Changes with every new card session
+        unsigned int atr_session;
+        BYTE uid[16];
+        DWORD uidlen;
+        // "recovering" or "recovered", no status then
+        const char* notice;
+        // monotonic_ns() right after SCardGetStatusChange reported the change
+        uint64_t timestamp;
+        // pcscd event counter, the upper 16 bits of dwEventState
+        DWORD event_count;
+        bool do_exit;
+    };
+
+    // Both are called on the monitor thread, on_exit right before it returns
+    typedef std::function<void(const Event& event)> EventHandler;
+    typedef std::function<void()> ExitHandler;
+
+    explicit ReaderMonitor(Reader& reader);
+    ~ReaderMonitor();
+
+    // False if the monitor is already running
+    bool start(EventHandler on_event, ExitHandler on_exit);
+    // Wait-free, the thread ends on its own and on_exit tells when
+    LONG close();
+    // Once on_exit was called
+    void join();
+
+    bool closing() const { return m_state == MONITOR_CLOSING; }
+    bool stopped() const { return m_state == MONITOR_STOPPED; }
+    void set_debounce(unsigned int dwell_ms, unsigned int suppress_ms, bool uid);
+
+private:
+    // Lifecycle of the monitor, only changed with atomic operations
+    enum MonitorState {
+        MONITOR_RUNNING = 0,
+        MONITOR_CLOSING = 1,
+        MONITOR_FAILED = 2,
+        MONITOR_STOPPED = 3
+    };
+
+    bool recover(SCARD_READERSTATE* reader_state);
+    void notify(const char* notice);
+    void run();
+
+    Reader& m_reader;
+    EventHandler m_on_event;
+    ExitHandler m_on_exit;
+    std::thread m_thread;
+    std::atomic<int> m_state;
+    // Swapped on recovery while close() may cancel it
+    std::atomic<SCARDCONTEXT> m_context;
+    // Only used to cut the recovery backoff short on close()
+    std::mutex m_recovery_mutex;
+    std::condition_variable m_recovery_cond;
+    std::atomic<unsigned int> m_debounce_dwell;
+    std::atomic<unsigned int> m_debounce_suppress;
+    std::atomic<bool> m_debounce_uid;
+};
+
+#endif /* READERMONITOR_H */
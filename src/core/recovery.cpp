@@ -0,0 +1,32 @@
+#include "recovery.h"
+#include <algorithm>
+
+const unsigned int Recovery::MIN_DELAY_MS;
+const unsigned int Recovery::MAX_DELAY_MS;
+const unsigned int Recovery::TIMEOUT_MS;
+
+Recovery::Recovery(Clock::time_point now)
+    : m_deadline(now + std::chrono::milliseconds(TIMEOUT_MS)),
+      m_delay_ms(MIN_DELAY_MS),
+      m_attempts(0) {
+}
+
+bool Recovery::service_lost(LONG result) {
+    return result == (LONG)SCARD_E_NO_SERVICE ||
+           result == (LONG)SCARD_E_SERVICE_STOPPED ||
+           result == (LONG)SCARD_E_INVALID_HANDLE;
+}
+
+bool Recovery::next_delay(Clock::time_point now, std::chrono::milliseconds* delay) {
+    if (now >= m_deadline) {
+        return false;
+    }
+
+    // The last attempt happens right at the deadline
+    std::chrono::milliseconds left = std::chrono::duration_cast<std::chrono::milliseconds>(m_deadline - now);
+    *delay = std::min(std::chrono::milliseconds(m_delay_ms), left);
+
+    m_delay_ms = (m_delay_ms * 2 < MAX_DELAY_MS) ? m_delay_ms * 2 : MAX_DELAY_MS;
+    m_attempts++;
+    return true;
+}
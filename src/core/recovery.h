@@ -0,0 +1,38 @@
+#ifndef RECOVERY_H
+#define RECOVERY_H
+
+#ifdef __APPLE__
+#include <PCSC/winscard.h>
+#include <PCSC/wintypes.h>
+#else
+#include <winscard.h>
+#endif
+#include <chrono>
+
+// Bounded exponential backoff used to re-establish the PC/SC contexts once
+// pcscd is back after a restart. Delays double from MIN_DELAY_MS up to
+// MAX_DELAY_MS, and recovery gives up after TIMEOUT_MS.
+class Recovery {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    static const unsigned int MIN_DELAY_MS = 50;
+    static const unsigned int MAX_DELAY_MS = 2000;
+    static const unsigned int TIMEOUT_MS = 60000;
+
+    explicit Recovery(Clock::time_point now);
+
+    // Tells whether the error means that pcscd went away with our contexts
+    static bool service_lost(LONG result);
+
+    // Delay before the next attempt, false once the timeout is exceeded
+    bool next_delay(Clock::time_point now, std::chrono::milliseconds* delay);
+    unsigned int attempts() const { return m_attempts; }
+
+private:
+    Clock::time_point m_deadline;
+    unsigned int m_delay_ms;
+    unsigned int m_attempts;
+};
+
+#endif /* RECOVERY_H */
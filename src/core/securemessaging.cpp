@@ -0,0 +1,488 @@
+#include "securemessaging.h"
+#include "tlv.h"
+#include <string.h>
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+
+// Room for the secure messaging data objects around the plain data
+#define SM_OVERHEAD 64
+
+static const BYTE ZEROS[16] = { 0 };
+
+// CBC without padding, len being a multiple of the block size
+static bool cbc(const EVP_CIPHER* cipher, const BYTE* key, const BYTE* iv,
+                const BYTE* in, size_t len, BYTE* out, bool encrypt) {
+    EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+    int out_len = 0;
+    int final_len = 0;
+
+    bool ok = ctx != NULL &&
+              EVP_CipherInit_ex(ctx, cipher, NULL, key, iv, encrypt ? 1 : 0) == 1 &&
+              EVP_CIPHER_CTX_set_padding(ctx, 0) == 1 &&
+              EVP_CipherUpdate(ctx, out, &out_len, in, (int)len) == 1 &&
+              EVP_CipherFinal_ex(ctx, out + out_len, &final_len) == 1;
+
+    EVP_CIPHER_CTX_free(ctx);
+    return ok;
+}
+
+static const EVP_CIPHER* session_cipher(SecureMessaging::Cipher cipher, size_t key_len) {
+    if (cipher == SecureMessaging::CIPHER_3DES) {
+        return key_len == 16 ? EVP_des_ede_cbc() : EVP_des_ede3_cbc();
+    }
+
+    switch (key_len) {
+        case 16: return EVP_aes_128_cbc();
+        case 24: return EVP_aes_192_cbc();
+        default: return EVP_aes_256_cbc();
+    }
+}
+
+// ISO 9797-1 padding method 2
+static void pad(std::vector<BYTE>* data, size_t block) {
+    data->push_back(0x80);
+    while (data->size() % block) {
+        data->push_back(0x00);
+    }
+}
+
+static void append_tlv(std::vector<BYTE>* out, BYTE tag, const BYTE* value, size_t len, const BYTE* prefix) {
+    size_t total = len + (prefix ? 1 : 0);
+
+    out->push_back(tag);
+    if (total < 0x80) {
+        out->push_back((BYTE)total);
+    } else if (total < 0x100) {
+        out->push_back(0x81);
+        out->push_back((BYTE)total);
+    } else {
+        out->push_back(0x82);
+        out->push_back((BYTE)(total >> 8));
+        out->push_back((BYTE)total);
+    }
+
+    if (prefix) {
+        out->push_back(*prefix);
+    }
+    out->insert(out->end(), value, value + len);
+}
+
+SecureMessaging::SecureMessaging(Reader& reader)
+    : m_reader(reader),
+      m_active(false),
+      m_cipher(CIPHER_3DES),
+      m_block(8),
+      m_enc_len(0),
+      m_mac_len(0) {
+}
+
+SecureMessaging::~SecureMessaging() {
+    wipe();
+}
+
+bool SecureMessaging::start(Cipher cipher,
+                            const uint8_t* enc, size_t enc_len,
+                            const uint8_t* mac, size_t mac_len,
+                            const uint8_t* ssc, size_t ssc_len) {
+    size_t block = (cipher == CIPHER_AES) ? 16 : 8;
+    bool keys_ok = (cipher == CIPHER_AES) ?
+                   ((enc_len == 16 || enc_len == 24 || enc_len == 32) && mac_len == enc_len) :
+                   ((enc_len == 16 || enc_len == 24) && mac_len == 16);
+
+    if (!keys_ok || ssc_len != block) {
+        return false;
+    }
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    wipe();
+    m_cipher = cipher;
+    m_block = block;
+    memcpy(m_enc, enc, enc_len);
+    m_enc_len = enc_len;
+    memcpy(m_mac, mac, mac_len);
+    m_mac_len = mac_len;
+    memcpy(m_ssc, ssc, ssc_len);
+    m_active = true;
+    m_reader.set_secure_messaging(true);
+
+    return true;
+}
+
+void SecureMessaging::end() {
+    m_active = false;
+    m_reader.set_secure_messaging(false);
+
+    // Otherwise transmit() wipes them once its exchange is over
+    std::unique_lock<std::mutex> lock(m_mutex, std::try_to_lock);
+    if (lock.owns_lock()) {
+        wipe();
+    }
+}
+
+void SecureMessaging::wipe() {
+    OPENSSL_cleanse(m_enc, sizeof(m_enc));
+    OPENSSL_cleanse(m_mac, sizeof(m_mac));
+    OPENSSL_cleanse(m_ssc, sizeof(m_ssc));
+    m_active = false;
+    m_reader.set_secure_messaging(false);
+}
+
+void SecureMessaging::increment_ssc() {
+    for (size_t i = m_block; i-- > 0; ) {
+        if (++m_ssc[i]) {
+            break;
+        }
+    }
+}
+
+// 3DES sessions use a zero IV, AES sessions the encrypted counter
+bool SecureMessaging::iv(BYTE* out) {
+    if (m_cipher == CIPHER_3DES) {
+        memset(out, 0, m_block);
+        return true;
+    }
+
+    return cbc(session_cipher(m_cipher, m_enc_len), m_enc, ZEROS, m_ssc, m_block, out, true);
+}
+
+// MAC over data, which is already padded to the block size
+bool SecureMessaging::compute_mac(const std::vector<BYTE>& data, BYTE mac[8]) {
+    size_t blocks = data.size() / m_block;
+    std::vector<BYTE> out(data.size());
+
+    if (m_cipher == CIPHER_3DES) {
+        // Retail MAC: single DES CBC with K1 (run as K1 K1 3DES), then 3DES on the last block
+        BYTE single[16];
+        BYTE chain[8] = { 0 };
+        memcpy(single, m_mac, 8);
+        memcpy(single + 8, m_mac, 8);
+
+        bool ok = blocks < 2 ||
+                  cbc(EVP_des_ede_cbc(), single, ZEROS, &data[0], (blocks - 1) * 8, &out[0], true);
+        OPENSSL_cleanse(single, sizeof(single));
+        if (!ok) {
+            return false;
+        }
+        if (blocks > 1) {
+            memcpy(chain, &out[(blocks - 2) * 8], 8);
+        }
+
+        if (!cbc(EVP_des_ede_cbc(), m_mac, chain, &data[(blocks - 1) * 8], 8, &out[0], true)) {
+            return false;
+        }
+        memcpy(mac, &out[0], 8);
+        return true;
+    }
+
+    // CMAC (NIST SP 800-38B), the last block being complete once padded
+    const EVP_CIPHER* cipher = session_cipher(m_cipher, m_mac_len);
+    BYTE subkey[16];
+    if (!cbc(cipher, m_mac, ZEROS, ZEROS, 16, subkey, true)) {
+        return false;
+    }
+
+    BYTE carry = (subkey[0] & 0x80) ? 0x87 : 0x00;
+    for (size_t i = 0; i < 15; i++) {
+        subkey[i] = (BYTE)((subkey[i] << 1) | (subkey[i + 1] >> 7));
+    }
+    subkey[15] = (BYTE)((subkey[15] << 1) ^ carry);
+
+    std::vector<BYTE> last(data.end() - 16, data.end());
+    for (size_t i = 0; i < 16; i++) {
+        last[i] ^= subkey[i];
+    }
+    OPENSSL_cleanse(subkey, sizeof(subkey));
+
+    BYTE chain[16] = { 0 };
+    if (blocks > 1) {
+        if (!cbc(cipher, m_mac, ZEROS, &data[0], (blocks - 1) * 16, &out[0], true)) {
+            return false;
+        }
+        memcpy(chain, &out[(blocks - 2) * 16], 16);
+    }
+
+    if (!cbc(cipher, m_mac, chain, &last[0], 16, &out[0], true)) {
+        return false;
+    }
+    memcpy(mac, &out[0], 8);
+    return true;
+}
+
+SecureMessaging::Error SecureMessaging::wrap(const BYTE* apdu, size_t len, std::vector<BYTE>* wrapped) {
+    // Case 1 to 4, short or extended
+    const BYTE* data = NULL;
+    size_t data_len = 0;
+    const BYTE* le = NULL;
+    size_t le_len = 0;
+    bool extended = false;
+
+    if (len < 4) {
+        return SM_BAD_COMMAND;
+    } else if (len == 5) {
+        le = apdu + 4;
+        le_len = 1;
+    } else if (len > 5 && apdu[4] != 0) {
+        data = apdu + 5;
+        data_len = apdu[4];
+        if (len == 6 + data_len) {
+            le = apdu + len - 1;
+            le_len = 1;
+        } else if (len != 5 + data_len) {
+            return SM_BAD_COMMAND;
+        }
+    } else if (len == 7) {
+        le = apdu + 5;
+        le_len = 2;
+        extended = true;
+    } else if (len > 7) {
+        data = apdu + 7;
+        data_len = ((size_t)apdu[5] << 8) | apdu[6];
+        extended = true;
+        if (len == 9 + data_len) {
+            le = apdu + len - 2;
+            le_len = 2;
+        } else if (len != 7 + data_len || data_len == 0) {
+            return SM_BAD_COMMAND;
+        }
+    } else if (len != 4) {
+        return SM_BAD_COMMAND;
+    }
+
+    increment_ssc();
+
+    // Header with the secure messaging indication, padded
+    std::vector<BYTE> mac_input(m_ssc, m_ssc + m_block);
+    BYTE header[4] = { (BYTE)(apdu[0] | 0x0C), apdu[1], apdu[2], apdu[3] };
+    mac_input.insert(mac_input.end(), header, header + 4);
+    pad(&mac_input, m_block);
+
+    std::vector<BYTE> body;
+    if (data_len) {
+        std::vector<BYTE> plain(data, data + data_len);
+        pad(&plain, m_block);
+
+        BYTE chain[16];
+        std::vector<BYTE> cryptogram(plain.size());
+        bool ok = iv(chain) &&
+                  cbc(session_cipher(m_cipher, m_enc_len), m_enc, chain, &plain[0], plain.size(), &cryptogram[0], true);
+        OPENSSL_cleanse(&plain[0], plain.size());
+        if (!ok) {
+            return SM_CRYPTO_FAILED;
+        }
+
+        // Odd INS carry BER-TLV data, without the padding indicator
+        static const BYTE padding_indicator = 0x01;
+        bool odd = (apdu[1] & 0x01) != 0;
+        append_tlv(&body, odd ? 0x85 : 0x87, &cryptogram[0], cryptogram.size(), odd ? NULL : &padding_indicator);
+    }
+
+    if (le) {
+        // Le = 00 (or 00 00) is kept as a single byte
+        size_t value_len = (le_len == 2 && le[0] == 0 && le[1] == 0) ? 1 : le_len;
+        append_tlv(&body, 0x97, le + le_len - value_len, value_len, NULL);
+    }
+
+    mac_input.insert(mac_input.end(), body.begin(), body.end());
+    if (!body.empty()) {
+        pad(&mac_input, m_block);
+    }
+
+    BYTE mac[8];
+    if (!compute_mac(mac_input, mac)) {
+        return SM_CRYPTO_FAILED;
+    }
+    append_tlv(&body, 0x8E, mac, sizeof(mac), NULL);
+
+    extended = extended || body.size() > 0xFF;
+
+    wrapped->assign(header, header + 4);
+    if (extended) {
+        wrapped->push_back(0x00);
+        wrapped->push_back((BYTE)(body.size() >> 8));
+    }
+    wrapped->push_back((BYTE)body.size());
+    wrapped->insert(wrapped->end(), body.begin(), body.end());
+    wrapped->push_back(0x00);
+    if (extended) {
+        wrapped->push_back(0x00);
+    }
+
+    return SM_OK;
+}
+
+SecureMessaging::Error SecureMessaging::unwrap(const BYTE* response, size_t len, BYTE* out_data, DWORD* out_len) {
+    if (len < 2) {
+        return SM_BAD_RESPONSE;
+    }
+
+    increment_ssc();
+
+    const BYTE* sw = response + len - 2;
+    std::vector<TlvNode> nodes;
+    if (!tlv_index(response, len - 2, &nodes)) {
+        return SM_BAD_RESPONSE;
+    }
+
+    uint32_t mac_tag = 0x8E;
+    long mac_node = tlv_find(nodes, &mac_tag, 1);
+    if (mac_node < 0) {
+        // Plain status words are only allowed for errors
+        if (len != 2 || (sw[0] == 0x90 && sw[1] == 0x00) || *out_len < 2) {
+            return SM_BAD_RESPONSE;
+        }
+        memcpy(out_data, sw, 2);
+        *out_len = 2;
+
+        // Missing or wrong SM data objects, the card ended the session
+        if (sw[0] == 0x69 && (sw[1] == 0x87 || sw[1] == 0x88)) {
+            wipe();
+        }
+        return SM_OK;
+    }
+
+    const TlvNode& mac_do = nodes[mac_node];
+    if (mac_do.length != 8 || mac_do.offset + 8 != len - 2 || mac_do.offset < 2) {
+        return SM_BAD_RESPONSE;
+    }
+
+    // Every data object before DO'8E' is authenticated
+    std::vector<BYTE> mac_input(m_ssc, m_ssc + m_block);
+    mac_input.insert(mac_input.end(), response, response + mac_do.offset - 2);
+    pad(&mac_input, m_block);
+
+    BYTE mac[8];
+    if (!compute_mac(mac_input, mac)) {
+        return SM_CRYPTO_FAILED;
+    }
+    if (CRYPTO_memcmp(mac, response + mac_do.offset, 8) != 0) {
+        return SM_BAD_MAC;
+    }
+
+    DWORD written = 0;
+    for (size_t i = 0; i < nodes.size(); i = nodes[i].next) {
+        const TlvNode& node = nodes[i];
+        const BYTE* value = response + node.offset;
+        size_t value_len = node.length;
+
+        if (node.tag == 0x87 || node.tag == 0x85) {
+            if (node.tag == 0x87) {
+                if (value_len < 1 || value[0] != 0x01) {
+                    return SM_BAD_RESPONSE;
+                }
+                value++;
+                value_len--;
+            }
+            if (value_len == 0 || value_len % m_block) {
+                return SM_BAD_RESPONSE;
+            }
+
+            BYTE chain[16];
+            std::vector<BYTE> plain(value_len);
+            if (!iv(chain) ||
+                !cbc(session_cipher(m_cipher, m_enc_len), m_enc, chain, value, value_len, &plain[0], false)) {
+                return SM_CRYPTO_FAILED;
+            }
+
+            // Removes the ISO 9797-1 method 2 padding
+            size_t plain_len = value_len;
+            while (plain_len > 0 && plain[plain_len - 1] == 0x00) {
+                plain_len--;
+            }
+            if (plain_len == 0 || plain[plain_len - 1] != 0x80) {
+                OPENSSL_cleanse(&plain[0], plain.size());
+                return SM_BAD_RESPONSE;
+            }
+            plain_len--;
+
+            if (*out_len < plain_len + 2) {
+                OPENSSL_cleanse(&plain[0], plain.size());
+                return SM_BAD_RESPONSE;
+            }
+            memcpy(out_data, &plain[0], plain_len);
+            OPENSSL_cleanse(&plain[0], plain.size());
+            written = (DWORD)plain_len;
+        } else if (node.tag == 0x99) {
+            if (value_len != 2) {
+                return SM_BAD_RESPONSE;
+            }
+            sw = value;
+        }
+    }
+
+    if (*out_len < written + 2) {
+        return SM_BAD_RESPONSE;
+    }
+    memcpy(out_data + written, sw, 2);
+    *out_len = written + 2;
+
+    return SM_OK;
+}
+
+LONG SecureMessaging::transmit(DWORD protocol,
+                               const BYTE* in_data, DWORD in_len,
+                               BYTE* out_data, DWORD* out_len,
+                               Error* error) {
+    LONG result;
+    {
+        // A command and its response use consecutive counter values
+        std::unique_lock<std::mutex> lock(m_mutex);
+        result = exchange(protocol, in_data, in_len, out_data, out_len, error);
+    }
+
+    // An end() landing during the exchange left the keys to this thread. A
+    // session started since is checked for under the lock.
+    if (!m_active) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        if (!m_active) {
+            wipe();
+        }
+    }
+
+    return result;
+}
+
+LONG SecureMessaging::exchange(DWORD protocol,
+                               const BYTE* in_data, DWORD in_len,
+                               BYTE* out_data, DWORD* out_len,
+                               Error* error) {
+    if (!m_active) {
+        *error = SM_NOT_STARTED;
+        return SCARD_S_SUCCESS;
+    }
+
+    std::vector<BYTE> wrapped;
+    *error = wrap(in_data, in_len, &wrapped);
+    if (*error != SM_OK) {
+        wipe();
+        return SCARD_S_SUCCESS;
+    }
+
+    std::vector<BYTE> response(*out_len + SM_OVERHEAD);
+    DWORD response_len = (DWORD)response.size();
+    LONG result = m_reader.transmit(protocol, &wrapped[0], (DWORD)wrapped.size(), &response[0], &response_len);
+    if (result != SCARD_S_SUCCESS) {
+        wipe();
+        return result;
+    }
+
+    *error = unwrap(&response[0], response_len, out_data, out_len);
+    OPENSSL_cleanse(&response[0], response.size());
+    if (*error != SM_OK) {
+        wipe();
+    }
+
+    return SCARD_S_SUCCESS;
+}
+
+const char* SecureMessaging::error_string(Error error) {
+    switch (error) {
+        case SM_OK: return "Success";
+        case SM_NOT_STARTED: return "No secure messaging session";
+        case SM_BAD_COMMAND: return "Malformed command APDU";
+        case SM_BAD_RESPONSE: return "Malformed or unprotected response";
+        case SM_BAD_MAC: return "Response MAC verification failed";
+        case SM_CRYPTO_FAILED: return "Cryptographic operation failed";
+    }
+
+    return "Unknown error";
+}
@@ -0,0 +1,88 @@
+#ifndef SECUREMESSAGING_H
+#define SECUREMESSAGING_H
+
+#ifdef __APPLE__
+#include <PCSC/winscard.h>
+#include <PCSC/wintypes.h>
+#else
+#include <winscard.h>
+#endif
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include "reader.h"
+
+// ISO 7816-4 secure messaging session (ICAO 9303 / BSI TR-03110 flavor):
+// commands are wrapped into DO'87'/DO'85', DO'97' and DO'8E', responses are
+// checked and unwrapped from DO'87'/DO'85', DO'99' and DO'8E'. 3DES sessions
+// use the ISO 9797-1 retail MAC, AES sessions a CMAC truncated to 8 bytes.
+// The keys and the send sequence counter never leave this object. The reader
+// is flagged while a session runs, so that nothing else sends plain APDUs to
+// its card.
+class SecureMessaging {
+public:
+    enum Cipher {
+        CIPHER_3DES,
+        CIPHER_AES
+    };
+
+    enum Error {
+        SM_OK,
+        SM_NOT_STARTED,
+        SM_BAD_COMMAND,
+        SM_BAD_RESPONSE,
+        SM_BAD_MAC,
+        SM_CRYPTO_FAILED
+    };
+
+    explicit SecureMessaging(Reader& reader);
+    ~SecureMessaging();
+
+    // False when the key or counter lengths do not fit the cipher
+    bool start(Cipher cipher,
+               const uint8_t* enc, size_t enc_len,
+               const uint8_t* mac, size_t mac_len,
+               const uint8_t* ssc, size_t ssc_len);
+    // Never waits for an exchange in flight, which wipes the keys once the card answered
+    void end();
+    // Lock free, for the JS thread
+    bool active() const { return m_active; }
+
+    // Wraps the command, transmits it and unwraps the response. Any failure
+    // ends the session, since both sides are then out of sync.
+    LONG transmit(DWORD protocol,
+                  const BYTE* in_data, DWORD in_len,
+                  BYTE* out_data, DWORD* out_len,
+                  Error* error);
+
+    static const char* error_string(Error error);
+
+private:
+    // m_mutex held
+    LONG exchange(DWORD protocol,
+                  const BYTE* in_data, DWORD in_len,
+                  BYTE* out_data, DWORD* out_len,
+                  Error* error);
+    Error wrap(const BYTE* apdu, size_t len, std::vector<BYTE>* wrapped);
+    Error unwrap(const BYTE* response, size_t len, BYTE* out_data, DWORD* out_len);
+    void increment_ssc();
+    bool compute_mac(const std::vector<BYTE>& data, BYTE mac[8]);
+    bool iv(BYTE* out);
+    void wipe();
+
+    Reader& m_reader;
+    // Sequences the counter and the key use of the exchanges
+    std::mutex m_mutex;
+    std::atomic<bool> m_active;
+    Cipher m_cipher;
+    size_t m_block;
+    BYTE m_enc[32];
+    size_t m_enc_len;
+    BYTE m_mac[32];
+    size_t m_mac_len;
+    BYTE m_ssc[16];
+};
+
+#endif /* SECUREMESSAGING_H */
@@ -0,0 +1,520 @@
+#include "sharedstate.h"
+#include "stats.h"
+#include <limits.h>
+#include <string.h>
+#include <vector>
+#ifdef __linux__
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+static const uint32_t MAGIC = 0x50435343;   // "PCSC"
+
+// A follower notices a dead owner within this time
+static const unsigned int OWNER_CHECK_MS = 1000;
+
+// An owner initializing the segment is waited for this many times 10 ms
+static const int OPEN_RETRIES = 100;
+
+// A snapshot retried this many times checks the owner is still alive
+static const unsigned int SNAPSHOT_OWNER_CHECK = 1024;
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t) && std::atomic<uint32_t>::is_always_lock_free,
+              "std::atomic<uint32_t> must be usable as a futex");
+
+struct SharedState::Slot {
+    char name[MAX_NAME];
+    // Generation of the last status, 0 for a free slot
+    uint32_t serial;
+    uint32_t result;
+    uint32_t status;
+    uint32_t event_count;
+    uint64_t timestamp;
+    uint32_t atrlen;
+    uint32_t uidlen;
+    uint8_t atr[MAX_ATR_SIZE];
+    uint8_t uid[16];
+};
+
+// Copied as a whole by the followers
+struct SharedState::Data {
+    // Generation of the last reader list, 0 before the first one
+    uint32_t list_serial;
+    uint32_t list_event_count;
+    uint64_t list_timestamp;
+    uint32_t names_len;
+    char names[4096];
+    Slot slots[MAX_READERS];
+};
+
+static_assert(sizeof(ReaderMonitor::Event().atr) == MAX_ATR_SIZE && sizeof(ReaderMonitor::Event().uid) == 16,
+              "A slot must fit in a status event");
+
+struct SharedState::Segment {
+    // Set last by an owner initializing the segment
+    std::atomic<uint32_t> magic;
+    uint32_t size;
+    // Odd while the owner writes, the followers sleep on it
+    std::atomic<uint32_t> generation;
+    // pid of the owner, 0 once it closed
+    std::atomic<uint32_t> owner;
+    Data data;
+};
+
+struct SharedState::Watcher {
+    std::string name;
+    std::mutex mutex;
+    ReaderMonitor::EventHandler on_event;
+    ReaderMonitor::ExitHandler on_exit;
+    bool ended;
+    // Generation of the last status delivered
+    uint32_t serial;
+    ReaderMonitor::Event event;
+};
+
+#ifdef __linux__
+static void futex_wait(std::atomic<uint32_t>* word, uint32_t value, unsigned int timeout_ms) {
+    struct timespec timeout = { (time_t)(timeout_ms / 1000), (long)(timeout_ms % 1000) * 1000000 };
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT, value, &timeout, NULL, 0);
+}
+
+static void futex_wake(std::atomic<uint32_t>* word) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+#endif
+
+SharedState::SharedState()
+    : m_role(ROLE_NONE),
+      m_fd(-1),
+      m_segment(NULL),
+      m_closing(false),
+      m_ended(false) {
+}
+
+SharedState::~SharedState() {
+    if (m_thread.joinable()) {
+        close();
+        m_thread.join();
+    }
+
+#ifdef __linux__
+    if (m_segment) {
+        munmap(m_segment, sizeof(Segment));
+    }
+    if (m_fd >= 0) {
+        ::close(m_fd);
+    }
+#endif
+}
+
+bool SharedState::open(const std::string& name, std::string* error) {
+#ifdef __linux__
+    std::string path = (name.empty() || name[0] != '/') ? "/" + name : name;
+    m_fd = shm_open(path.c_str(), O_RDWR | O_CREAT, 0600);
+    if (m_fd < 0) {
+        *error = "Cannot open the shared state " + path + ": " + strerror(errno);
+        return false;
+    }
+
+    // The owner holds the lock for as long as it lives
+    bool owner = flock(m_fd, LOCK_EX | LOCK_NB) == 0;
+    if (owner && ftruncate(m_fd, sizeof(Segment)) != 0) {
+        *error = "Cannot size the shared state " + path + ": " + strerror(errno);
+        return false;
+    }
+
+    for (int i = 0; !m_segment || m_segment->magic.load(std::memory_order_acquire) != MAGIC; i++) {
+        struct stat st;
+        if (i == OPEN_RETRIES || fstat(m_fd, &st) != 0) {
+            *error = "Shared state " + path + " not initialized by its owner";
+            return false;
+        }
+
+        if (!m_segment && st.st_size >= (off_t)sizeof(Segment)) {
+            void* memory = mmap(NULL, sizeof(Segment), owner ? PROT_READ | PROT_WRITE : PROT_READ,
+                                MAP_SHARED, m_fd, 0);
+            if (memory == MAP_FAILED) {
+                *error = "Cannot map the shared state " + path + ": " + strerror(errno);
+                return false;
+            }
+            m_segment = static_cast<Segment*>(memory);
+        }
+
+        if (owner) {
+            // The generation of a previous owner goes on, its followers see every change
+            if (m_segment->magic != MAGIC || m_segment->size != sizeof(Segment)) {
+                m_segment->size = sizeof(Segment);
+                m_segment->generation = 0;
+            } else if (m_segment->generation & 1) {
+                // The previous owner died in the middle of a write
+                m_segment->generation++;
+            }
+            uint32_t generation = begin_write();
+            memset(&m_segment->data, 0, sizeof(Data));
+            m_segment->owner = (uint32_t)getpid();
+            end_write(generation);
+            m_segment->magic.store(MAGIC, std::memory_order_release);
+        } else if (!m_segment || m_segment->magic.load(std::memory_order_acquire) != MAGIC) {
+            usleep(10000);
+        }
+    }
+
+    if (m_segment->size != sizeof(Segment)) {
+        *error = "Shared state " + path + " owned by another version";
+        return false;
+    }
+
+    m_role = owner ? ROLE_OWNER : ROLE_FOLLOWER;
+    return true;
+#else
+    *error = "Shared state is only supported on Linux";
+    return false;
+#endif
+}
+
+// Returns the generation to end the write with
+uint32_t SharedState::begin_write() {
+    uint32_t generation = m_segment->generation.load(std::memory_order_relaxed);
+    m_segment->generation.store(generation + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    // 0 stands for nothing published
+    return (generation + 2) ? generation + 2 : 2;
+}
+
+void SharedState::end_write(uint32_t generation) {
+    m_segment->generation.store(generation, std::memory_order_release);
+#ifdef __linux__
+    futex_wake(&m_segment->generation);
+#endif
+}
+
+// Consistent copy of the data, retried while the owner writes. An owner
+// which died in the middle of a write leaves the generation odd for good:
+// the odd generation is returned then, with no consistent copy.
+uint32_t SharedState::snapshot(Data* data) {
+    for (unsigned int i = 1;; i++) {
+        uint32_t generation = m_segment->generation.load(std::memory_order_acquire);
+        if (!(generation & 1)) {
+            memcpy(data, &m_segment->data, sizeof(Data));
+            std::atomic_thread_fence(std::memory_order_acquire);
+
+            if (m_segment->generation.load(std::memory_order_relaxed) == generation) {
+                return generation;
+            }
+        } else if (i % SNAPSHOT_OWNER_CHECK == 0 && !owner_alive()) {
+            return generation;
+        }
+
+        std::this_thread::yield();
+    }
+}
+
+bool SharedState::owner_alive() {
+    if (!m_segment->owner) {
+        return false;
+    }
+
+#ifdef __linux__
+    // Only granted once the owner lock is gone
+    if (flock(m_fd, LOCK_SH | LOCK_NB) == 0) {
+        flock(m_fd, LOCK_UN);
+        return false;
+    }
+#endif
+
+    return true;
+}
+
+void SharedState::publish_list(const ReaderList::Event& event) {
+    if (m_role != ROLE_OWNER || m_closing || event.notice || event.result != SCARD_S_SUCCESS) {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(m_write_mutex);
+    Data& data = m_segment->data;
+    uint32_t generation = begin_write();
+
+    // Names which do not fit are left out
+    data.names_len = 0;
+    for (size_t offset = 0; offset < event.names.size() && event.names[offset];) {
+        size_t len = strlen(event.names.c_str() + offset) + 1;
+        if (data.names_len + len + 1 <= sizeof(data.names)) {
+            memcpy(data.names + data.names_len, event.names.c_str() + offset, len);
+            data.names_len += len;
+        }
+        offset += len;
+    }
+    if (data.names_len) {
+        data.names[data.names_len++] = '\0';
+    }
+    data.list_serial = generation;
+    data.list_timestamp = event.timestamp;
+    data.list_event_count = event.event_count;
+
+    // The status of the readers gone is dropped
+    for (Slot& slot : data.slots) {
+        bool listed = false;
+        for (size_t offset = 0; slot.serial && offset < data.names_len && data.names[offset];
+             offset += strnlen(data.names + offset, sizeof(data.names) - offset) + 1) {
+            listed = listed || strncmp(slot.name, data.names + offset, MAX_NAME) == 0;
+        }
+        if (!listed) {
+            memset(&slot, 0, sizeof(slot));
+        }
+    }
+
+    end_write(generation);
+}
+
+void SharedState::publish_status(const std::string& reader, const ReaderMonitor::Event& event) {
+    if (m_role != ROLE_OWNER || m_closing || event.notice || reader.size() >= MAX_NAME) {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(m_write_mutex);
+    Slot* slot = NULL;
+    for (Slot& candidate : m_segment->data.slots) {
+        if (candidate.serial && reader == candidate.name) {
+            slot = &candidate;
+            break;
+        }
+        if (!candidate.serial && !slot) {
+            slot = &candidate;
+        }
+    }
+    if (!slot) {
+        return;
+    }
+
+    uint32_t generation = begin_write();
+    memcpy(slot->name, reader.c_str(), reader.size() + 1);
+    slot->serial = generation;
+    slot->result = (uint32_t)event.result;
+    slot->status = event.status;
+    slot->event_count = event.event_count;
+    slot->timestamp = event.timestamp;
+    slot->atrlen = event.atrlen;
+    memcpy(slot->atr, event.atr, event.atrlen);
+    slot->uidlen = event.uidlen;
+    memcpy(slot->uid, event.uid, event.uidlen);
+    end_write(generation);
+}
+
+bool SharedState::follow(ReaderList::EventHandler on_event, ReaderList::ExitHandler on_exit) {
+    if (m_role != ROLE_FOLLOWER || m_thread.joinable()) {
+        return false;
+    }
+
+    m_on_event = on_event;
+    m_on_exit = on_exit;
+    m_thread = std::thread(&SharedState::run, this);
+
+    return true;
+}
+
+// Called with the watcher locked. Generations only grow, so that a snapshot
+// older than the status delivered is ignored.
+static bool newer(uint32_t serial, uint32_t delivered) {
+    return serial && (!delivered || (int32_t)(serial - delivered) > 0);
+}
+
+void SharedState::deliver(const Data& data, const std::shared_ptr<Watcher>& watcher) {
+    if (watcher->ended) {
+        return;
+    }
+
+    for (const Slot& slot : data.slots) {
+        if (!newer(slot.serial, watcher->serial) || strncmp(slot.name, watcher->name.c_str(), MAX_NAME) != 0) {
+            continue;
+        }
+
+        // Written by another process, a slot which does not fit is dropped
+        if (slot.atrlen > sizeof(slot.atr) || slot.uidlen > sizeof(slot.uid)) {
+            return;
+        }
+
+        ReaderMonitor::Event& event = watcher->event;
+        // Parse the ATR only when a new card session starts
+        if (slot.atrlen != event.atrlen || memcmp(event.atr, slot.atr, slot.atrlen) != 0) {
+            atr_parse(slot.atr, slot.atrlen, &event.atr_info);
+            event.atr_session++;
+        }
+        memcpy(event.atr, slot.atr, slot.atrlen);
+        event.atrlen = slot.atrlen;
+        memcpy(event.uid, slot.uid, slot.uidlen);
+        event.uidlen = slot.uidlen;
+        event.result = (LONG)slot.result;
+        event.status = slot.status;
+        event.timestamp = slot.timestamp;
+        event.event_count = slot.event_count;
+        watcher->serial = slot.serial;
+
+        watcher->on_event(event);
+        return;
+    }
+}
+
+bool SharedState::watch(const std::string& reader, ReaderMonitor::EventHandler on_event,
+                        ReaderMonitor::ExitHandler on_exit) {
+    std::shared_ptr<Watcher> watcher = std::make_shared<Watcher>();
+    watcher->name = reader;
+    watcher->on_event = on_event;
+    watcher->on_exit = on_exit;
+    watcher->ended = false;
+    watcher->serial = 0;
+    watcher->event = ReaderMonitor::Event();
+
+    std::unique_lock<std::mutex> lock(watcher->mutex);
+    bool following;
+    {
+        std::unique_lock<std::mutex> watch_lock(m_watch_mutex);
+        if (m_watchers.count(reader)) {
+            return false;
+        }
+        following = !m_closing && !m_ended;
+        if (following) {
+            m_watchers[reader] = watcher;
+        }
+    }
+
+    if (!following) {
+        watcher->ended = true;
+        on_exit();
+        return true;
+    }
+
+    // The current status first, as a monitor reports it when it starts. An
+    // owner dead in the middle of a write left none, the thread ends the watch.
+    std::unique_ptr<Data> data(new Data());
+    if (!(snapshot(data.get()) & 1)) {
+        deliver(*data, watcher);
+    }
+
+    return true;
+}
+
+void SharedState::unwatch(const std::string& reader) {
+    std::shared_ptr<Watcher> watcher;
+    {
+        std::unique_lock<std::mutex> watch_lock(m_watch_mutex);
+        auto it = m_watchers.find(reader);
+        if (it == m_watchers.end()) {
+            return;
+        }
+        watcher = it->second;
+        m_watchers.erase(it);
+    }
+
+    std::unique_lock<std::mutex> lock(watcher->mutex);
+    if (!watcher->ended) {
+        watcher->ended = true;
+        watcher->on_exit();
+    }
+}
+
+void SharedState::close() {
+    bool closing = m_closing.exchange(true);
+    if (!m_segment || closing) {
+        return;
+    }
+
+    if (m_role == ROLE_OWNER) {
+        std::unique_lock<std::mutex> lock(m_write_mutex);
+        uint32_t generation = begin_write();
+        m_segment->owner = 0;
+        end_write(generation);
+#ifdef __linux__
+        // Another process may own the name from now on
+        flock(m_fd, LOCK_UN);
+#endif
+    } else {
+#ifdef __linux__
+        futex_wake(&m_segment->generation);
+#endif
+    }
+}
+
+void SharedState::run() {
+    StatThread counted;
+    std::unique_ptr<Data> data(new Data());
+    // Odd, a complete write never ends with it
+    uint32_t known = 1;
+    uint32_t list_serial = 0;
+
+    while (!m_closing) {
+        uint32_t generation = snapshot(data.get());
+        if (generation != known && !(generation & 1)) {
+            known = generation;
+
+            if (data->list_serial != list_serial) {
+                list_serial = data->list_serial;
+
+                // Written by another process: a list which does not fit, or
+                // whose last name is not terminated, is taken as empty
+                uint32_t names_len = data->names_len;
+                if (names_len > sizeof(data->names) || (names_len && data->names[names_len - 1])) {
+                    names_len = 0;
+                }
+
+                ReaderList::Event event = ReaderList::Event();
+                event.result = SCARD_S_SUCCESS;
+                event.names.assign(data->names, names_len);
+                event.timestamp = data->list_timestamp;
+                event.event_count = data->list_event_count;
+                m_on_event(event);
+            }
+
+            std::vector<std::shared_ptr<Watcher>> watchers;
+            {
+                std::unique_lock<std::mutex> watch_lock(m_watch_mutex);
+                for (auto& entry : m_watchers) {
+                    watchers.push_back(entry.second);
+                }
+            }
+            for (auto& watcher : watchers) {
+                std::unique_lock<std::mutex> lock(watcher->mutex);
+                deliver(*data, watcher);
+            }
+        }
+
+        if (!owner_alive()) {
+            if (!m_closing) {
+                ReaderList::Event event = ReaderList::Event();
+                event.result = SCARD_E_NO_SERVICE;
+                event.method = "SharedState";
+                event.do_exit = true;
+                m_on_event(event);
+            }
+            break;
+        }
+
+#ifdef __linux__
+        futex_wait(&m_segment->generation, known, OWNER_CHECK_MS);
+#endif
+    }
+
+    // The readers end with the reader list
+    std::map<std::string, std::shared_ptr<Watcher>> watchers;
+    {
+        std::unique_lock<std::mutex> watch_lock(m_watch_mutex);
+        m_ended = true;
+        watchers.swap(m_watchers);
+    }
+    for (auto& entry : watchers) {
+        std::unique_lock<std::mutex> lock(entry.second->mutex);
+        if (!entry.second->ended) {
+            entry.second->ended = true;
+            entry.second->on_exit();
+        }
+    }
+
+    m_on_exit();
+}
@@ -0,0 +1,84 @@
+#ifndef SHAREDSTATE_H
+#define SHAREDSTATE_H
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "readerlist.h"
+#include "readermonitor.h"
+
+// Reader list and reader status shared by the processes of a host (Linux
+// only). The first process opening a name owns the shared memory segment and
+// publishes what its monitors see; the others follow it from one thread
+// sleeping on a futex, without PC/SC context or pcscd wake-up of their own.
+// Ownership is a lock on the segment, so it is released when the owner dies.
+class SharedState {
+public:
+    // Readers published at most, and their name size
+    static const size_t MAX_READERS = 32;
+    static const size_t MAX_NAME = 128;
+
+    enum Role {
+        ROLE_NONE,
+        ROLE_OWNER,
+        ROLE_FOLLOWER
+    };
+
+    SharedState();
+    ~SharedState();
+
+    // Creates the segment, or follows the process owning it. *error is set on failures.
+    bool open(const std::string& name, std::string* error);
+    Role role() const { return m_role; }
+
+    // Owner side, called by the monitor threads
+    void publish_list(const ReaderList::Event& event);
+    void publish_status(const std::string& reader, const ReaderMonitor::Event& event);
+
+    // Follower side. List events go to on_event and status events to the
+    // handler watching the reader, starting with its current status. Each
+    // exit handler is called once, the watchers' before on_exit.
+    bool follow(ReaderList::EventHandler on_event, ReaderList::ExitHandler on_exit);
+    // False if the reader is watched already
+    bool watch(const std::string& reader, ReaderMonitor::EventHandler on_event,
+               ReaderMonitor::ExitHandler on_exit);
+    void unwatch(const std::string& reader);
+
+    // Owner: the followers fail with SCARD_E_NO_SERVICE. Follower: wait-free,
+    // the thread ends on its own.
+    void close();
+    bool closing() const { return m_closing; }
+
+private:
+    struct Slot;
+    struct Data;
+    struct Segment;
+    struct Watcher;
+
+    uint32_t begin_write();
+    void end_write(uint32_t generation);
+    uint32_t snapshot(Data* data);
+    bool owner_alive();
+    void deliver(const Data& data, const std::shared_ptr<Watcher>& watcher);
+    void run();
+
+    Role m_role;
+    int m_fd;
+    Segment* m_segment;
+    std::atomic<bool> m_closing;
+    // Owner: the monitor threads publish in turn
+    std::mutex m_write_mutex;
+    // Follower
+    std::thread m_thread;
+    ReaderList::EventHandler m_on_event;
+    ReaderList::ExitHandler m_on_exit;
+    std::mutex m_watch_mutex;
+    std::map<std::string, std::shared_ptr<Watcher>> m_watchers;
+    // Following ended, no reader is watched any more
+    bool m_ended;
+};
+
+#endif /* SHAREDSTATE_H */
@@ -0,0 +1,46 @@
+#include "stats.h"
+#include <atomic>
+#if defined(__GLIBC__)
+#include <malloc.h>
+#elif defined(__APPLE__)
+#include <malloc/malloc.h>
+#endif
+
+static std::atomic<int64_t> s_live[STAT_COUNT];
+static std::atomic<uint64_t> s_total[STAT_COUNT];
+
+void stats_open(Stat stat) {
+    s_live[stat]++;
+    s_total[stat]++;
+}
+
+void stats_close(Stat stat) {
+    s_live[stat]--;
+}
+
+StatValue stats_get(Stat stat) {
+    StatValue value;
+    value.live = s_live[stat];
+    value.total = s_total[stat];
+    return value;
+}
+
+const char* stats_name(Stat stat) {
+    static const char* names[STAT_COUNT] = { "contexts", "handles", "threads", "workers" };
+    return names[stat];
+}
+
+int64_t stats_heap() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+#elif defined(__GLIBC__)
+    // Wraps around past 4 GB
+    struct mallinfo info = mallinfo();
+    return static_cast<unsigned int>(info.uordblks) + static_cast<unsigned int>(info.hblkhd);
+#elif defined(__APPLE__)
+    return mstats().bytes_used;
+#else
+    return -1;
+#endif
+}
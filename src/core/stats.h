@@ -0,0 +1,41 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+
+// Native resources held by the core and the addon, to catch leaks and
+// thread buildup in long running processes. Counters are process wide.
+enum Stat {
+    // PC/SC contexts established and not released yet
+    STAT_CONTEXTS,
+    // Card handles connected
+    STAT_HANDLES,
+    // Monitor, pool and broadcast threads running
+    STAT_THREADS,
+    // Async workers queued or running
+    STAT_WORKERS,
+    STAT_COUNT
+};
+
+struct StatValue {
+    int64_t live;
+    // Opened since the library was loaded
+    uint64_t total;
+};
+
+void stats_open(Stat stat);
+void stats_close(Stat stat);
+StatValue stats_get(Stat stat);
+const char* stats_name(Stat stat);
+
+// Bytes allocated from the native heap, -1 where the allocator cannot tell
+int64_t stats_heap();
+
+// Counts the thread it lives on
+class StatThread {
+public:
+    StatThread() { stats_open(STAT_THREADS); }
+    ~StatThread() { stats_close(STAT_THREADS); }
+};
+
+#endif /* STATS_H */
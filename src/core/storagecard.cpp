@@ -0,0 +1,315 @@
+#include "storagecard.h"
+#include "atr.h"
+#include <algorithm>
+#include <string.h>
+
+// Chunk sizes tried in turn until the reader accepts one. A reader may write
+// less than it was given and still answer 90 00, so writes go one page at a
+// time until a larger chunk has been read back as written.
+static const unsigned int READ_CHUNKS[] = { 240, 128, 64, 32, 16, 0 };
+static const unsigned int WRITE_CHUNKS[] = { 16, 0 };
+
+static const uint16_t SW_OK = 0x9000;
+
+// NXP GET VERSION through the PN53x InCommunicateThru command, which most
+// PC/SC contactless readers pass to the tag with this pseudo APDU
+static const BYTE GET_VERSION[] = { 0xFF, 0x00, 0x00, 0x00, 0x03, 0xD4, 0x42, 0x60 };
+
+// NDEF capability container magic number
+static const BYTE CC_MAGIC = 0xE1;
+
+// User memory of the NXP tags answering GET VERSION, by product type and storage size
+struct VersionSize {
+    BYTE type;
+    BYTE storage;
+    unsigned int user_bytes;
+};
+
+static const VersionSize VERSION_SIZES[] = {
+    { 0x03, 0x0B, 48 },   // MIFARE Ultralight EV1 MF0UL11
+    { 0x03, 0x0E, 128 },  // MIFARE Ultralight EV1 MF0UL21
+    { 0x04, 0x0B, 48 },   // NTAG210
+    { 0x04, 0x0E, 128 },  // NTAG212
+    { 0x04, 0x0F, 144 },  // NTAG213
+    { 0x04, 0x11, 504 },  // NTAG215
+    { 0x04, 0x13, 888 }   // NTAG216
+};
+
+// Largest size of the list up to max which is a whole number of pages
+static unsigned int chunk_size(const unsigned int* chunks, unsigned int max, unsigned int page_size) {
+    for (; *chunks; chunks++) {
+        if (*chunks <= max && *chunks >= page_size && *chunks % page_size == 0) {
+            return *chunks;
+        }
+    }
+    return page_size;
+}
+
+StorageCard::StorageCard(Reader& reader)
+    : m_reader(reader),
+      m_read_chunk(READ_CHUNKS[0]),
+      m_write_chunk(0),
+      m_status(0) {
+}
+
+LONG StorageCard::exchange(const std::vector<BYTE>& apdu, BYTE* out, DWORD* out_len, Error* error) {
+    if (m_reader.secure_messaging()) {
+        return SCARD_W_SECURITY_VIOLATION;
+    }
+
+    LONG result = m_reader.transmit(SCARD_PROTOCOL_UNDEFINED, apdu.data(), (DWORD)apdu.size(), out, out_len);
+    if (result != SCARD_S_SUCCESS) {
+        return result;
+    }
+
+    if (*out_len < 2) {
+        *error = ST_BAD_RESPONSE;
+        return SCARD_S_SUCCESS;
+    }
+
+    *out_len -= 2;
+    m_status = (uint16_t)(out[*out_len] << 8 | out[*out_len + 1]);
+    *error = ST_OK;
+    return SCARD_S_SUCCESS;
+}
+
+LONG StorageCard::read_pages(unsigned int page_size, unsigned int page, unsigned int len, BYTE* out, Error* error) {
+    std::vector<BYTE> apdu(5);
+    BYTE response[258];
+
+    for (unsigned int offset = 0; offset < len;) {
+        unsigned int chunk = chunk_size(READ_CHUNKS, std::min(m_read_chunk, len - offset), page_size);
+        unsigned int address = page + offset / page_size;
+
+        apdu[0] = 0xFF;
+        apdu[1] = 0xB0;
+        apdu[2] = (BYTE)(address >> 8);
+        apdu[3] = (BYTE)address;
+        apdu[4] = (BYTE)chunk;
+
+        DWORD response_len = sizeof(response);
+        LONG result = exchange(apdu, response, &response_len, error);
+        if (result != SCARD_S_SUCCESS || *error != ST_OK) {
+            return result;
+        }
+
+        // Longer responses are fine, some readers always return the 16 bytes of a tag READ
+        if (m_status != SW_OK || response_len < chunk) {
+            if (chunk > page_size) {
+                // Too large for this reader, the next size is tried from the same page
+                m_read_chunk = chunk_size(READ_CHUNKS, chunk - 1, page_size);
+                continue;
+            }
+            *error = (m_status != SW_OK) ? ST_BAD_STATUS : ST_BAD_RESPONSE;
+            return SCARD_S_SUCCESS;
+        }
+
+        memcpy(out + offset, response, chunk);
+        offset += chunk;
+    }
+
+    *error = ST_OK;
+    return SCARD_S_SUCCESS;
+}
+
+LONG StorageCard::write_pages(unsigned int page_size, unsigned int page, const BYTE* data, unsigned int len,
+                              Error* error) {
+    std::vector<BYTE> apdu;
+    BYTE response[258];
+
+    for (unsigned int offset = 0; offset < len;) {
+        // Until probed, only a chunk which is read back right after is larger than a page
+        bool probe = !m_write_chunk;
+        unsigned int chunk = chunk_size(WRITE_CHUNKS, std::min(probe ? WRITE_CHUNKS[0] : m_write_chunk, len - offset),
+                                        page_size);
+        probe = probe && chunk > page_size;
+        unsigned int address = page + offset / page_size;
+
+        apdu.assign({ 0xFF, 0xD6, (BYTE)(address >> 8), (BYTE)address, (BYTE)chunk });
+        apdu.insert(apdu.end(), data + offset, data + offset + chunk);
+
+        DWORD response_len = sizeof(response);
+        LONG result = exchange(apdu, response, &response_len, error);
+        if (result != SCARD_S_SUCCESS || *error != ST_OK) {
+            return result;
+        }
+
+        bool written = (m_status == SW_OK);
+        if (written && probe) {
+            BYTE check[sizeof(response)];
+            result = read_pages(page_size, address, chunk, check, error);
+            if (result != SCARD_S_SUCCESS || *error != ST_OK) {
+                return result;
+            }
+            written = (memcmp(check, data + offset, chunk) == 0);
+        }
+
+        if (!written) {
+            // Writing the same pages again is harmless
+            if (chunk > page_size) {
+                m_write_chunk = page_size;
+                continue;
+            }
+            *error = ST_BAD_STATUS;
+            return SCARD_S_SUCCESS;
+        }
+
+        if (probe) {
+            m_write_chunk = chunk;
+        }
+        offset += chunk;
+    }
+
+    *error = ST_OK;
+    return SCARD_S_SUCCESS;
+}
+
+LONG StorageCard::detect(Layout* layout, Error* error) {
+    *error = ST_OK;
+
+    // Given by the caller
+    if (layout->pages) {
+        if (!layout->page_size) {
+            layout->page_size = 4;
+        }
+        return SCARD_S_SUCCESS;
+    }
+
+    BYTE atr[MAX_ATR_SIZE];
+    DWORD atr_len = sizeof(atr);
+    LONG result = m_reader.atr(atr, &atr_len);
+    if (result != SCARD_S_SUCCESS) {
+        return result;
+    }
+
+    AtrInfo info;
+    atr_parse(atr, atr_len, &info);
+    if (!info.storage) {
+        *error = ST_UNSUPPORTED;
+        return SCARD_S_SUCCESS;
+    }
+
+    bool ultralight = false;
+    unsigned int user_bytes = 0;
+    switch (info.card_name) {
+        case 0x0003:    // MIFARE Ultralight, and the NTAG reported as such
+        case 0x003A:    // MIFARE Ultralight C
+        case 0x003D:    // MIFARE Ultralight EV1
+            ultralight = true;
+            layout->page_size = 4;
+            layout->first_page = 4;
+            user_bytes = (info.card_name == 0x003A) ? 144 : 48;
+            break;
+        case 0x0014:    // ICODE SLI
+            layout->page_size = 4;
+            layout->first_page = 0;
+            user_bytes = 112;
+            break;
+        default:
+            // Other ISO 15693 tags, whose size only their capability container tells.
+            // MIFARE Classic and Plus need an authentication first.
+            if (info.standard < 0x09 || info.standard > 0x0C) {
+                *error = ST_UNSUPPORTED;
+                return SCARD_S_SUCCESS;
+            }
+            layout->page_size = 4;
+            layout->first_page = 0;
+            break;
+    }
+
+    BYTE response[258];
+    DWORD response_len = sizeof(response);
+    layout->has_version = false;
+    if (ultralight) {
+        // Not every reader passes it through, the capability container is the fallback
+        std::vector<BYTE> apdu(GET_VERSION, GET_VERSION + sizeof(GET_VERSION));
+        result = exchange(apdu, response, &response_len, error);
+        if (result == SCARD_S_SUCCESS && *error == ST_OK && m_status == SW_OK && response_len >= 11 &&
+            response[0] == 0xD5 && response[1] == 0x43 && response[2] == 0x00) {
+            layout->has_version = true;
+            memcpy(layout->version, response + 3, sizeof(layout->version));
+        }
+    }
+
+    bool sized = false;
+    if (layout->has_version) {
+        for (const VersionSize& size : VERSION_SIZES) {
+            if (size.type == layout->version[2] && size.storage == layout->version[6]) {
+                user_bytes = size.user_bytes;
+                sized = true;
+            }
+        }
+    }
+
+    if (!sized) {
+        // The NDEF capability container, in page 3 of Type 2 tags and block 0 of Type 5 tags
+        BYTE cc[4];
+        result = read_pages(layout->page_size, ultralight ? 3 : 0, sizeof(cc), cc, error);
+        if (result != SCARD_S_SUCCESS) {
+            return result;
+        }
+        if (*error == ST_OK && cc[0] == CC_MAGIC && cc[2]) {
+            user_bytes = ultralight ? cc[2] * 8 : sizeof(cc) + cc[2] * 8;
+        }
+    }
+
+    if (!user_bytes) {
+        *error = ST_UNSUPPORTED;
+        return SCARD_S_SUCCESS;
+    }
+
+    layout->pages = user_bytes / layout->page_size;
+    *error = ST_OK;
+    return SCARD_S_SUCCESS;
+}
+
+LONG StorageCard::read(const Layout& layout, std::vector<BYTE>* data, Error* error) {
+    data->resize(layout.pages * layout.page_size);
+    return read_pages(layout.page_size, layout.first_page, (unsigned int)data->size(), data->data(), error);
+}
+
+LONG StorageCard::write(const Layout& layout, const BYTE* data, size_t len, bool verify, Error* error) {
+    if (len > (size_t)layout.pages * layout.page_size) {
+        *error = ST_TOO_LARGE;
+        return SCARD_S_SUCCESS;
+    }
+
+    // Whole pages only, the rest of the last one is read first
+    unsigned int padded_len = (unsigned int)((len + layout.page_size - 1) / layout.page_size * layout.page_size);
+    std::vector<BYTE> pages(padded_len);
+    LONG result;
+    if (padded_len != len) {
+        result = read_pages(layout.page_size, layout.first_page + padded_len / layout.page_size - 1,
+                            layout.page_size, &pages[padded_len - layout.page_size], error);
+        if (result != SCARD_S_SUCCESS || *error != ST_OK) {
+            return result;
+        }
+    }
+    memcpy(pages.data(), data, len);
+
+    result = write_pages(layout.page_size, layout.first_page, pages.data(), padded_len, error);
+    if (result != SCARD_S_SUCCESS || *error != ST_OK || !verify) {
+        return result;
+    }
+
+    std::vector<BYTE> check(padded_len);
+    result = read_pages(layout.page_size, layout.first_page, padded_len, check.data(), error);
+    if (result == SCARD_S_SUCCESS && *error == ST_OK && check != pages) {
+        *error = ST_VERIFY_FAILED;
+    }
+
+    return result;
+}
+
+const char* StorageCard::error_string(Error error) {
+    switch (error) {
+        case ST_OK: return "Success";
+        case ST_UNSUPPORTED: return "Unsupported card or unknown memory size";
+        case ST_BAD_STATUS: return "Command failed";
+        case ST_BAD_RESPONSE: return "Malformed response";
+        case ST_TOO_LARGE: return "Data larger than the user memory";
+        case ST_VERIFY_FAILED: return "Written data read back differently";
+    }
+
+    return "Unknown error";
+}
@@ -0,0 +1,64 @@
+#ifndef STORAGECARD_H
+#define STORAGECARD_H
+
+#include "reader.h"
+#include <stdint.h>
+#include <vector>
+
+// Bulk access to the user memory of storage cards (NFC tags: MIFARE
+// Ultralight, NTAG, ICODE) with the PC/SC Part 3 READ BINARY (FF B0) and
+// UPDATE BINARY (FF D6) commands. The memory is addressed in pages, read and
+// written in the largest chunks the reader accepts, so that a whole tag takes
+// a handful of exchanges instead of one per page.
+class StorageCard {
+public:
+    enum Error {
+        ST_OK,
+        ST_UNSUPPORTED,
+        ST_BAD_STATUS,
+        ST_BAD_RESPONSE,
+        ST_TOO_LARGE,
+        ST_VERIFY_FAILED
+    };
+
+    struct Layout {
+        unsigned int page_size;
+        unsigned int first_page;
+        unsigned int pages;
+        // GET VERSION response (NXP tags), when the reader passed it through
+        bool has_version;
+        BYTE version[8];
+    };
+
+    explicit StorageCard(Reader& reader);
+
+    // Fills the layout from the ATR, GET VERSION and the NDEF capability
+    // container. A layout with pages set is kept as given, page_size
+    // defaulting to 4.
+    LONG detect(Layout* layout, Error* error);
+    LONG read(const Layout& layout, std::vector<BYTE>* data, Error* error);
+    // Writes data from the first user page, the end of a partial last page
+    // being preserved, then reads it back when verify is set
+    LONG write(const Layout& layout, const BYTE* data, size_t len, bool verify, Error* error);
+
+    // SW1 SW2 of the command which failed with ST_BAD_STATUS
+    uint16_t status() const { return m_status; }
+    // Largest chunk read at once, once read() probed it
+    unsigned int read_chunk() const { return m_read_chunk; }
+
+    static const char* error_string(Error error);
+
+private:
+    LONG exchange(const std::vector<BYTE>& apdu, BYTE* out, DWORD* out_len, Error* error);
+    // len is a multiple of page_size
+    LONG read_pages(unsigned int page_size, unsigned int page, unsigned int len, BYTE* out, Error* error);
+    LONG write_pages(unsigned int page_size, unsigned int page, const BYTE* data, unsigned int len, Error* error);
+
+    Reader& m_reader;
+    unsigned int m_read_chunk;
+    // 0 until a write larger than a page was probed
+    unsigned int m_write_chunk;
+    uint16_t m_status;
+};
+
+#endif /* STORAGECARD_H */
@@ -0,0 +1,126 @@
+#include "tlv.h"
+
+static bool read_tag(const uint8_t* data, size_t end, size_t* pos, uint32_t* tag) {
+    uint32_t value = data[(*pos)++];
+
+    if ((value & 0x1F) == 0x1F) {
+        // Subsequent bytes until b8 is cleared, up to 4 bytes in all
+        for (int i = 1; ; i++) {
+            if (*pos >= end || i == 4) {
+                return false;
+            }
+            uint8_t b = data[(*pos)++];
+            value = (value << 8) | b;
+            if (!(b & 0x80)) {
+                break;
+            }
+        }
+    }
+
+    *tag = value;
+    return true;
+}
+
+static bool read_length(const uint8_t* data, size_t end, size_t* pos, uint32_t* length) {
+    if (*pos >= end) {
+        return false;
+    }
+
+    uint8_t first = data[(*pos)++];
+    if (first < 0x80) {
+        *length = first;
+        return true;
+    }
+
+    // 80 is the indefinite form, not used by smart cards
+    size_t count = first & 0x7F;
+    if (count == 0 || count > 4 || end - *pos < count) {
+        return false;
+    }
+
+    uint32_t value = 0;
+    for (size_t i = 0; i < count; i++) {
+        value = (value << 8) | data[(*pos)++];
+    }
+
+    *length = value;
+    return true;
+}
+
+bool tlv_index(const uint8_t* data, size_t len, std::vector<TlvNode>* nodes) {
+    // Open constructed nodes, with the end of their value
+    size_t open[TLV_MAX_DEPTH];
+    size_t ends[TLV_MAX_DEPTH + 1];
+    size_t depth = 0;
+    size_t pos = 0;
+
+    nodes->clear();
+    ends[0] = len;
+
+    for (;;) {
+        // Close the constructed nodes ending here
+        while (pos == ends[depth] && depth > 0) {
+            depth--;
+            (*nodes)[open[depth]].next = (uint32_t)nodes->size();
+        }
+
+        if (pos == ends[depth]) {
+            return depth == 0;
+        }
+
+        if (data[pos] == 0x00 || data[pos] == 0xFF) {
+            pos++;
+            continue;
+        }
+
+        bool constructed = (data[pos] & 0x20) != 0;
+        TlvNode node;
+        uint32_t length;
+
+        if (!read_tag(data, ends[depth], &pos, &node.tag) ||
+            !read_length(data, ends[depth], &pos, &length) ||
+            ends[depth] - pos < length) {
+            return false;
+        }
+
+        node.offset = (uint32_t)pos;
+        node.length = length;
+        node.next = (uint32_t)nodes->size() + 1;
+        nodes->push_back(node);
+
+        if (constructed) {
+            if (depth == TLV_MAX_DEPTH) {
+                return false;
+            }
+            open[depth++] = nodes->size() - 1;
+            ends[depth] = pos + length;
+        } else {
+            pos += length;
+        }
+    }
+}
+
+long tlv_find(const std::vector<TlvNode>& nodes, const uint32_t* path, size_t depth) {
+    size_t i = 0;
+    size_t end = nodes.size();
+
+    for (size_t level = 0; level < depth; level++) {
+        while (i < end && nodes[i].tag != path[level]) {
+            i = nodes[i].next;
+        }
+
+        if (i >= end) {
+            return -1;
+        }
+
+        if (level + 1 == depth) {
+            return (long)i;
+        }
+
+        // Descend into the children
+        end = nodes[i].next;
+        i++;
+    }
+
+    return -1;
+}
@@ -0,0 +1,30 @@
+#ifndef TLV_H
+#define TLV_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// Flat offset index over a BER-TLV encoded buffer (ISO 7816-4 / EMV). Nodes
+// are stored in document order and never copy the values: a constructed node
+// is followed by its children, and next points past its last descendant, so
+// that siblings are found by skipping whole subtrees.
+struct TlvNode {
+    uint32_t tag;
+    uint32_t offset;
+    uint32_t length;
+    uint32_t next;
+};
+
+#define TLV_MAX_DEPTH 16
+
+// Indexes data[0..len), skipping 00 and FF padding between objects. Tags
+// longer than 4 bytes, the indefinite length form, lengths overflowing their
+// parent and nesting deeper than TLV_MAX_DEPTH make it fail.
+bool tlv_index(const uint8_t* data, size_t len, std::vector<TlvNode>* nodes);
+
+// Value of the object at the tag path, each tag being a child of the
+// previous one. Returns the node index, or -1 when there is none.
+long tlv_find(const std::vector<TlvNode>& nodes, const uint32_t* path, size_t depth);
+
+#endif /* TLV_H */
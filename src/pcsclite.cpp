@@ -1,17 +1,26 @@
 #include "pcsclite.h"
-#include "common.h"
+#include "cardreader.h"
+#include "addon.h"
+#include <algorithm>
 
 // PCSCLite implementation
 
 Napi::Object PCSCLite::Init(Napi::Env env, Napi::Object exports) {
     Napi::Function func = DefineClass(env, "PCSCLite", {
         InstanceMethod("start", &PCSCLite::Start),
+        InstanceMethod("_broadcast", &PCSCLite::Broadcast),
+        InstanceMethod("_control_batch", &PCSCLite::ControlBatch),
+        InstanceMethod("_match", &PCSCLite::Match),
+        InstanceMethod("_set_queue", &PCSCLite::SetQueue),
+        InstanceMethod("_pause", &PCSCLite::Pause),
+        InstanceMethod("_resume", &PCSCLite::Resume),
+        InstanceMethod("_read", &PCSCLite::Read),
+        InstanceMethod("_set_polling", &PCSCLite::SetPolling),
+        InstanceMethod("rescan", &PCSCLite::Rescan),
         InstanceMethod("close", &PCSCLite::Close)
     });
 
-    Napi::FunctionReference* constructor = new Napi::FunctionReference();
-    *constructor = Napi::Persistent(func);
-    env.SetInstanceData(constructor);
+    env.GetInstanceData<AddonData>()->pcsclite_constructor = Napi::Persistent(func);
 
     exports.Set("PCSCLite", func);
     return exports;
@@ -19,138 +28,238 @@ Napi::Object PCSCLite::Init(Napi::Env env, Napi::Object exports) {
 
 PCSCLite::PCSCLite(const Napi::CallbackInfo& info) 
     : Napi::ObjectWrap<PCSCLite>(info),
-      m_card_context(0),
-      m_card_reader_state(),
-      m_mutex(),
-      m_cond(),
-      m_pnp(false),
-      m_state(0) {
-    
-    // Windows-specific service initialization code
-#ifdef _WIN32
-    HKEY hKey;
-    DWORD startStatus, datacb = sizeof(DWORD);
-    LONG _res;
-    _res = RegOpenKeyEx(HKEY_LOCAL_MACHINE, "System\\CurrentControlSet\\Services\\SCardSvr", 0, KEY_READ, &hKey);
-    if (_res != ERROR_SUCCESS) {
-        printf("Reg Open Key exited with %d\n", _res);
-        goto postServiceCheck;
-    }
-    _res = RegQueryValueEx(hKey, "Start", NULL, NULL, (LPBYTE)&startStatus, &datacb);
-    if (_res != ERROR_SUCCESS) {
-        printf("Reg Query Value exited with %d\n", _res);
-        goto postServiceCheck;
+      m_wake_pending(false),
+      m_flowing(true) {
+
+    // Filtered out readers are dropped from the list before it reaches JS
+    std::vector<std::string> filters[2];
+    for (size_t i = 0; i < 2 && i < info.Length(); i++) {
+        if (info[i].IsUndefined()) {
+            continue;
+        }
+        
+        if (!info[i].IsArray()) {
+            Napi::TypeError::New(info.Env(), "Array of patterns expected").ThrowAsJavaScriptException();
+            return;
+        }
+        
+        Napi::Array patterns = info[i].As<Napi::Array>();
+        for (uint32_t j = 0; j < patterns.Length(); j++) {
+            Napi::Value pattern = patterns.Get(j);
+            if (!pattern.IsString()) {
+                Napi::TypeError::New(info.Env(), "Array of patterns expected").ThrowAsJavaScriptException();
+                return;
+            }
+            filters[i].push_back(pattern.As<Napi::String>().Utf8Value());
+        }
     }
-    if (startStatus != 2) {
-        SHELLEXECUTEINFO seInfo = {0};
-        seInfo.cbSize = sizeof(SHELLEXECUTEINFO);
-        seInfo.fMask = SEE_MASK_NOCLOSEPROCESS;
-        seInfo.hwnd = NULL;
-        seInfo.lpVerb = "runas";
-        seInfo.lpFile = "sc.exe";
-        seInfo.lpParameters = "config SCardSvr start=auto";
-        seInfo.lpDirectory = NULL;
-        seInfo.nShow = SW_SHOWNORMAL;
-        seInfo.hInstApp = NULL;
-        if (!ShellExecuteEx(&seInfo)) {
-            printf("Shell Execute failed with %d\n", GetLastError());
-            goto postServiceCheck;
+    m_list.set_filter(std::move(filters[0]), std::move(filters[1]));
+
+    // The PC/SC library is only loaded once a PCSCLite is needed
+    std::string library;
+    if (info.Length() > 2 && !info[2].IsUndefined()) {
+        if (!info[2].IsString()) {
+            Napi::TypeError::New(info.Env(), "Library path expected").ThrowAsJavaScriptException();
+            return;
         }
-        WaitForSingleObject(seInfo.hProcess, INFINITE);
-        CloseHandle(seInfo.hProcess);
+        library = info[2].As<Napi::String>().Utf8Value();
     }
-postServiceCheck:
-#endif // _WIN32
 
-    LONG result;
-    do {
-        result = SCardEstablishContext(SCARD_SCOPE_SYSTEM, NULL, NULL, &m_card_context);
-    } while(result == SCARD_E_NO_SERVICE || result == SCARD_E_SERVICE_STOPPED);
-    
-    if (result != SCARD_S_SUCCESS) {
-        Napi::Error::New(info.Env(), error_msg("SCardEstablishContext", result)).ThrowAsJavaScriptException();
+    std::string error;
+    if (!pcsc_load(library.empty() ? NULL : library.c_str(), &error)) {
+        Napi::Error::New(info.Env(), error).ThrowAsJavaScriptException();
         return;
-    } 
-    
-    m_card_reader_state.szReader = "\\\\?PnP?\\Notification";
-    m_card_reader_state.dwCurrentState = SCARD_STATE_UNAWARE;
-    result = SCardGetStatusChange(m_card_context, 0, &m_card_reader_state, 1);
+    }
 
-    if ((result != SCARD_S_SUCCESS) && (result != (LONG)SCARD_E_TIMEOUT)) {
-        Napi::Error::New(info.Env(), error_msg("SCardGetStatusChange", result)).ThrowAsJavaScriptException();
-    } else {
-        m_pnp = !(m_card_reader_state.dwEventState & SCARD_STATE_UNKNOWN);
+    // The first process sharing a name monitors for the others
+    if (info.Length() > 3 && !info[3].IsUndefined()) {
+        if (!info[3].IsString()) {
+            Napi::TypeError::New(info.Env(), "Shared state name expected").ThrowAsJavaScriptException();
+            return;
+        }
+
+        m_shared = std::make_shared<SharedState>();
+        if (!m_shared->open(info[3].As<Napi::String>().Utf8Value(), &error)) {
+            Napi::Error::New(info.Env(), error).ThrowAsJavaScriptException();
+            return;
+        }
+
+        bool owner = m_shared->role() == SharedState::ROLE_OWNER;
+        info.This().As<Napi::Object>().Set("shared", Napi::String::New(info.Env(), owner ? "owner" : "follower"));
+        if (!owner) {
+            // Neither context nor monitoring thread of its own
+            return;
+        }
+    }
+
+    const char* method = NULL;
+    LONG result = m_list.init(&method);
+    if (result != SCARD_S_SUCCESS) {
+        Napi::Error(info.Env(), pcsc_error(info.Env(), method, result)).ThrowAsJavaScriptException();
     }
 }
 
 PCSCLite::~PCSCLite() {
-    if (m_status_thread.joinable()) {
-        SCardCancel(m_card_context);
-        m_status_thread.join();
+}
+
+// BroadcastWorker implementation
+PCSCLite::BroadcastWorker::BroadcastWorker(Napi::Function& callback,
+                                           BroadcastInput* input,
+                                           std::vector<Napi::ObjectReference>&& refs,
+                                           std::vector<std::atomic<unsigned int>*>&& pending)
+    : PcscWorker(callback),
+      input_(input),
+      refs_(std::move(refs)),
+      pending_(std::move(pending)) {
+    for (std::atomic<unsigned int>* pending : pending_) {
+        (*pending)++;
     }
+}
 
-    if (m_card_context) {
-        SCardReleaseContext(m_card_context);
+PCSCLite::BroadcastWorker::~BroadcastWorker() {
+    for (std::atomic<unsigned int>* pending : pending_) {
+        (*pending)--;
     }
+    delete input_;
 }
 
-// ReaderWorker implementation
-PCSCLite::ReaderWorker::ReaderWorker(Napi::Function& callback, PCSCLite* pcsclite)
-    : Napi::AsyncWorker(callback),
-      pcsclite_(pcsclite) {
-    async_result_ = new AsyncResult();
+void PCSCLite::BroadcastWorker::Execute() {
+    broadcast(input_->readers, input_->apdus, input_->out_len, input_->concurrency, &results_);
 }
 
-PCSCLite::ReaderWorker::~ReaderWorker() {
-    if (async_result_) {
-#ifdef SCARD_AUTOALLOCATE
-        if (async_result_->readers_name) {
-            SCardFreeMemory(pcsclite_->m_card_context, async_result_->readers_name);
+void PCSCLite::BroadcastWorker::OnOK() {
+    Napi::Env env = Env();
+    Napi::HandleScope scope(env);
+    
+    Napi::Array results = Napi::Array::New(env, results_.size());
+    for (size_t i = 0; i < results_.size(); i++) {
+        const BroadcastResult& result = results_[i];
+        
+        Napi::Array responses = Napi::Array::New(env, result.responses.size());
+        for (size_t j = 0; j < result.responses.size(); j++) {
+            responses.Set(j, Napi::Buffer<BYTE>::Copy(env,
+                                                     result.responses[j].data(),
+                                                     result.responses[j].size()));
         }
-#else
-        delete[] async_result_->readers_name;
-#endif
-        delete async_result_;
+        
+        Napi::Object entry = Napi::Object::New(env);
+        entry.Set("reader", refs_[i].Value());
+        entry.Set("responses", responses);
+        if (result.result != SCARD_S_SUCCESS) {
+            entry.Set("error", pcsc_error(env, "SCardTransmit", result.result));
+        }
+        
+        results.Set(i, entry);
     }
+    
+    Callback().Call({env.Undefined(), results});
 }
 
-void PCSCLite::ReaderWorker::Execute() {
-    // This will run on the worker thread
-    LONG result = pcsclite_->get_card_readers(async_result_);
-    
-    if (result == (LONG)SCARD_E_NO_READERS_AVAILABLE) {
-        result = SCARD_S_SUCCESS;
+// ControlBatchWorker implementation
+PCSCLite::ControlBatchWorker::ControlBatchWorker(Napi::Function& callback,
+                                                 ControlBatchInput* input,
+                                                 std::vector<Napi::ObjectReference>&& refs,
+                                                 std::vector<std::atomic<unsigned int>*>&& pending)
+    : PcscWorker(callback),
+      input_(input),
+      refs_(std::move(refs)),
+      pending_(std::move(pending)) {
+    for (std::atomic<unsigned int>* pending : pending_) {
+        (*pending)++;
     }
+}
 
-    async_result_->result = result;
-    if (result != SCARD_S_SUCCESS) {
-        std::string error = error_msg("SCardListReaders", result);
-        SetError(error);
-        async_result_->err_msg = error;
+PCSCLite::ControlBatchWorker::~ControlBatchWorker() {
+    for (std::atomic<unsigned int>* pending : pending_) {
+        (*pending)--;
     }
+    delete input_;
+}
+
+void PCSCLite::ControlBatchWorker::Execute() {
+    control_batch(input_->entries, input_->concurrency, &results_);
 }
 
-void PCSCLite::ReaderWorker::OnOK() {
-    Napi::HandleScope scope(Env());
+void PCSCLite::ControlBatchWorker::OnOK() {
+    Napi::Env env = Env();
+    Napi::HandleScope scope(env);
     
-    // Prepare callback arguments
-    if (async_result_->readers_name && async_result_->readers_name_length > 0) {
-        Callback().Call({
-            Env().Undefined(),
-            Napi::Buffer<char>::Copy(Env(), 
-                                    async_result_->readers_name, 
-                                    async_result_->readers_name_length)
-        });
+    Napi::Array results = Napi::Array::New(env, results_.size());
+    for (size_t i = 0; i < results_.size(); i++) {
+        const ControlEntryResult& result = results_[i];
+        
+        Napi::Object entry = Napi::Object::New(env);
+        entry.Set("reader", refs_[i * 3].Value());
+        entry.Set("length", Napi::Number::New(env, result.len));
+        if (result.result != SCARD_S_SUCCESS) {
+            entry.Set("error", pcsc_error(env, "SCardControl", result.result));
+        }
+        
+        results.Set(i, entry);
+    }
+    
+    Callback().Call({env.Undefined(), results});
+}
+
+bool PCSCLite::closing() const {
+    if (m_shared && m_shared->role() == SharedState::ROLE_FOLLOWER) {
+        return m_shared->closing();
+    }
+
+    return m_list.closing();
+}
+
+void PCSCLite::dispatch(Napi::Env env, Napi::Function callback, const ReaderList::Event& event) {
+    if (closing()) {
+        // Swallow events: Listening thread was cancelled by user
+    } else if (event.notice) {
+        callback.Call({env.Undefined(), env.Undefined(), Napi::String::New(env, event.notice)});
+    } else if (event.result == SCARD_S_SUCCESS) {
+        Napi::Object stamp = Napi::Object::New(env);
+        stamp.Set("timestamp", hrtime_value(env, event.timestamp));
+        stamp.Set("event_count", Napi::Number::New(env, event.event_count));
+
+        if (!event.names.empty()) {
+            callback.Call({
+                env.Undefined(),
+                Napi::Buffer<char>::Copy(env, event.names.data(), event.names.size()),
+                env.Undefined(),
+                stamp
+            });
+        } else {
+            callback.Call({
+                env.Undefined(),
+                env.Undefined(),
+                env.Undefined(),
+                stamp
+            });
+        }
     } else {
-        Callback().Call({
-            Env().Undefined(),
-            Env().Undefined()
+        // Error case
+        callback.Call({
+            pcsc_error(env, event.method, event.result)
         });
     }
 }
 
-void PCSCLite::ReaderWorker::OnError(const Napi::Error& e) {
-    Callback().Call({e.Value()});
+// Delivers the queued events while flowing, only tells that there are some when paused
+void PCSCLite::drain(Napi::Env env, Napi::Function callback) {
+    m_wake_pending = false;
+
+    if (env == nullptr) {
+        return;
+    }
+
+    if (!m_flowing) {
+        callback.Call({env.Undefined(), env.Undefined(), Napi::String::New(env, "_readable")});
+        return;
+    }
+
+    PCSC_PROBE2(tsfn__dispatch, "", m_queue.size());
+    ReaderList::Event event;
+    while (m_flowing && m_queue.pop(&event)) {
+        dispatch(env, callback, event);
+    }
 }
 
 Napi::Value PCSCLite::Start(const Napi::CallbackInfo& info) {
@@ -163,6 +272,7 @@ Napi::Value PCSCLite::Start(const Napi::CallbackInfo& info) {
     
     Napi::Function callback = info[0].As<Napi::Function>();
     m_callback = Napi::Persistent(callback);
+    m_queue.open();
     
     // Create thread safe function
     m_tsfn = Napi::ThreadSafeFunction::New(
@@ -173,204 +283,254 @@ Napi::Value PCSCLite::Start(const Napi::CallbackInfo& info) {
         1
     );
     
-    // Start the monitoring thread
-    m_status_thread = std::thread(HandlerFunction, this);
+    // Events wait in the bounded queue until JS is ready for them
+    auto on_event = [this](const ReaderList::Event& event) {
+        if (m_shared) {
+            m_shared->publish_list(event);
+        }
+        
+        // Errors and notices are never merged into another reader list
+        bool coalescable = event.result == SCARD_S_SUCCESS && !event.notice;
+        if (m_queue.push(event, coalescable) && !m_wake_pending.exchange(true)) {
+            m_tsfn.NonBlockingCall([this](Napi::Env env, Napi::Function jsCallback) {
+                drain(env, jsCallback);
+            });
+        }
+    };
+    
+    if (m_shared && m_shared->role() == SharedState::ROLE_FOLLOWER) {
+        // The reader list of the owner process
+        m_shared->follow(on_event, [this]() { m_tsfn.Release(); });
+        return env.Undefined();
+    }
+    
+    // Start the monitoring thread, the followers of the list fail once it ends
+    m_list.start(on_event, [this]() {
+        if (m_shared) {
+            m_shared->close();
+        }
+        m_tsfn.Release();
+    });
     
     return env.Undefined();
 }
 
-Napi::Value PCSCLite::Close(const Napi::CallbackInfo& info) {
+Napi::Value PCSCLite::Broadcast(const Napi::CallbackInfo& info) {
     Napi::Env env = info.Env();
-    LONG result = SCARD_S_SUCCESS;
     
-    if (m_pnp) {
-        if (m_status_thread.joinable()) {
-            std::unique_lock<std::mutex> lock(m_mutex);
-            if (m_state == 0) {
-                int ret;
-                int times = 0;
-                m_state = 1;
-                do {
-                    result = SCardCancel(m_card_context);
-                    ret = std::cv_status::timeout == m_cond.wait_for(lock, std::chrono::microseconds(10000000)) ? -1 : 0;
-                } while ((ret != 0) && (++times < 5));
-            }
-        }
-    } else {
-        m_state = 1;
+    if (info.Length() < 5) {
+        Napi::TypeError::New(env, "Wrong number of arguments").ThrowAsJavaScriptException();
+        return env.Undefined();
     }
-
-    if (m_status_thread.joinable()) {
-        m_status_thread.join();
+    
+    if (!info[0].IsArray() || !info[1].IsArray() || !info[2].IsNumber() ||
+        !info[3].IsNumber() || !info[4].IsFunction()) {
+        Napi::TypeError::New(env, "Wrong arguments").ThrowAsJavaScriptException();
+        return env.Undefined();
     }
     
-    if (m_tsfn) {
-        m_tsfn.Release();
+    Napi::Array readers = info[0].As<Napi::Array>();
+    Napi::Array apdus = info[1].As<Napi::Array>();
+    Napi::Function callback = info[4].As<Napi::Function>();
+    Napi::Function card_reader = env.GetInstanceData<AddonData>()->card_reader_constructor.Value();
+    
+    BroadcastInput* bi = new BroadcastInput();
+    bi->out_len = info[2].As<Napi::Number>().Uint32Value();
+    bi->concurrency = std::max<uint32_t>(info[3].As<Napi::Number>().Uint32Value(), 1);
+    
+    std::vector<Napi::ObjectReference> refs;
+    std::vector<std::atomic<unsigned int>*> pending;
+    for (uint32_t i = 0; i < readers.Length(); i++) {
+        Napi::Value value = readers.Get(i);
+        if (!value.IsObject() || !value.As<Napi::Object>().InstanceOf(card_reader)) {
+            delete bi;
+            Napi::TypeError::New(env, "CardReader expected").ThrowAsJavaScriptException();
+            return env.Undefined();
+        }
+        
+        // Keep the readers alive until the worker is done with them
+        CardReader* reader = CardReader::Unwrap(value.As<Napi::Object>());
+        bi->readers.push_back(&reader->GetReader());
+        pending.push_back(reader->GetPending());
+        refs.push_back(Napi::Persistent(value.As<Napi::Object>()));
     }
     
-    return Napi::Number::New(env, result);
+    for (uint32_t i = 0; i < apdus.Length(); i++) {
+        Napi::Value value = apdus.Get(i);
+        if (!value.IsBuffer()) {
+            delete bi;
+            Napi::TypeError::New(env, "Buffer expected").ThrowAsJavaScriptException();
+            return env.Undefined();
+        }
+        
+        Napi::Buffer<BYTE> apdu = value.As<Napi::Buffer<BYTE>>();
+        bi->apdus.emplace_back(apdu.Data(), apdu.Data() + apdu.Length());
+    }
+    
+    BroadcastWorker* worker = new BroadcastWorker(callback, bi, std::move(refs), std::move(pending));
+    worker->Queue();
+    
+    return env.Undefined();
 }
 
-void PCSCLite::HandlerFunction(void* arg) {
-    PCSCLite* pcsclite = static_cast<PCSCLite*>(arg);
-    AsyncResult* async_result = new AsyncResult();
-    LONG result = SCARD_S_SUCCESS;
+Napi::Value PCSCLite::ControlBatch(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
     
-    auto callback = [pcsclite, async_result](Napi::Env env, Napi::Function jsCallback) {
-        if (pcsclite->m_state == 1) {
-            // Swallow events: Listening thread was cancelled by user
-        } else if ((async_result->result == SCARD_S_SUCCESS) ||
-                  (async_result->result == (LONG)SCARD_E_NO_READERS_AVAILABLE)) {
-            // Success case
-            if (async_result->readers_name && async_result->readers_name_length > 0) {
-                jsCallback.Call({
-                    env.Undefined(),
-                    Napi::Buffer<char>::Copy(env, 
-                                           async_result->readers_name, 
-                                           async_result->readers_name_length)
-                });
-            } else {
-                jsCallback.Call({
-                    env.Undefined(),
-                    env.Undefined()
-                });
-            }
-        } else {
-            // Error case
-            jsCallback.Call({
-                Napi::Error::New(env, async_result->err_msg).Value()
-            });
+    if (info.Length() < 3) {
+        Napi::TypeError::New(env, "Wrong number of arguments").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    if (!info[0].IsArray() || !info[1].IsNumber() || !info[2].IsFunction()) {
+        Napi::TypeError::New(env, "Wrong arguments").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+    
+    Napi::Array entries = info[0].As<Napi::Array>();
+    Napi::Function callback = info[2].As<Napi::Function>();
+    Napi::Function card_reader = env.GetInstanceData<AddonData>()->card_reader_constructor.Value();
+    
+    ControlBatchInput* ci = new ControlBatchInput();
+    ci->concurrency = std::max<uint32_t>(info[1].As<Napi::Number>().Uint32Value(), 1);
+    
+    std::vector<Napi::ObjectReference> refs;
+    std::vector<std::atomic<unsigned int>*> pending;
+    for (uint32_t i = 0; i < entries.Length(); i++) {
+        Napi::Value value = entries.Get(i);
+        if (!value.IsObject()) {
+            delete ci;
+            Napi::TypeError::New(env, "Wrong arguments").ThrowAsJavaScriptException();
+            return env.Undefined();
         }
         
-        // Reset AsyncResult for reuse
-#ifdef SCARD_AUTOALLOCATE
-        if (async_result->readers_name) {
-            SCardFreeMemory(pcsclite->m_card_context, async_result->readers_name);
-        }
-#else
-        delete[] async_result->readers_name;
-#endif
-        async_result->readers_name = NULL;
-        async_result->readers_name_length = 0;
-        async_result->result = SCARD_S_SUCCESS;
-    };
-    
-    while (!pcsclite->m_state) {
-        // Get card readers
-        result = pcsclite->get_card_readers(async_result);
-        if (result == (LONG)SCARD_E_NO_READERS_AVAILABLE) {
-            result = SCARD_S_SUCCESS;
+        Napi::Object entry = value.As<Napi::Object>();
+        Napi::Value reader = entry.Get("reader");
+        Napi::Value code = entry.Get("control_code");
+        Napi::Value data = entry.Get("data");
+        Napi::Value output = entry.Get("output");
+        if (!reader.IsObject() || !reader.As<Napi::Object>().InstanceOf(card_reader)) {
+            delete ci;
+            Napi::TypeError::New(env, "CardReader expected").ThrowAsJavaScriptException();
+            return env.Undefined();
         }
         
-        // Store the result
-        async_result->result = result;
-        if (result != SCARD_S_SUCCESS) {
-            async_result->err_msg = error_msg("SCardListReaders", result);
+        if (!code.IsNumber() || !data.IsBuffer() || !output.IsBuffer()) {
+            delete ci;
+            Napi::TypeError::New(env, "Wrong arguments").ThrowAsJavaScriptException();
+            return env.Undefined();
         }
         
-        // Notify the JavaScript thread
-        pcsclite->m_tsfn.BlockingCall(callback);
+        Napi::Buffer<BYTE> in_buf = data.As<Napi::Buffer<BYTE>>();
+        Napi::Buffer<BYTE> out_buf = output.As<Napi::Buffer<BYTE>>();
         
-        if (result == SCARD_S_SUCCESS) {
-            if (pcsclite->m_pnp) {
-                // Set current status
-                pcsclite->m_card_reader_state.dwCurrentState = pcsclite->m_card_reader_state.dwEventState;
-                // Start checking for status change
-                result = SCardGetStatusChange(pcsclite->m_card_context,
-                                             INFINITE,
-                                             &pcsclite->m_card_reader_state,
-                                             1);
-                
-                std::unique_lock<std::mutex> lock(pcsclite->m_mutex);
-                async_result->result = result;
-                if (pcsclite->m_state) {
-                    pcsclite->m_cond.notify_all();
-                }
-                
-                if (result != SCARD_S_SUCCESS) {
-                    pcsclite->m_state = 2;
-                    async_result->err_msg = error_msg("SCardGetStatusChange", result);
-                }
-            } else {
-                // If PnP is not supported, just wait for 1 second
-#ifdef _WIN32
-                Sleep(1000);
-#else
-                usleep(1000000);
-#endif
-            }
-        } else {
-            // Error on last card access, stop monitoring
-            pcsclite->m_state = 2;
-        }
+        CardReader* target = CardReader::Unwrap(reader.As<Napi::Object>());
+        ControlEntry ce;
+        ce.reader = &target->GetReader();
+        ce.control_code = code.As<Napi::Number>().Uint32Value();
+        ce.in_data = in_buf.Data();
+        ce.in_len = in_buf.Length();
+        ce.out_data = out_buf.Data();
+        ce.out_len = out_buf.Length();
+        ci->entries.push_back(ce);
+        pending.push_back(target->GetPending());
+        
+        // Keep the readers and the buffers alive until the worker is done with them
+        refs.push_back(Napi::Persistent(reader.As<Napi::Object>()));
+        refs.push_back(Napi::Persistent(static_cast<Napi::Object>(in_buf)));
+        refs.push_back(Napi::Persistent(static_cast<Napi::Object>(out_buf)));
     }
     
-    // Final notification before exiting
-    async_result->do_exit = true;
-    pcsclite->m_tsfn.BlockingCall(callback);
-    pcsclite->m_tsfn.Release();
+    ControlBatchWorker* worker = new ControlBatchWorker(callback, ci, std::move(refs), std::move(pending));
+    worker->Queue();
     
-    delete async_result;
+    return env.Undefined();
 }
 
-LONG PCSCLite::get_card_readers(AsyncResult* async_result) {
-    DWORD readers_name_length;
-    LPTSTR readers_name;
+Napi::Value PCSCLite::Match(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
     
-    LONG result = SCARD_S_SUCCESS;
+    if (info.Length() < 2 || !info[0].IsString() || !info[1].IsString()) {
+        Napi::TypeError::New(env, "Wrong arguments").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
     
-    // Reset the readers_name in the result
-    async_result->readers_name = NULL;
-    async_result->readers_name_length = 0;
+    std::string pattern = info[0].As<Napi::String>().Utf8Value();
+    std::string name = info[1].As<Napi::String>().Utf8Value();
     
-#ifdef SCARD_AUTOALLOCATE
-    readers_name_length = SCARD_AUTOALLOCATE;
-    result = SCardListReaders(m_card_context,
-                             NULL,
-                             (LPTSTR)&readers_name,
-                             &readers_name_length);
-#else
-    // Find out ReaderNameLength
-    result = SCardListReaders(m_card_context,
-                             NULL,
-                             NULL,
-                             &readers_name_length);
-    if (result != SCARD_S_SUCCESS) {
-        return result;
+    return Napi::Boolean::New(env, ReaderFilter::glob_match(pattern.c_str(), name.c_str()));
+}
+
+Napi::Value PCSCLite::SetQueue(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    if (info.Length() < 2 || !info[0].IsNumber() || !info[1].IsNumber()) {
+        Napi::TypeError::New(env, "Wrong arguments").ThrowAsJavaScriptException();
+        return env.Undefined();
     }
+
+    m_queue.configure(info[0].As<Napi::Number>().Uint32Value(),
+                      static_cast<OverflowPolicy>(info[1].As<Napi::Number>().Uint32Value()));
+
+    return env.Undefined();
+}
+
+Napi::Value PCSCLite::Pause(const Napi::CallbackInfo& info) {
+    m_flowing = false;
+    return info.Env().Undefined();
+}
+
+Napi::Value PCSCLite::Resume(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    m_flowing = true;
+    if (!m_callback.IsEmpty()) {
+        drain(env, m_callback.Value());
+    }
+
+    return env.Undefined();
+}
+
+// Delivers one queued event through the start callback, false when there is none
+Napi::Value PCSCLite::Read(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    ReaderList::Event event;
+
+    if (m_callback.IsEmpty() || !m_queue.pop(&event)) {
+        return Napi::Boolean::New(env, false);
+    }
+
+    dispatch(env, m_callback.Value(), event);
+    return Napi::Boolean::New(env, true);
+}
+
+Napi::Value PCSCLite::SetPolling(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    if (info.Length() < 2 || !info[0].IsNumber() || !info[1].IsNumber()) {
+        Napi::TypeError::New(env, "Wrong arguments").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    m_list.set_polling(info[0].As<Napi::Number>().Uint32Value(),
+                       info[1].As<Napi::Number>().Uint32Value());
+
+    return env.Undefined();
+}
+
+Napi::Value PCSCLite::Rescan(const Napi::CallbackInfo& info) {
+    m_list.rescan();
+    return info.Env().Undefined();
+}
+
+Napi::Value PCSCLite::Close(const Napi::CallbackInfo& info) {
+    // The monitor thread releases the function on its way out, once a
+    // producer blocked on a full queue is released
+    m_queue.close();
     
-    // Allocate Memory for ReaderName and retrieve all readers in the terminal
-    readers_name = new char[readers_name_length];
-    result = SCardListReaders(m_card_context,
-                             NULL,
-                             readers_name,
-                             &readers_name_length);
-#endif
-    
-    if (result != SCARD_S_SUCCESS) {
-#ifndef SCARD_AUTOALLOCATE
-        delete[] readers_name;
-#endif
-        readers_name = NULL;
-        readers_name_length = 0;
-        
-#ifndef SCARD_AUTOALLOCATE
-        // Retry in case of insufficient buffer error
-        if (result == (LONG)SCARD_E_INSUFFICIENT_BUFFER) {
-            result = get_card_readers(async_result);
-        }
-#endif
-        
-        if (result == SCARD_E_NO_SERVICE || result == SCARD_E_SERVICE_STOPPED) {
-            SCardReleaseContext(m_card_context);
-            SCardEstablishContext(SCARD_SCOPE_SYSTEM, NULL, NULL, &m_card_context);
-            result = get_card_readers(async_result);
-        }
-    } else {
-        // Store the readers_name in the result
-        async_result->readers_name = readers_name;
-        async_result->readers_name_length = readers_name_length;
+    if (m_shared && m_shared->role() == SharedState::ROLE_FOLLOWER) {
+        m_shared->close();
+        return Napi::Number::New(info.Env(), SCARD_S_SUCCESS);
     }
     
-    return result;
-}
\ No newline at end of file
+    return Napi::Number::New(info.Env(), m_list.close());
+}
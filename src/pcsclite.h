@@ -2,15 +2,12 @@
 #define PCSCLITE_H
 
 #include <napi.h>
-#ifdef __APPLE__
-#include <PCSC/winscard.h>
-#include <PCSC/wintypes.h>
-#else
-#include <winscard.h>
-#endif
-#include <thread>
-#include <mutex>
-#include <condition_variable>
+#include <memory>
+#include <string>
+#include <vector>
+#include "pcsccore.h"
+#include "pcscworker.h"
+#include "probes.h"
 
 class PCSCLite : public Napi::ObjectWrap<PCSCLite> {
 public:
@@ -18,48 +15,86 @@ public:
     PCSCLite(const Napi::CallbackInfo& info);
     ~PCSCLite();
 
+    // Null unless the reader state is shared with other processes
+    std::shared_ptr<SharedState> GetShared() const { return m_shared; };
+
 private:
-    struct AsyncResult {
-        LONG result;
-        LPSTR readers_name;
-        DWORD readers_name_length;
-        bool do_exit;
-        std::string err_msg;
+    struct BroadcastInput {
+        std::vector<Reader*> readers;
+        std::vector<std::vector<BYTE>> apdus;
+        DWORD out_len;
+        size_t concurrency;
+    };
+
+    // Runs the same APDU sequence on several readers concurrently
+    class BroadcastWorker : public PcscWorker {
+    public:
+        BroadcastWorker(Napi::Function& callback, BroadcastInput* input,
+                        std::vector<Napi::ObjectReference>&& refs,
+                        std::vector<std::atomic<unsigned int>*>&& pending);
+        ~BroadcastWorker();
+
+        void Execute() override;
+        void OnOK() override;
+
+    private:
+        BroadcastInput* input_;
+        std::vector<BroadcastResult> results_;
+        std::vector<Napi::ObjectReference> refs_;
+        // Pending counts of the readers, held until the worker completed
+        std::vector<std::atomic<unsigned int>*> pending_;
+    };
+
+    struct ControlBatchInput {
+        std::vector<ControlEntry> entries;
+        size_t concurrency;
     };
 
-    class ReaderWorker : public Napi::AsyncWorker {
+    // Runs control commands on several readers concurrently, into the JS buffers
+    class ControlBatchWorker : public PcscWorker {
     public:
-        ReaderWorker(Napi::Function& callback, PCSCLite* pcsclite);
-        ~ReaderWorker();
+        // refs holds the reader, input buffer and output buffer of each entry, in turn
+        ControlBatchWorker(Napi::Function& callback, ControlBatchInput* input,
+                           std::vector<Napi::ObjectReference>&& refs,
+                           std::vector<std::atomic<unsigned int>*>&& pending);
+        ~ControlBatchWorker();
 
         void Execute() override;
         void OnOK() override;
-        void OnError(const Napi::Error& e) override;
-        void Notify();
 
     private:
-        PCSCLite* pcsclite_;
-        AsyncResult* async_result_;
+        ControlBatchInput* input_;
+        std::vector<ControlEntryResult> results_;
+        std::vector<Napi::ObjectReference> refs_;
+        std::vector<std::atomic<unsigned int>*> pending_;
     };
 
     // NApi methods
     Napi::Value Start(const Napi::CallbackInfo& info);
+    Napi::Value Broadcast(const Napi::CallbackInfo& info);
+    Napi::Value ControlBatch(const Napi::CallbackInfo& info);
+    Napi::Value Match(const Napi::CallbackInfo& info);
+    Napi::Value SetQueue(const Napi::CallbackInfo& info);
+    Napi::Value Pause(const Napi::CallbackInfo& info);
+    Napi::Value Resume(const Napi::CallbackInfo& info);
+    Napi::Value Read(const Napi::CallbackInfo& info);
+    Napi::Value SetPolling(const Napi::CallbackInfo& info);
+    Napi::Value Rescan(const Napi::CallbackInfo& info);
     Napi::Value Close(const Napi::CallbackInfo& info);
 
     // Internal methods
-    LONG get_card_readers(AsyncResult* async_result);
-    static void HandlerFunction(void* arg);
+    bool closing() const;
+    void dispatch(Napi::Env env, Napi::Function callback, const ReaderList::Event& event);
+    void drain(Napi::Env env, Napi::Function callback);
 
     // Member variables
-    SCARDCONTEXT m_card_context;
-    SCARD_READERSTATE m_card_reader_state;
-    std::thread m_status_thread;
-    std::mutex m_mutex;
-    std::condition_variable m_cond;
-    bool m_pnp;
-    int m_state;
+    ReaderList m_list;
+    std::shared_ptr<SharedState> m_shared;
     Napi::ThreadSafeFunction m_tsfn;
     Napi::FunctionReference m_callback;
+    EventQueue<ReaderList::Event> m_queue;
+    std::atomic<bool> m_wake_pending;
+    bool m_flowing;
 };
 
 #endif /* PCSCLITE_H */
\ No newline at end of file
@@ -0,0 +1,52 @@
+#ifndef PCSCWORKER_H
+#define PCSCWORKER_H
+
+#include <napi.h>
+#include <atomic>
+#include "addon.h"
+#include "stats.h"
+
+// Worker of a PC/SC call. A failed call only keeps the method and the result
+// on the worker thread, the callback getting a PCSCError built from them, so
+// that no message is formatted unless JS reads it.
+class PcscWorker : public Napi::AsyncWorker {
+protected:
+    // *pending counts the workers of the same object until they completed
+    explicit PcscWorker(Napi::Function& callback, std::atomic<unsigned int>* pending = NULL)
+        : Napi::AsyncWorker(callback),
+          m_pending(pending),
+          m_method(NULL),
+          m_result(SCARD_S_SUCCESS) {
+        stats_open(STAT_WORKERS);
+        if (m_pending) {
+            (*m_pending)++;
+        }
+    }
+
+    ~PcscWorker() {
+        if (m_pending) {
+            (*m_pending)--;
+        }
+        stats_close(STAT_WORKERS);
+    }
+
+    // method has to be a literal, it is used once the call returned
+    void SetPcscError(const char* method, LONG result) {
+        m_method = method;
+        m_result = result;
+        SetError(method);
+    }
+
+    void OnError(const Napi::Error& error) override {
+        Napi::HandleScope scope(Env());
+
+        Callback().Call({ m_method ? pcsc_error(Env(), m_method, m_result) : error.Value() });
+    }
+
+private:
+    std::atomic<unsigned int>* m_pending;
+    const char* m_method;
+    LONG m_result;
+};
+
+#endif /* PCSCWORKER_H */
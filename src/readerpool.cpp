@@ -0,0 +1,407 @@
+#include "readerpool.h"
+#include "cardreader.h"
+#include "addon.h"
+
+// ReaderPool implementation
+
+Napi::Object ReaderPool::Init(Napi::Env env, Napi::Object exports) {
+    Napi::Function func = DefineClass(env, "ReaderPool", {
+        InstanceMethod("add", &ReaderPool::Add),
+        InstanceMethod("remove", &ReaderPool::Remove),
+        InstanceMethod("_transmit", &ReaderPool::Transmit),
+        InstanceMethod("close", &ReaderPool::Close),
+        InstanceAccessor("size", &ReaderPool::GetSize, nullptr)
+    });
+
+    exports.Set("ReaderPool", func);
+    return exports;
+}
+
+ReaderPool::ReaderPool(const Napi::CallbackInfo& info)
+    : Napi::ObjectWrap<ReaderPool>(info),
+      m_next(0),
+      m_inflight(0),
+      m_closed(false) {
+
+    Napi::Env env = info.Env();
+
+    if (info.Length() < 1 || !info[0].IsFunction()) {
+        Napi::TypeError::New(env, "Callback function expected").ThrowAsJavaScriptException();
+        m_closed = true;
+        return;
+    }
+
+    Napi::Function callback = info[0].As<Napi::Function>();
+    m_evict_callback = Napi::Persistent(callback);
+
+    // Completions from the member threads are delivered through this function.
+    // It only keeps the loop alive while operations are in flight.
+    m_tsfn = Napi::ThreadSafeFunction::New(
+        env,
+        callback,
+        "ReaderPoolCallback",
+        0,
+        1
+    );
+    m_tsfn.Unref(env);
+}
+
+ReaderPool::~ReaderPool() {
+    if (!m_closed) {
+        for (const std::shared_ptr<Member>& member : m_members) {
+            stop(member);
+        }
+        m_members.clear();
+        m_tsfn.Release();
+    }
+}
+
+ReaderPool::Member::~Member() {
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        closing = true;
+        cond.notify_all();
+    }
+
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+// Internal methods
+bool ReaderPool::is_fatal(LONG result) {
+    switch (result) {
+        case SCARD_E_INVALID_HANDLE:
+        case SCARD_E_NO_SMARTCARD:
+        case SCARD_E_READER_UNAVAILABLE:
+        case SCARD_E_UNKNOWN_READER:
+        case SCARD_E_NO_SERVICE:
+        case SCARD_E_SERVICE_STOPPED:
+        case SCARD_F_COMM_ERROR:
+        case SCARD_W_REMOVED_CARD:
+        case SCARD_W_RESET_CARD:
+        case SCARD_W_UNPOWERED_CARD:
+        case SCARD_W_UNRESPONSIVE_CARD:
+            return true;
+        default:
+            return false;
+    }
+}
+
+std::shared_ptr<ReaderPool::Member> ReaderPool::pick() {
+    std::shared_ptr<Member> best;
+    size_t count = m_members.size();
+
+    // Least pending work wins, ties go round-robin starting after the last pick
+    for (size_t i = 0; i < count; i++) {
+        size_t index = (m_next + i) % count;
+        const std::shared_ptr<Member>& member = m_members[index];
+        if (!best || member->pending < best->pending) {
+            best = member;
+            if (best->pending == 0) {
+                m_next = index + 1;
+                break;
+            }
+        }
+    }
+
+    if (best && best->pending != 0) {
+        m_next++;
+    }
+
+    return best;
+}
+
+bool ReaderPool::dispatch(Napi::Env env, Job* job) {
+    std::shared_ptr<Member> member = pick();
+    if (!member) {
+        return false;
+    }
+
+    job->member = member;
+    member->pending++;
+
+    std::unique_lock<std::mutex> lock(member->mutex);
+    member->jobs.push_back(job);
+    member->cond.notify_one();
+
+    return true;
+}
+
+std::deque<ReaderPool::Job*> ReaderPool::stop(const std::shared_ptr<Member>& member) {
+    std::deque<Job*> jobs;
+
+    {
+        std::unique_lock<std::mutex> lock(member->mutex);
+        member->closing = true;
+        jobs.swap(member->jobs);
+        member->cond.notify_all();
+    }
+
+    member->evicted = true;
+    member->pending -= jobs.size();
+    for (Job* job : jobs) {
+        job->member.reset();
+    }
+
+    return jobs;
+}
+
+void ReaderPool::evict(Napi::Env env, const std::shared_ptr<Member>& member, LONG result) {
+    for (size_t i = 0; i < m_members.size(); i++) {
+        if (m_members[i] == member) {
+            m_members.erase(m_members.begin() + i);
+            break;
+        }
+    }
+
+    // Work queued on the evicted member goes to the remaining ones
+    std::deque<Job*> jobs = stop(member);
+    for (Job* job : jobs) {
+        if (!dispatch(env, job)) {
+            fail(env, job, SCARD_E_NO_READERS_AVAILABLE);
+        }
+    }
+
+    m_evict_callback.Call({
+        member->ref.Value(),
+        pcsc_error(env, "SCardTransmit", result)
+    });
+}
+
+void ReaderPool::fail(Napi::Env env, Job* job, LONG result) {
+    job->result = result;
+    job->responses.clear();
+    complete(env, job);
+}
+
+void ReaderPool::complete(Napi::Env env, Job* job) {
+    Napi::HandleScope scope(env);
+    std::shared_ptr<Member> member = job->member;
+    Napi::Value reader = env.Undefined();
+
+    if (member) {
+        member->pending--;
+        reader = member->ref.Value();
+        if (job->result != SCARD_S_SUCCESS && is_fatal(job->result) && !member->evicted) {
+            evict(env, member, job->result);
+        }
+    }
+
+    Napi::Value error = env.Undefined();
+    if (job->result != SCARD_S_SUCCESS) {
+        error = pcsc_error(env, "SCardTransmit", job->result);
+    }
+
+    Napi::Value data = env.Undefined();
+    if (job->batch) {
+        Napi::Array responses = Napi::Array::New(env, job->responses.size());
+        for (size_t i = 0; i < job->responses.size(); i++) {
+            responses.Set(i, Napi::Buffer<BYTE>::Copy(env,
+                                                     job->responses[i].data(),
+                                                     job->responses[i].size()));
+        }
+        data = responses;
+    } else if (!job->responses.empty()) {
+        data = Napi::Buffer<BYTE>::Copy(env, job->responses[0].data(), job->responses[0].size());
+    }
+
+    Napi::FunctionReference callback = std::move(job->callback);
+    delete job;
+
+    if (--m_inflight == 0) {
+        if (m_closed) {
+            m_tsfn.Release();
+        } else {
+            m_tsfn.Unref(env);
+        }
+        Unref();
+    }
+
+    callback.Call({error, data, reader});
+}
+
+// NApi methods
+Napi::Value ReaderPool::Add(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    if (info.Length() < 1 || !info[0].IsObject() ||
+        !info[0].As<Napi::Object>().InstanceOf(env.GetInstanceData<AddonData>()->card_reader_constructor.Value())) {
+        Napi::TypeError::New(env, "CardReader expected").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    if (m_closed) {
+        Napi::Error::New(env, "Reader pool closed").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    Napi::Object obj = info[0].As<Napi::Object>();
+    Reader* reader = &CardReader::Unwrap(obj)->GetReader();
+    for (const std::shared_ptr<Member>& member : m_members) {
+        if (member->reader == reader) {
+            return Napi::Boolean::New(env, false);
+        }
+    }
+
+    std::shared_ptr<Member> member = std::make_shared<Member>();
+    member->reader = reader;
+    member->ref = Napi::Persistent(obj);
+    member->closing = false;
+    member->pending = 0;
+    member->evicted = false;
+    member->thread = std::thread(MemberFunction, this, member.get());
+    m_members.push_back(member);
+
+    return Napi::Boolean::New(env, true);
+}
+
+Napi::Value ReaderPool::Remove(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    if (info.Length() < 1 || !info[0].IsObject()) {
+        Napi::TypeError::New(env, "CardReader expected").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    Napi::Object obj = info[0].As<Napi::Object>();
+    for (size_t i = 0; i < m_members.size(); i++) {
+        std::shared_ptr<Member> member = m_members[i];
+        if (member->ref.Value().StrictEquals(obj)) {
+            m_members.erase(m_members.begin() + i);
+
+            std::deque<Job*> jobs = stop(member);
+            for (Job* job : jobs) {
+                if (!dispatch(env, job)) {
+                    fail(env, job, SCARD_E_NO_READERS_AVAILABLE);
+                }
+            }
+
+            return Napi::Boolean::New(env, true);
+        }
+    }
+
+    return Napi::Boolean::New(env, false);
+}
+
+Napi::Value ReaderPool::Transmit(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    if (info.Length() < 4) {
+        Napi::TypeError::New(env, "Wrong number of arguments").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    if (!info[0].IsArray() || !info[1].IsNumber() || !info[2].IsBoolean() || !info[3].IsFunction()) {
+        Napi::TypeError::New(env, "Wrong arguments").ThrowAsJavaScriptException();
+        return env.Undefined();
+    }
+
+    Napi::Array apdus = info[0].As<Napi::Array>();
+    Napi::Function callback = info[3].As<Napi::Function>();
+
+    Job* job = new Job();
+    job->out_len = info[1].As<Napi::Number>().Uint32Value();
+    job->batch = info[2].As<Napi::Boolean>().Value();
+    job->result = SCARD_S_SUCCESS;
+
+    for (uint32_t i = 0; i < apdus.Length(); i++) {
+        Napi::Value value = apdus.Get(i);
+        if (!value.IsBuffer()) {
+            delete job;
+            Napi::TypeError::New(env, "Buffer expected").ThrowAsJavaScriptException();
+            return env.Undefined();
+        }
+
+        Napi::Buffer<BYTE> apdu = value.As<Napi::Buffer<BYTE>>();
+        job->apdus.emplace_back(apdu.Data(), apdu.Data() + apdu.Length());
+    }
+
+    job->callback = Napi::Persistent(callback);
+    if (!dispatch(env, job)) {
+        delete job;
+        return Napi::Boolean::New(env, false);
+    }
+
+    // Keep the pool and the event loop alive while work is in flight
+    if (m_inflight++ == 0) {
+        Ref();
+        m_tsfn.Ref(env);
+    }
+
+    return Napi::Boolean::New(env, true);
+}
+
+Napi::Value ReaderPool::Close(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    if (m_closed) {
+        return env.Undefined();
+    }
+
+    std::vector<std::shared_ptr<Member>> members;
+    members.swap(m_members);
+    for (const std::shared_ptr<Member>& member : members) {
+        std::deque<Job*> jobs = stop(member);
+        for (Job* job : jobs) {
+            fail(env, job, SCARD_E_CANCELLED);
+        }
+    }
+
+    // Jobs still running release the function once they complete
+    m_closed = true;
+    if (m_inflight == 0) {
+        m_tsfn.Release();
+    }
+
+    return env.Undefined();
+}
+
+Napi::Value ReaderPool::GetSize(const Napi::CallbackInfo& info) {
+    return Napi::Number::New(info.Env(), m_members.size());
+}
+
+void ReaderPool::MemberFunction(ReaderPool* pool, Member* member) {
+    StatThread counted;
+    for (;;) {
+        std::unique_lock<std::mutex> lock(member->mutex);
+        member->cond.wait(lock, [member]() { return member->closing || !member->jobs.empty(); });
+
+        // Queued jobs of a stopped member are taken over by stop()
+        if (member->closing) {
+            break;
+        }
+
+        Job* job = member->jobs.front();
+        member->jobs.pop_front();
+        lock.unlock();
+
+        job->responses.reserve(job->apdus.size());
+        for (const std::vector<BYTE>& apdu : job->apdus) {
+            // Never in plain to a card in a secure messaging session
+            if (member->reader->secure_messaging()) {
+                job->result = SCARD_W_SECURITY_VIOLATION;
+                break;
+            }
+
+            std::vector<BYTE> response(job->out_len);
+            DWORD len = job->out_len;
+
+            job->result = member->reader->transmit(SCARD_PROTOCOL_UNDEFINED,
+                                                   apdu.data(),
+                                                   apdu.size(),
+                                                   response.data(),
+                                                   &len);
+            if (job->result != SCARD_S_SUCCESS) {
+                break;
+            }
+
+            response.resize(len);
+            job->responses.push_back(std::move(response));
+        }
+
+        pool->m_tsfn.BlockingCall(job, [pool](Napi::Env env, Napi::Function, Job* job) {
+            pool->complete(env, job);
+        });
+    }
+}
@@ -0,0 +1,84 @@
+#ifndef READERPOOL_H
+#define READERPOOL_H
+
+#include <napi.h>
+#ifdef __APPLE__
+#include <PCSC/winscard.h>
+#include <PCSC/wintypes.h>
+#else
+#include <winscard.h>
+#endif
+#include <deque>
+#include <memory>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+class Reader;
+
+class ReaderPool : public Napi::ObjectWrap<ReaderPool> {
+public:
+    static Napi::Object Init(Napi::Env env, Napi::Object exports);
+    ReaderPool(const Napi::CallbackInfo& info);
+    ~ReaderPool();
+
+private:
+    struct Member;
+
+    // A single APDU or a batch submitted to the pool
+    struct Job {
+        std::vector<std::vector<BYTE>> apdus;
+        DWORD out_len;
+        bool batch;
+        LONG result;
+        std::vector<std::vector<BYTE>> responses;
+        std::shared_ptr<Member> member;
+        Napi::FunctionReference callback;
+    };
+
+    // Every member owns a thread, so members never compete for the libuv threadpool
+    struct Member {
+        Reader* reader;
+        Napi::ObjectReference ref;
+        std::thread thread;
+        std::mutex mutex;
+        std::condition_variable cond;
+        std::deque<Job*> jobs;
+        bool closing;
+        // Only touched on the JS thread
+        unsigned int pending;
+        bool evicted;
+
+        ~Member();
+    };
+
+    // NApi methods
+    Napi::Value Add(const Napi::CallbackInfo& info);
+    Napi::Value Remove(const Napi::CallbackInfo& info);
+    Napi::Value Transmit(const Napi::CallbackInfo& info);
+    Napi::Value Close(const Napi::CallbackInfo& info);
+    Napi::Value GetSize(const Napi::CallbackInfo& info);
+
+    // Internal methods
+    std::shared_ptr<Member> pick();
+    bool dispatch(Napi::Env env, Job* job);
+    void complete(Napi::Env env, Job* job);
+    void fail(Napi::Env env, Job* job, LONG result);
+    void evict(Napi::Env env, const std::shared_ptr<Member>& member, LONG result);
+    std::deque<Job*> stop(const std::shared_ptr<Member>& member);
+    static bool is_fatal(LONG result);
+
+    // Thread function
+    static void MemberFunction(ReaderPool* pool, Member* member);
+
+    // Member variables
+    std::vector<std::shared_ptr<Member>> m_members;
+    size_t m_next;
+    unsigned int m_inflight;
+    bool m_closed;
+    Napi::FunctionReference m_evict_callback;
+    Napi::ThreadSafeFunction m_tsfn;
+};
+
+#endif /* READERPOOL_H */
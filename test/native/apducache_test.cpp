@@ -0,0 +1,145 @@
+#include "coretest.h"
+#include "fakecard.h"
+#include "reader.h"
+
+// EMV card with two applications, each with its own record 1 of SFI 1
+struct FakeEmv {
+    char selected;
+    unsigned int reads;
+};
+
+static const char* SELECT_A = "00A4040007 A0000000041010 00";
+static const char* SELECT_B = "00A4040007 A0000000031010 00";
+static const char* READ_RECORD = "00B2010C00";
+
+static std::shared_ptr<FakeEmv> insert_emv() {
+    std::shared_ptr<FakeEmv> card = std::make_shared<FakeEmv>();
+    card->selected = 0;
+    card->reads = 0;
+
+    fake_atr = hex("3B 6E 00 00 80 31 80 66 B0 84 12 01 6E 01 83 00 90 00");
+    fake_card = [card](const std::vector<BYTE>& apdu) {
+        if (apdu == hex(SELECT_A)) {
+            card->selected = 'A';
+            return hex("6F 02 84 00 9000");
+        }
+        if (apdu == hex(SELECT_B)) {
+            card->selected = 'B';
+            return hex("6F 02 84 00 9000");
+        }
+        if (apdu == hex(READ_RECORD)) {
+            card->reads++;
+            if (card->selected == 'A') {
+                return hex("70 03 5A 01 0A 9000");
+            }
+            if (card->selected == 'B') {
+                return hex("70 03 5A 01 0B 9000");
+            }
+            return hex("6985");
+        }
+        return hex("6D00");
+    };
+
+    return card;
+}
+
+// What reader.transmit() does: the cache first, then the card
+static std::vector<BYTE> transmit(Reader& reader, const char* command) {
+    std::vector<BYTE> apdu = hex(command);
+    std::vector<BYTE> response;
+    if (reader.cache().lookup(apdu.data(), apdu.size(), response)) {
+        return response;
+    }
+
+    uint64_t generation = reader.cache().generation();
+    BYTE out[258];
+    DWORD out_len = sizeof(out);
+    CHECK(reader.transmit(SCARD_PROTOCOL_UNDEFINED, apdu.data(), apdu.size(), out, &out_len) == SCARD_S_SUCCESS);
+    reader.cache().store(generation, apdu.data(), apdu.size(), out, out_len);
+    return std::vector<BYTE>(out, out + out_len);
+}
+
+static void connect(Reader& reader) {
+    DWORD protocol;
+    CHECK(reader.connect(SCARD_SHARE_SHARED, SCARD_PROTOCOL_T1, &protocol) == SCARD_S_SUCCESS);
+
+    std::vector<ApduCache::Rule> rules(2);
+    rules[0].pattern = hex("00A4");
+    rules[0].mask = hex("FFFF");
+    rules[1].pattern = hex("00B2");
+    rules[1].mask = hex("FFFF");
+    reader.cache().enable(std::move(rules), 16);
+}
+
+TEST(cache_read_record_per_application) {
+    std::shared_ptr<FakeEmv> card = insert_emv();
+    Reader reader("Fake Reader");
+    connect(reader);
+
+    transmit(reader, SELECT_A);
+    CHECK(transmit(reader, READ_RECORD) == hex("70 03 5A 01 0A 9000"));
+    transmit(reader, SELECT_B);
+    CHECK(card->selected == 'B');
+    CHECK(transmit(reader, READ_RECORD) == hex("70 03 5A 01 0B 9000"));
+    CHECK(card->reads == 2);
+}
+
+TEST(cache_read_record_again) {
+    std::shared_ptr<FakeEmv> card = insert_emv();
+    Reader reader("Fake Reader");
+    connect(reader);
+
+    transmit(reader, SELECT_A);
+    CHECK(transmit(reader, READ_RECORD) == hex("70 03 5A 01 0A 9000"));
+    transmit(reader, SELECT_B);
+    CHECK(transmit(reader, READ_RECORD) == hex("70 03 5A 01 0B 9000"));
+
+    // Back to A, its record is answered from the cache
+    transmit(reader, SELECT_A);
+    CHECK(card->selected == 'A');
+    CHECK(transmit(reader, READ_RECORD) == hex("70 03 5A 01 0A 9000"));
+    CHECK(card->reads == 2);
+
+    // Selecting A again leaves the card where it is
+    transmit(reader, SELECT_A);
+    transmit(reader, SELECT_A);
+    CHECK(card->selected == 'A');
+    CHECK(transmit(reader, READ_RECORD) == hex("70 03 5A 01 0A 9000"));
+    CHECK(card->reads == 2);
+}
+
+TEST(cache_selection_by_another_caller) {
+    std::shared_ptr<FakeEmv> card = insert_emv();
+    Reader reader("Fake Reader");
+    connect(reader);
+
+    transmit(reader, SELECT_A);
+    transmit(reader, READ_RECORD);
+
+    // A SELECT sent around the cache (broadcast, pool...) changes the context all the same
+    std::vector<BYTE> apdu = hex(SELECT_B);
+    BYTE out[258];
+    DWORD out_len = sizeof(out);
+    CHECK(reader.transmit(SCARD_PROTOCOL_UNDEFINED, apdu.data(), apdu.size(), out, &out_len) == SCARD_S_SUCCESS);
+    CHECK(transmit(reader, READ_RECORD) == hex("70 03 5A 01 0B 9000"));
+    CHECK(card->reads == 2);
+}
+
+TEST(cache_failed_selection) {
+    std::shared_ptr<FakeEmv> card = insert_emv();
+    Reader reader("Fake Reader");
+    connect(reader);
+
+    transmit(reader, SELECT_A);
+    transmit(reader, READ_RECORD);
+
+    // Where the card is after 6A 82 is unknown, nothing is answered until the next SELECT
+    transmit(reader, "00A4040007 A0000000999999 00");
+    transmit(reader, READ_RECORD);
+    transmit(reader, READ_RECORD);
+    CHECK(card->reads == 3);
+
+    transmit(reader, SELECT_A);
+    transmit(reader, READ_RECORD);
+    CHECK(card->reads == 3);
+}
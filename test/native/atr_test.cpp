@@ -0,0 +1,67 @@
+#include "coretest.h"
+#include "atr.h"
+
+static AtrInfo parse(const char* text) {
+    std::vector<BYTE> atr = hex(text);
+    AtrInfo info;
+    atr_parse(atr.data(), atr.size(), &info);
+    return info;
+}
+
+// PC/SC Part 3 ATR of a contactless storage card
+TEST(atr_mifare_classic_1k) {
+    AtrInfo info = parse("3B 8F 80 01 80 4F 0C A0 00 00 03 06 03 00 01 00 00 00 00 6A");
+
+    CHECK(info.valid);
+    CHECK(info.storage);
+    CHECK(info.standard == 0x03);
+    CHECK(info.card_name == 0x0001);
+    CHECK(std::string(info.card_type) == "mifare_classic_1k");
+    CHECK(info.interfaces_count == 3);
+    CHECK(info.historical_offset == 4);
+    CHECK(info.historical_len == 15);
+    CHECK(info.tck == 0x6A);
+    CHECK(info.protocols == (SCARD_PROTOCOL_T0 | SCARD_PROTOCOL_T1));
+}
+
+TEST(atr_storage_card_names) {
+    CHECK(std::string(parse("3B 8F 80 01 80 4F 0C A0 00 00 03 06 03 00 03 00 00 00 00 68").card_type) ==
+          "mifare_ultralight");
+    CHECK(std::string(parse("3B 8F 80 01 80 4F 0C A0 00 00 03 06 11 00 3B 00 00 00 00 42").card_type) == "felica");
+}
+
+// Built by the reader from the ATS of an ISO 14443-4 card
+TEST(atr_iso14443_4) {
+    AtrInfo info = parse("3B 88 80 01 00 00 00 00 33 81 81 00 3A");
+
+    CHECK(info.valid);
+    CHECK(!info.storage);
+    CHECK(std::string(info.card_type) == "iso14443_4");
+    CHECK(info.historical_len == 8);
+    CHECK(info.tck == 0x3A);
+    CHECK(info.protocols & SCARD_PROTOCOL_T1);
+}
+
+// Contact card without TD1: T=0 only, and no TCK
+TEST(atr_iso7816_t0) {
+    AtrInfo info = parse("3B 6E 00 00 80 31 80 66 B0 84 0C 01 6E 01 83 00 90 00");
+
+    CHECK(info.valid);
+    CHECK(std::string(info.card_type) == "iso7816");
+    CHECK(info.interfaces[0].tb == 0x00);
+    CHECK(info.interfaces[0].tc == 0x00);
+    CHECK(info.interfaces[0].td == -1);
+    CHECK(info.protocols == SCARD_PROTOCOL_T0);
+    CHECK(info.tck == -1);
+}
+
+TEST(atr_truncated) {
+    CHECK(!parse("3B").valid);
+    CHECK(!parse("3B 8F 80").valid);
+    // Historical bytes cut short
+    AtrInfo info = parse("3B 8F 80 01 80 4F 0C A0 00 00");
+    CHECK(!info.valid);
+    CHECK(std::string(info.card_type) == "unknown");
+    // TCK missing
+    CHECK(!parse("3B 8F 80 01 80 4F 0C A0 00 00 03 06 03 00 01 00 00 00 00").valid);
+}
@@ -0,0 +1,56 @@
+{
+	"targets": [
+		{
+			"target_name": "coretest",
+			"type": "executable",
+			"sources": [
+				"coretest.cpp",
+				"fakecard.cpp",
+				"apducache_test.cpp",
+				"atr_test.cpp",
+				"broadcast_test.cpp",
+				"securemessaging_test.cpp",
+				"storagecard_test.cpp",
+				"../../src/core/apducache.cpp",
+				"../../src/core/arbiter.cpp",
+				"../../src/core/atr.cpp",
+				"../../src/core/broadcast.cpp",
+				"../../src/core/reader.cpp",
+				"../../src/core/readerfeatures.cpp",
+				"../../src/core/securemessaging.cpp",
+				"../../src/core/stats.cpp",
+				"../../src/core/storagecard.cpp",
+				"../../src/core/tlv.cpp"
+			],
+			"include_dirs": [
+				"../../src/core"
+			],
+			"defines": [
+				"PCSC_SECURE_MESSAGING"
+			],
+			"cflags": [
+				"-Wall",
+				"-Wextra",
+				"-Wno-unused-parameter",
+				"-pedantic"
+			],
+			"cflags_cc": [
+				"-std=c++17"
+			],
+			"conditions": [
+				[
+					"OS=='linux'",
+					{
+						"include_dirs": [
+							"/usr/include/PCSC"
+						]
+					}
+				]
+			],
+			"libraries": [
+				"-lcrypto",
+				"-pthread"
+			]
+		}
+	]
+}
@@ -0,0 +1,66 @@
+#include "coretest.h"
+#include "fakecard.h"
+#include "broadcast.h"
+#include <chrono>
+#include <thread>
+
+// Card which needs each SELECT followed by its UPDATE BINARY, as a
+// sequence of two APDUs interleaved with another one would break it
+struct FakeFile {
+    bool selected;
+    unsigned int updates;
+    unsigned int out_of_sequence;
+};
+
+static std::shared_ptr<FakeFile> insert_file() {
+    std::shared_ptr<FakeFile> file = std::make_shared<FakeFile>();
+    file->selected = false;
+    file->updates = 0;
+    file->out_of_sequence = 0;
+
+    fake_atr = hex("3B 6E 00 00 80 31 80 66 B0 84 12 01 6E 01 83 00 90 00");
+    fake_card = [file](const std::vector<BYTE>& apdu) {
+        // Long enough for another thread to come in between two APDUs
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+
+        if (apdu == hex("00A4020C02 0101")) {
+            if (file->selected) {
+                file->out_of_sequence++;
+            }
+            file->selected = true;
+            return hex("9000");
+        }
+        if (apdu[1] == 0xD6) {
+            if (!file->selected) {
+                file->out_of_sequence++;
+                return hex("6986");
+            }
+            file->selected = false;
+            file->updates++;
+            return hex("9000");
+        }
+        return hex("6D00");
+    };
+
+    return file;
+}
+
+TEST(broadcast_reader_listed_twice) {
+    std::shared_ptr<FakeFile> file = insert_file();
+    Reader reader("Fake Reader");
+    DWORD protocol;
+    CHECK(reader.connect(SCARD_SHARE_SHARED, SCARD_PROTOCOL_T1, &protocol) == SCARD_S_SUCCESS);
+
+    std::vector<Reader*> readers = { &reader, &reader, &reader };
+    std::vector<std::vector<BYTE>> apdus = { hex("00A4020C02 0101"), hex("00D6000002 CAFE") };
+    std::vector<BroadcastResult> results;
+    broadcast(readers, apdus, 258, readers.size(), &results);
+
+    CHECK(results.size() == 3);
+    for (const BroadcastResult& result : results) {
+        CHECK(result.result == SCARD_S_SUCCESS);
+        CHECK(result.responses.size() == 2);
+    }
+    CHECK(file->updates == 3);
+    CHECK(file->out_of_sequence == 0);
+}
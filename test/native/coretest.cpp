@@ -0,0 +1,57 @@
+// Native tests of the core library, built apart from the addon:
+//
+//   node-gyp rebuild -C test/native
+//   test/native/build/Release/coretest
+
+#include "coretest.h"
+#include <stdlib.h>
+#include <string.h>
+
+struct TestCase {
+    const char* name;
+    TestFunction function;
+};
+
+static std::vector<TestCase>& test_cases() {
+    static std::vector<TestCase> cases;
+    return cases;
+}
+
+static int failures = 0;
+
+TestRegistration::TestRegistration(const char* name, TestFunction function) {
+    test_cases().push_back(TestCase{ name, function });
+}
+
+void test_failed(const char* file, int line, const char* condition) {
+    fprintf(stderr, "    %s:%d: CHECK(%s) failed\n", file, line, condition);
+    failures++;
+}
+
+std::vector<BYTE> hex(const char* text) {
+    std::vector<BYTE> bytes;
+    for (const char* c = text; *c;) {
+        if (*c == ' ') {
+            c++;
+            continue;
+        }
+        char digits[3] = { c[0], c[1], '\0' };
+        bytes.push_back((BYTE)strtoul(digits, NULL, 16));
+        c += 2;
+    }
+    return bytes;
+}
+
+int main() {
+    int failed_cases = 0;
+
+    for (const TestCase& test : test_cases()) {
+        int before = failures;
+        test.function();
+        printf("%s %s\n", failures == before ? "ok  " : "FAIL", test.name);
+        failed_cases += (failures != before);
+    }
+
+    printf("%zu cases, %d failed\n", test_cases().size(), failed_cases);
+    return failed_cases ? 1 : 0;
+}
@@ -0,0 +1,40 @@
+#ifndef CORETEST_H
+#define CORETEST_H
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#ifdef __APPLE__
+#include <PCSC/winscard.h>
+#include <PCSC/wintypes.h>
+#else
+#include <winscard.h>
+#endif
+
+// Minimal test runner of the core library: TEST() registers a case, CHECK()
+// reports a failed condition and lets the case go on.
+
+typedef void (*TestFunction)();
+
+struct TestRegistration {
+    TestRegistration(const char* name, TestFunction function);
+};
+
+void test_failed(const char* file, int line, const char* condition);
+
+#define TEST(name) \
+    static void name(); \
+    static TestRegistration name##_registration(#name, name); \
+    static void name()
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            test_failed(__FILE__, __LINE__, #condition); \
+        } \
+    } while (0)
+
+// "3B 8F 80..." to bytes, spaces ignored
+std::vector<BYTE> hex(const char* text);
+
+#endif /* CORETEST_H */
@@ -0,0 +1,60 @@
+#include "fakecard.h"
+#include <string.h>
+
+FakeCard fake_card;
+std::vector<BYTE> fake_atr;
+
+extern "C" {
+
+LONG SCardEstablishContext(DWORD scope, LPCVOID reserved1, LPCVOID reserved2, LPSCARDCONTEXT context) {
+    *context = 1;
+    return SCARD_S_SUCCESS;
+}
+
+LONG SCardReleaseContext(SCARDCONTEXT context) {
+    return SCARD_S_SUCCESS;
+}
+
+LONG SCardCancel(SCARDCONTEXT context) {
+    return SCARD_S_SUCCESS;
+}
+
+LONG SCardConnect(SCARDCONTEXT context, LPCSTR reader, DWORD share_mode,
+                  DWORD preferred_protocols, LPSCARDHANDLE handle, LPDWORD protocol) {
+    *handle = 1;
+    *protocol = SCARD_PROTOCOL_T1;
+    return SCARD_S_SUCCESS;
+}
+
+LONG SCardDisconnect(SCARDHANDLE handle, DWORD disposition) {
+    return SCARD_S_SUCCESS;
+}
+
+LONG SCardGetStatusChange(SCARDCONTEXT context, DWORD timeout, SCARD_READERSTATE* states, DWORD count) {
+    for (DWORD i = 0; i < count; i++) {
+        memcpy(states[i].rgbAtr, fake_atr.data(), fake_atr.size());
+        states[i].cbAtr = (DWORD)fake_atr.size();
+        states[i].dwEventState = SCARD_STATE_PRESENT | SCARD_STATE_CHANGED;
+    }
+    return SCARD_S_SUCCESS;
+}
+
+LONG SCardTransmit(SCARDHANDLE handle, const SCARD_IO_REQUEST* send_pci,
+                   LPCBYTE send_buffer, DWORD send_len, SCARD_IO_REQUEST* recv_pci,
+                   LPBYTE recv_buffer, LPDWORD recv_len) {
+    std::vector<BYTE> response = fake_card(std::vector<BYTE>(send_buffer, send_buffer + send_len));
+    if (response.size() > *recv_len) {
+        return SCARD_E_INSUFFICIENT_BUFFER;
+    }
+
+    memcpy(recv_buffer, response.data(), response.size());
+    *recv_len = (DWORD)response.size();
+    return SCARD_S_SUCCESS;
+}
+
+LONG SCardControl(SCARDHANDLE handle, DWORD control_code, LPCVOID send_buffer, DWORD send_len,
+                  LPVOID recv_buffer, DWORD recv_len, LPDWORD returned_len) {
+    return SCARD_E_UNSUPPORTED_FEATURE;
+}
+
+}
@@ -0,0 +1,16 @@
+#ifndef FAKECARD_H
+#define FAKECARD_H
+
+#include <functional>
+#include <memory>
+#include <vector>
+#include "coretest.h"
+
+// Stand-in PC/SC library with one reader and a card inserted. The card
+// answers each APDU with fake_card(), which the tests replace.
+typedef std::function<std::vector<BYTE>(const std::vector<BYTE>& apdu)> FakeCard;
+
+extern FakeCard fake_card;
+extern std::vector<BYTE> fake_atr;
+
+#endif /* FAKECARD_H */
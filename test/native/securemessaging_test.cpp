@@ -0,0 +1,138 @@
+#include "coretest.h"
+#include "fakecard.h"
+#include "securemessaging.h"
+
+// ICAO Doc 9303 part 11, appendix D.4: session keys and counter agreed on by
+// Basic Access Control, then SELECT EF.COM and READ BINARY of its first bytes
+static const char* KS_ENC = "979EC13B1CBFE9DCD01AB0FED307EAE5";
+static const char* KS_MAC = "F1CB1F1FB5ADF208806B89DC579DC1F8";
+static const char* SSC = "887022120C06C226";
+
+struct Exchange {
+    const char* command;
+    const char* response;
+};
+
+static const Exchange ICAO_EXCHANGES[] = {
+    { "0CA4020C158709016375432908C044F68E08BF8B92D635FF24F800",
+      "990290008E08FA855A5D4C50A8ED9000" },
+    { "0CB000000D9701048E08ED6705417E96BA5500",
+      "8709019FF0EC34F9922651990290008E08AD55CC17140B2DED9000" }
+};
+
+// Answers the expected protected commands in turn, 6988 (wrong SM data objects) to the others
+static void serve(const Exchange* exchanges, size_t count, const char* tamper = NULL) {
+    std::shared_ptr<size_t> next = std::make_shared<size_t>(0);
+
+    fake_card = [exchanges, count, next, tamper](const std::vector<BYTE>& apdu) {
+        if (*next >= count || apdu != hex(exchanges[*next].command)) {
+            return hex("6988");
+        }
+        return hex(tamper ? tamper : exchanges[(*next)++].response);
+    };
+}
+
+static bool start(SecureMessaging& sm) {
+    std::vector<BYTE> enc = hex(KS_ENC);
+    std::vector<BYTE> mac = hex(KS_MAC);
+    std::vector<BYTE> ssc = hex(SSC);
+
+    return sm.start(SecureMessaging::CIPHER_3DES, enc.data(), enc.size(), mac.data(), mac.size(),
+                    ssc.data(), ssc.size());
+}
+
+static std::vector<BYTE> transmit(SecureMessaging& sm, const char* command, SecureMessaging::Error* error) {
+    std::vector<BYTE> apdu = hex(command);
+    std::vector<BYTE> response(258);
+    DWORD len = (DWORD)response.size();
+
+    LONG result = sm.transmit(SCARD_PROTOCOL_UNDEFINED, apdu.data(), (DWORD)apdu.size(), response.data(), &len,
+                              error);
+    CHECK(result == SCARD_S_SUCCESS);
+    response.resize(result == SCARD_S_SUCCESS ? len : 0);
+    return response;
+}
+
+TEST(sm_icao_9303_worked_example) {
+    Reader reader("Fake Reader");
+    DWORD protocol;
+    CHECK(reader.connect(SCARD_SHARE_SHARED, SCARD_PROTOCOL_T1, &protocol) == SCARD_S_SUCCESS);
+
+    SecureMessaging sm(reader);
+    serve(ICAO_EXCHANGES, 2);
+    CHECK(start(sm));
+    CHECK(sm.active());
+    CHECK(reader.secure_messaging());
+
+    SecureMessaging::Error error;
+    CHECK(transmit(sm, "00A4020C02011E", &error) == hex("9000"));
+    CHECK(error == SecureMessaging::SM_OK);
+
+    // The counter went up by two, the response data is decrypted and unpadded
+    CHECK(transmit(sm, "00B0000004", &error) == hex("60145F01 9000"));
+    CHECK(error == SecureMessaging::SM_OK);
+    CHECK(sm.active());
+
+    sm.end();
+    CHECK(!sm.active());
+    CHECK(!reader.secure_messaging());
+}
+
+TEST(sm_wrong_mac_ends_the_session) {
+    Reader reader("Fake Reader");
+    DWORD protocol;
+    CHECK(reader.connect(SCARD_SHARE_SHARED, SCARD_PROTOCOL_T1, &protocol) == SCARD_S_SUCCESS);
+
+    SecureMessaging sm(reader);
+    // Last MAC byte changed
+    serve(ICAO_EXCHANGES, 2, "990290008E08FA855A5D4C50A8EC9000");
+    CHECK(start(sm));
+
+    SecureMessaging::Error error;
+    transmit(sm, "00A4020C02011E", &error);
+    CHECK(error == SecureMessaging::SM_BAD_MAC);
+    CHECK(!sm.active());
+    CHECK(!reader.secure_messaging());
+
+    // Nothing is sent any more, in plain or not
+    transmit(sm, "00A4020C02011E", &error);
+    CHECK(error == SecureMessaging::SM_NOT_STARTED);
+}
+
+TEST(sm_unprotected_responses) {
+    Reader reader("Fake Reader");
+    DWORD protocol;
+    CHECK(reader.connect(SCARD_SHARE_SHARED, SCARD_PROTOCOL_T1, &protocol) == SCARD_S_SUCCESS);
+
+    SecureMessaging sm(reader);
+    SecureMessaging::Error error;
+
+    // A success must be protected
+    serve(ICAO_EXCHANGES, 2, "9000");
+    CHECK(start(sm));
+    transmit(sm, "00A4020C02011E", &error);
+    CHECK(error == SecureMessaging::SM_BAD_RESPONSE);
+    CHECK(!sm.active());
+
+    // A plain 6988 is the card ending the session
+    serve(ICAO_EXCHANGES, 0);
+    CHECK(start(sm));
+    CHECK(transmit(sm, "00A4020C02011E", &error) == hex("6988"));
+    CHECK(error == SecureMessaging::SM_OK);
+    CHECK(!sm.active());
+}
+
+TEST(sm_key_lengths) {
+    Reader reader("Fake Reader");
+    SecureMessaging sm(reader);
+    std::vector<BYTE> key = hex("000102030405060708090A0B0C0D0E0F");
+    std::vector<BYTE> ssc8 = hex("0000000000000000");
+    std::vector<BYTE> ssc16 = hex("00000000000000000000000000000000");
+
+    CHECK(!sm.start(SecureMessaging::CIPHER_3DES, key.data(), 8, key.data(), 16, ssc8.data(), 8));
+    CHECK(!sm.start(SecureMessaging::CIPHER_3DES, key.data(), 16, key.data(), 16, ssc16.data(), 16));
+    CHECK(!sm.start(SecureMessaging::CIPHER_AES, key.data(), 16, key.data(), 8, ssc16.data(), 16));
+    CHECK(!sm.active());
+    CHECK(sm.start(SecureMessaging::CIPHER_AES, key.data(), 16, key.data(), 16, ssc16.data(), 16));
+    sm.end();
+}
@@ -0,0 +1,155 @@
+#include "coretest.h"
+#include "fakecard.h"
+#include "storagecard.h"
+#include <string.h>
+
+// NTAG213 behind a PC/SC Part 3 reader: 45 pages of 4 bytes, the NDEF
+// capability container in page 3 and 36 user pages from page 4
+struct FakeTag {
+    enum WriteMode {
+        // Multi-page writes fail with 67 00
+        WRITE_PAGE,
+        // Only the first page of a multi-page write is written, yet 90 00
+        WRITE_TRUNCATED,
+        WRITE_CHUNK
+    };
+
+    BYTE memory[45 * 4];
+    WriteMode write_mode;
+    unsigned int reads;
+    unsigned int writes;
+};
+
+static std::shared_ptr<FakeTag> insert_tag(FakeTag::WriteMode write_mode) {
+    std::shared_ptr<FakeTag> tag = std::make_shared<FakeTag>();
+    for (size_t i = 0; i < sizeof(tag->memory); i++) {
+        tag->memory[i] = (BYTE)i;
+    }
+    memcpy(tag->memory + 12, hex("E1101200").data(), 4);
+    tag->write_mode = write_mode;
+    tag->reads = 0;
+    tag->writes = 0;
+
+    fake_atr = hex("3B 8F 80 01 80 4F 0C A0 00 00 03 06 03 00 03 00 00 00 00 68");
+    fake_card = [tag](const std::vector<BYTE>& apdu) {
+        // GET VERSION: NXP NTAG213
+        if (apdu == hex("FF00000003D44260")) {
+            return hex("D543 00 0004040201000F03 9000");
+        }
+
+        unsigned int offset = (apdu.size() >= 5) ? (apdu[2] << 8 | apdu[3]) * 4 : 0;
+        unsigned int len = (apdu.size() >= 5) ? apdu[4] : 0;
+        if (apdu.size() < 5 || offset + len > sizeof(tag->memory)) {
+            return hex("6A82");
+        }
+
+        if (apdu[0] == 0xFF && apdu[1] == 0xB0) {
+            // A tag READ returns 16 bytes at most
+            tag->reads++;
+            if (len > 16) {
+                return hex("6C10");
+            }
+            std::vector<BYTE> response(tag->memory + offset, tag->memory + offset + len);
+            response.push_back(0x90);
+            response.push_back(0x00);
+            return response;
+        }
+
+        if (apdu[0] == 0xFF && apdu[1] == 0xD6 && apdu.size() == 5 + len) {
+            tag->writes++;
+            if (len > 4 && tag->write_mode == FakeTag::WRITE_PAGE) {
+                return hex("6700");
+            }
+            memcpy(tag->memory + offset, &apdu[5], tag->write_mode == FakeTag::WRITE_TRUNCATED ? 4 : len);
+            return hex("9000");
+        }
+
+        return hex("6D00");
+    };
+
+    return tag;
+}
+
+static void detect(Reader& reader, StorageCard& card, StorageCard::Layout* layout) {
+    DWORD protocol;
+    CHECK(reader.connect(SCARD_SHARE_SHARED, SCARD_PROTOCOL_T1, &protocol) == SCARD_S_SUCCESS);
+
+    StorageCard::Error error;
+    *layout = StorageCard::Layout();
+    CHECK(card.detect(layout, &error) == SCARD_S_SUCCESS);
+    CHECK(error == StorageCard::ST_OK);
+}
+
+TEST(storage_detect_and_read) {
+    std::shared_ptr<FakeTag> tag = insert_tag(FakeTag::WRITE_PAGE);
+    Reader reader("Fake Reader");
+    StorageCard card(reader);
+    StorageCard::Layout layout;
+    detect(reader, card, &layout);
+
+    CHECK(layout.page_size == 4);
+    CHECK(layout.first_page == 4);
+    CHECK(layout.pages == 36);
+    CHECK(layout.has_version);
+
+    // The larger reads are refused, 16 bytes at once is what the tag gives
+    std::vector<BYTE> data;
+    StorageCard::Error error;
+    CHECK(card.read(layout, &data, &error) == SCARD_S_SUCCESS);
+    CHECK(error == StorageCard::ST_OK);
+    CHECK(card.read_chunk() == 16);
+    CHECK(data.size() == 144);
+    CHECK(memcmp(data.data(), tag->memory + 16, data.size()) == 0);
+}
+
+static void check_write(FakeTag::WriteMode write_mode, unsigned int writes) {
+    std::shared_ptr<FakeTag> tag = insert_tag(write_mode);
+    Reader reader("Fake Reader");
+    StorageCard card(reader);
+    StorageCard::Layout layout;
+    detect(reader, card, &layout);
+
+    std::vector<BYTE> data(38);
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = (BYTE)(0xA0 + i);
+    }
+
+    tag->writes = 0;
+    StorageCard::Error error;
+    CHECK(card.write(layout, data.data(), data.size(), false, &error) == SCARD_S_SUCCESS);
+    CHECK(error == StorageCard::ST_OK);
+    CHECK(memcmp(tag->memory + 16, data.data(), data.size()) == 0);
+    // The end of the last page is kept
+    CHECK(tag->memory[16 + 38] == 16 + 38 && tag->memory[16 + 39] == 16 + 39);
+    CHECK(tag->writes == writes);
+}
+
+TEST(storage_write_page_by_page) {
+    // 16 bytes refused, then 10 pages
+    check_write(FakeTag::WRITE_PAGE, 11);
+}
+
+TEST(storage_write_truncating_reader) {
+    // 16 bytes of which only 4 were written, caught by the read back, then 10 pages
+    check_write(FakeTag::WRITE_TRUNCATED, 11);
+}
+
+TEST(storage_write_chunks) {
+    // 16 bytes read back as written, 16 more, then the 2 last pages
+    check_write(FakeTag::WRITE_CHUNK, 4);
+}
+
+TEST(storage_write_too_large) {
+    std::shared_ptr<FakeTag> tag = insert_tag(FakeTag::WRITE_CHUNK);
+    Reader reader("Fake Reader");
+    StorageCard card(reader);
+    StorageCard::Layout layout;
+    detect(reader, card, &layout);
+
+    std::vector<BYTE> data(145);
+    StorageCard::Error error;
+    tag->writes = 0;
+    CHECK(card.write(layout, data.data(), data.size(), false, &error) == SCARD_S_SUCCESS);
+    CHECK(error == StorageCard::ST_TOO_LARGE);
+    CHECK(tag->writes == 0);
+}
@@ -41,6 +41,297 @@ describe('Testing PCSCLite private', function () {
 			}
 
 		});
+
+		it('#start() passes the native timestamp to reader events', function (done) {
+
+			const p = pcsc();
+			const stamp = { timestamp: 123456789n, event_count: 3 };
+
+			try {
+
+				sinon.stub(p, 'start').callsFake(function (startCb) {
+					startCb(undefined, Buffer.from("ACS ACR122U PICC Interface\u0000\u0000"), undefined, stamp);
+				});
+
+				p.on('reader', function (reader, readerStamp) {
+
+					reader.close();
+					readerStamp.timestamp.should.equal(123456789n);
+					readerStamp.event_count.should.equal(3);
+					done();
+
+				});
+
+			} finally {
+				p.close();
+			}
+
+		});
+	});
+
+	describe('polling', function () {
+		it('passes the polling bounds to the native reader list', function () {
+
+			const first = pcsc();
+			const proto = Object.getPrototypeOf(first);
+			first.close();
+			const stub = sinon.stub(proto, '_set_polling');
+
+			try {
+				const p = pcsc({ poll: { max: 5000 } });
+				p.close();
+				stub.calledOnceWith(100, 5000).should.be.true();
+			} finally {
+				stub.restore();
+			}
+
+		});
+	});
+
+	describe('library', function () {
+		it('throws when the PC/SC library cannot be loaded', function () {
+
+			(() => pcsc({ library: '/nonexistent/libpcsclite.so' })).should.throw(/PC\/SC library/);
+
+		});
+	});
+
+	describe('stats', function () {
+		it('counts the native reader list thread and its context', function () {
+
+			const before = pcsc.stats();
+			const p = pcsc();
+			const during = pcsc.stats();
+			p.close();
+
+			during.contexts.live.should.equal(before.contexts.live + 1);
+			during.contexts.total.should.equal(before.contexts.total + 1);
+			pcsc.stats().contexts.live.should.equal(before.contexts.live);
+
+		});
+	});
+
+	describe('shared', function () {
+		it('a PCSCLite sharing the name of another follows it without a context', function () {
+
+			if (process.platform !== 'linux') {
+				this.skip();
+			}
+
+			const owner = pcsc({ shared: 'pcsclite-test' });
+			const before = pcsc.stats();
+			const follower = pcsc({ shared: 'pcsclite-test' });
+			const during = pcsc.stats();
+			follower.close();
+			owner.close();
+
+			owner.shared.should.equal('owner');
+			follower.shared.should.equal('follower');
+			during.contexts.live.should.equal(before.contexts.live);
+
+		});
+	});
+
+	describe('errors', function () {
+		it('names the PC/SC code of an error and formats its message on demand', function () {
+
+			const err = new pcsc.PCSCError(pcsc.PCSCError.SCARD_W_REMOVED_CARD, 'SCardTransmit');
+
+			err.should.be.an.instanceOf(Error);
+			err.code.should.equal(0x80100069);
+			err.symbol.should.equal('SCARD_W_REMOVED_CARD');
+			err.message.should.match(/^SCardTransmit error: .*\(0x80100069\)$/);
+
+		});
+	});
+
+	describe('filters', function () {
+		it('RegExp filters drop readers before any CardReader is created', function (done) {
+
+			const p = pcsc({ exclude: /01$/ });
+
+			try {
+
+				sinon.stub(p, 'start').callsFake(function (startCb) {
+					startCb(undefined, Buffer.from("ACS ACR122U PICC Interface\u0000ACS ACR122U PICC Interface 01\u0000\u0000"));
+				});
+
+				const readers = [];
+
+				p.on('reader', function (reader) {
+					reader.close();
+					readers.push(reader.name);
+				});
+
+				setImmediate(function () {
+					readers.should.eql(["ACS ACR122U PICC Interface"]);
+					done();
+				});
+
+			} finally {
+				p.close();
+			}
+
+		});
+	});
+
+	describe('recovery', function () {
+		it('keeps the readers across a pcscd restart', function (done) {
+
+			const p = pcsc();
+
+			try {
+
+				const list = Buffer.from("MyReader\u0000\u0000");
+
+				sinon.stub(p, 'start').callsFake(function (startCb) {
+					startCb(undefined, list);
+					startCb(undefined, undefined, 'recovering');
+					startCb(undefined, undefined, 'recovered');
+					startCb(undefined, list);
+				});
+
+				const events = [];
+
+				p.on('reader', function (reader) {
+					reader.close();
+					events.push('reader');
+				});
+				p.on('recovering', () => events.push('recovering'));
+				p.on('recovered', () => events.push('recovered'));
+
+				setImmediate(function () {
+					events.should.eql(['reader', 'recovering', 'recovered']);
+					Object.keys(p.readers).should.eql(['MyReader']);
+					done();
+				});
+
+			} finally {
+				p.close();
+			}
+
+		});
+	});
+
+	describe('#broadcast()', function () {
+
+		it('#broadcast() defaults concurrency to the number of readers', function (done) {
+			const p = pcsc();
+			const readers = [{}, {}, {}];
+			const apdus = [Buffer.from([0x00, 0xA4, 0x04, 0x00])];
+
+			sinon.stub(p, '_broadcast').callsFake(function (r, a, res_len, concurrency, cb) {
+				r.should.equal(readers);
+				a.should.equal(apdus);
+				res_len.should.equal(258);
+				concurrency.should.equal(3);
+				cb(undefined, []);
+			});
+
+			p.broadcast(readers, apdus, 258, function (err, results) {
+				should.not.exist(err);
+				results.should.be.empty();
+				p.close();
+				done();
+			});
+		});
+
+		it('#broadcast() honors options.concurrency', function (done) {
+			const p = pcsc();
+
+			sinon.stub(p, '_broadcast').callsFake(function (r, a, res_len, concurrency, cb) {
+				concurrency.should.equal(2);
+				cb(undefined, []);
+			});
+
+			p.broadcast([{}, {}, {}, {}], [], 2, { concurrency: 2 }, function (err) {
+				should.not.exist(err);
+				p.close();
+				done();
+			});
+		});
+
+	});
+
+	describe('#controlBatch()', function () {
+
+		it('#controlBatch() defaults concurrency to the number of readers and slices the responses', function (done) {
+			const p = pcsc();
+			const r1 = {};
+			const r2 = {};
+			const entries = [
+				{ reader: r1, control_code: 0x42000001, data: Buffer.from([0x01]), res_len: 4 },
+				{ reader: r2, control_code: 0x42000001, data: Buffer.from([0x02]), res_len: 4 },
+				{ reader: r1, control_code: 0x42000002, data: Buffer.from([0x03]), res_len: 4 },
+			];
+			const error = new Error('SCardControl error');
+
+			sinon.stub(p, '_control_batch').callsFake(function (batch, concurrency, cb) {
+				concurrency.should.equal(2);
+				batch.should.have.length(3);
+				batch[1].data.should.equal(entries[1].data);
+				batch[1].output.should.have.length(4);
+				batch[0].output[0] = 0x90;
+				cb(undefined, [
+					{ reader: r1, length: 2 },
+					{ reader: r2, length: 0, error: error },
+					{ reader: r1, length: 0 },
+				]);
+			});
+
+			p.controlBatch(entries, function (err, results) {
+				should.not.exist(err);
+				results[0].reader.should.equal(r1);
+				results[0].response.should.eql(Buffer.from([0x90, 0x00]));
+				should.not.exist(results[0].error);
+				results[1].error.should.equal(error);
+				results[2].response.should.have.length(0);
+				p.close();
+				done();
+			});
+		});
+
+	});
+
+});
+
+describe('Testing ReaderPool private', function () {
+
+	describe('#transmit()', function () {
+
+		it('#transmit() single APDU', function (done) {
+			const p = pcsc();
+			const pool = p.pool();
+			const apdu = Buffer.from([0x80, 0xCA, 0x9F, 0x7F, 0x00]);
+
+			sinon.stub(pool, '_transmit').callsFake(function (apdus, res_len, batch, cb) {
+				apdus.should.eql([apdu]);
+				batch.should.be.false();
+				cb(undefined, Buffer.from([0x90, 0x00]));
+				return true;
+			});
+
+			pool.transmit(apdu, 2, function (err, response) {
+				should.not.exist(err);
+				response.should.eql(Buffer.from([0x90, 0x00]));
+				pool.close();
+				p.close();
+				done();
+			});
+		});
+
+		it('#transmit() empty pool', function (done) {
+			const p = pcsc();
+			const pool = p.pool();
+
+			pool.transmit([Buffer.from([0x00, 0x84, 0x00, 0x00, 0x08])], 10, function (err) {
+				should.exist(err);
+				pool.close();
+				p.close();
+				done();
+			});
+		});
+
 	});
 
 });
@@ -88,6 +379,22 @@ describe('Testing CardReader private', function () {
 			});
 		});
 
+		it('#_connect() passes the wait time before the callback', function (done) {
+			const p = get_reader();
+			p.on('reader', function (reader) {
+				const connect_stub = sinon.stub(reader, '_connect').callsFake(function (share_mode, protocol, wait, connect_cb) {
+					connect_cb(undefined, 2);
+				});
+
+				reader.connect({ share_mode: reader.SCARD_SHARE_SHARED, wait: 500 }, function (err, protocol) {
+					should.not.exist(err);
+					sinon.assert.calledWith(connect_stub, reader.SCARD_SHARE_SHARED, sinon.match.number, 500);
+					protocol.should.equal(2);
+					done();
+				});
+			});
+		});
+
 		it('#_connect() already connected', function (done) {
 			const p = get_reader();
 			p.on('reader', function (reader) {
@@ -104,6 +411,213 @@ describe('Testing CardReader private', function () {
 
 	});
 
+	describe('#transmitSync()', function () {
+
+		it('#transmitSync() returns the response as a view into the output buffer', function (done) {
+			const p = get_reader();
+			p.on('reader', function (reader) {
+				reader.connected = true;
+				sinon.stub(reader, '_transmit_sync').callsFake(function (data, output, protocol) {
+					output[0] = 0x90;
+					output[1] = 0x00;
+					return 2;
+				});
+
+				const output = Buffer.alloc(16);
+				const response = reader.transmitSync(Buffer.from([0x00, 0xB0, 0x00, 0x00, 0x00]), output, 2);
+				response.should.eql(Buffer.from([0x90, 0x00]));
+				response.buffer.should.equal(output.buffer);
+				done();
+			});
+		});
+
+	});
+
+	describe('#escape()', function () {
+
+		it('#escape() uses the escape code the reader lists', function (done) {
+			const p = get_reader();
+			p.on('reader', function (reader) {
+				reader.connected = true;
+				sinon.stub(reader, '_features').callsFake(function (features_cb) {
+					features_cb(undefined, { ccid_esc_command: 0x42330013 }, {});
+				});
+				const control_stub = sinon.stub(reader, '_control').callsFake(function (data, code, output, control_cb) {
+					control_cb(undefined, 0);
+				});
+
+				reader.escape(Buffer.from([0x01]), 16, function (err) {
+					should.not.exist(err);
+					sinon.assert.calledWith(control_stub, sinon.match.any, 0x42330013);
+					done();
+				});
+			});
+		});
+
+	});
+
+	describe('#writeStorage()', function () {
+
+		it('#writeStorage() passes the data and options to the native engine', function (done) {
+			const p = get_reader();
+			p.on('reader', function (reader) {
+				reader.connected = true;
+				const storage_stub = sinon.stub(reader, '_storage').callsFake(function (write, data, options, storage_cb) {
+					storage_cb(undefined, undefined, { page_size: 4, first_page: 4, pages: 36 });
+				});
+
+				const data = Buffer.from([0x03, 0x00, 0xFE]);
+				reader.writeStorage(data, { verify: true }, function (err, layout) {
+					should.not.exist(err);
+					sinon.assert.calledWith(storage_stub, true, data, { verify: true });
+					layout.pages.should.equal(36);
+					done();
+				});
+			});
+		});
+
+	});
+
+	describe('#transmit() cache', function () {
+
+		it('#transmit() answers from the cache', function (done) {
+			const p = get_reader();
+			p.on('reader', function (reader) {
+				reader.connected = true;
+				sinon.stub(reader, '_enable_cache');
+				sinon.stub(reader, '_cache_lookup').returns(Buffer.from([0x90, 0x00]));
+				const transmit_stub = sinon.stub(reader, '_transmit');
+
+				reader.enableCache([Buffer.from([0x00, 0xA4, 0x04, 0x00])]);
+				reader.transmit(Buffer.from([0x00, 0xA4, 0x04, 0x00, 0x00]), 2, 2, function (err, data) {
+					should.not.exist(err);
+					data.should.eql(Buffer.from([0x90, 0x00]));
+					sinon.assert.notCalled(transmit_stub);
+					done();
+				});
+			});
+		});
+
+		it('#transmit() falls through on a miss', function (done) {
+			const p = get_reader();
+			p.on('reader', function (reader) {
+				reader.connected = true;
+				sinon.stub(reader, '_enable_cache');
+				sinon.stub(reader, '_cache_lookup').returns(undefined);
+				sinon.stub(reader, '_transmit').callsFake(function (data, res_len, protocol, cb) {
+					cb(undefined, Buffer.from([0x6A, 0x82]));
+				});
+
+				reader.enableCache([{ apdu: Buffer.from([0x00, 0xB2]), mask: Buffer.from([0xFF, 0xFF]) }]);
+				reader.transmit(Buffer.from([0x00, 0xB2, 0x01, 0x0C, 0x00]), 2, 2, function (err, data) {
+					should.not.exist(err);
+					data.should.eql(Buffer.from([0x6A, 0x82]));
+					done();
+				});
+			});
+		});
+
+	});
+
+	describe('#transmit() tlv', function () {
+
+		it('#transmit() finds values as views into the response', function (done) {
+			const p = get_reader();
+			p.on('reader', function (reader) {
+				reader.connected = true;
+				// 6F 09 84 02 A0 00 A5 03 50 01 41, 90 00
+				const response = Buffer.from('6f098402a000a5035001419000', 'hex');
+				sinon.stub(reader, '_transmit').callsFake(function (data, res_len, protocol, cb, tlv) {
+					tlv.should.be.true();
+					cb(undefined, response, new Uint32Array([0x6F, 2, 9, 4, 0x84, 4, 2, 2, 0xA5, 8, 3, 4, 0x50, 10, 1, 4]));
+				});
+
+				reader.transmit(Buffer.from([0x00, 0xA4, 0x04, 0x00, 0x00]), 258, 2, { tlv: true }, function (err, data, tlv) {
+					should.not.exist(err);
+					tlv.find(['6F', 'A5', '50']).should.eql(Buffer.from('A'));
+					tlv.find([0x6F, 0x84]).buffer.should.equal(response.buffer);
+					should.not.exist(tlv.find(['6F', '50']));
+					done();
+				});
+			});
+		});
+
+	});
+
+	describe('#statusEvents()', function () {
+
+		it('#statusEvents() delivers the queued statuses on demand', function (done) {
+			const p = get_reader();
+			p.on('reader', function (reader) {
+				const queued = [{ state: 0x12 }, { state: 0x22 }];
+				sinon.stub(reader, '_set_queue');
+				sinon.stub(reader, '_pause');
+				sinon.stub(reader, '_resume');
+				sinon.stub(reader, '_read').callsFake(function () {
+					if (!queued.length) {
+						return false;
+					}
+					reader.emit('status', queued.shift());
+					return true;
+				});
+
+				const it = reader.statusEvents({ overflow: 'coalesce', highWaterMark: 4 });
+				sinon.assert.calledWith(reader._set_queue, 4, 1);
+
+				it.next().then(function (first) {
+					first.value.state.should.equal(0x12);
+					return it.next();
+				}).then(function (second) {
+					second.value.state.should.equal(0x22);
+					return it.return();
+				}).then(function () {
+					sinon.assert.calledOnce(reader._resume);
+					sinon.assert.calledWith(reader._set_queue, 64, 2);
+					reader.close();
+					done();
+				}).catch(done);
+			});
+		});
+
+	});
+
+	describe('#startSecureMessaging()', function () {
+
+		it('#startSecureMessaging() hands the session keys to the native side', function (done) {
+			const p = get_reader();
+			p.on('reader', function (reader) {
+				reader.connected = true;
+				reader._sm_start = sinon.stub();
+				const enc = Buffer.alloc(16, 1);
+				const mac = Buffer.alloc(16, 2);
+				const ssc = Buffer.alloc(16);
+
+				reader.startSecureMessaging({ cipher: 'aes', enc: enc, mac: mac, ssc: ssc });
+				sinon.assert.calledWith(reader._sm_start, 1, enc, mac, ssc);
+				(() => reader.startSecureMessaging({ cipher: 'rc4', enc: enc, mac: mac, ssc: ssc })).should.throw(TypeError);
+				done();
+			});
+		});
+
+	});
+
+	describe('#setDebounce()', function () {
+
+		it('#setDebounce() passes the options to the status thread', function (done) {
+			const p = get_reader();
+			p.on('reader', function (reader) {
+				const stub = sinon.stub(reader, '_set_debounce');
+
+				reader.setDebounce({ dwell: 50, uid: true });
+				sinon.assert.calledWith(stub, 50, 0, true);
+				reader.setDebounce();
+				sinon.assert.calledWith(stub, 0, 0, false);
+				done();
+			});
+		});
+
+	});
+
 	describe('#_disconnect()', function () {
 
 		it('#_disconnect() success', function (done) {